@@ -0,0 +1,394 @@
+/* GStreamer examples - in-memory static asset serving
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "example-assets.h"
+
+#include <gio/gio.h>
+#include <string.h>
+
+/* Everything a response needs is computed when an asset is loaded, serving
+ * it is a hash table lookup plus a couple of header comparisons. Pages are
+ * revalidated on every load, which is a cheap 304 thanks to the ETag, so
+ * edits show up right away. */
+
+#define MIN_COMPRESS_SIZE 256
+#define MAX_ASSET_SIZE (4 * 1024 * 1024)    /* skips binaries and the like */
+#define RELOAD_DELAY 100        /* ms, coalesces the events of one save */
+#define PAGE_CACHE_CONTROL "no-cache"
+#define ASSET_CACHE_CONTROL "public, max-age=300"
+
+typedef struct
+{
+  gchar *content_type;
+  GBytes *data;
+  GBytes *gzip_data;
+  gchar *etag;
+  gchar *gzip_etag;
+  const gchar *cache_control;
+} Asset;
+
+struct _ExampleAssets
+{
+  GFile *directory;
+  GFileMonitor *monitor;
+  guint reload_id;
+
+  GHashTable *files;            /* path -> Asset */
+  GHashTable *embedded;         /* path -> Asset */
+  GHashTable *aliases;          /* alias -> path */
+};
+
+static void
+asset_free (gpointer data)
+{
+  Asset *asset = (Asset *) data;
+
+  g_free (asset->content_type);
+  g_bytes_unref (asset->data);
+  if (asset->gzip_data != NULL)
+    g_bytes_unref (asset->gzip_data);
+  g_free (asset->etag);
+  g_free (asset->gzip_etag);
+  g_slice_free (Asset, asset);
+}
+
+static gboolean
+is_compressible (const gchar * content_type)
+{
+  return g_str_has_prefix (content_type, "text/")
+      || g_str_has_suffix (content_type, "javascript")
+      || g_str_has_suffix (content_type, "json")
+      || g_str_has_suffix (content_type, "xml");
+}
+
+static GBytes *
+gzip_bytes (GBytes * data)
+{
+  GZlibCompressor *compressor;
+  GOutputStream *memory, *stream;
+  gsize len;
+  gconstpointer contents = g_bytes_get_data (data, &len);
+  GBytes *result = NULL;
+
+  compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, 9);
+  memory = g_memory_output_stream_new_resizable ();
+  stream = g_converter_output_stream_new (memory, G_CONVERTER (compressor));
+
+  if (g_output_stream_write_all (stream, contents, len, NULL, NULL, NULL)
+      && g_output_stream_close (stream, NULL, NULL))
+    result =
+        g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (memory));
+
+  g_object_unref (stream);
+  g_object_unref (memory);
+  g_object_unref (compressor);
+
+  return result;
+}
+
+/* Takes ownership of @data */
+static Asset *
+asset_new (const gchar * content_type, GBytes * data)
+{
+  Asset *asset = g_slice_new0 (Asset);
+  gchar *checksum;
+
+  asset->content_type = g_strdup (content_type);
+  asset->data = data;
+  asset->cache_control = g_str_has_prefix (content_type, "text/html") ?
+      PAGE_CACHE_CONTROL : ASSET_CACHE_CONTROL;
+
+  checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA1, data);
+  asset->etag = g_strdup_printf ("\"%.16s\"", checksum);
+
+  /* Only keep the gzip variant if it is actually smaller */
+  if (g_bytes_get_size (data) >= MIN_COMPRESS_SIZE
+      && is_compressible (content_type)) {
+    asset->gzip_data = gzip_bytes (data);
+    if (asset->gzip_data != NULL
+        && g_bytes_get_size (asset->gzip_data) >= g_bytes_get_size (data))
+      g_clear_pointer (&asset->gzip_data, g_bytes_unref);
+    if (asset->gzip_data != NULL)
+      asset->gzip_etag = g_strdup_printf ("\"%.16s-gz\"", checksum);
+  }
+  g_free (checksum);
+
+  return asset;
+}
+
+static Asset *
+asset_load (GFile * file)
+{
+  GFileInfo *info;
+  gchar *contents, *name, *guessed, *content_type;
+  gsize len;
+  Asset *asset;
+
+  info = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+      G_FILE_ATTRIBUTE_STANDARD_SIZE, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+  if (info == NULL)
+    return NULL;
+  if (g_file_info_get_file_type (info) != G_FILE_TYPE_REGULAR
+      || g_file_info_get_size (info) > MAX_ASSET_SIZE) {
+    g_object_unref (info);
+    return NULL;
+  }
+  g_object_unref (info);
+
+  if (!g_file_load_contents (file, NULL, &contents, &len, NULL, NULL))
+    return NULL;
+
+  name = g_file_get_basename (file);
+  guessed = g_content_type_guess (name, (const guchar *) contents, len, NULL);
+  g_free (name);
+  content_type = g_content_type_get_mime_type (guessed);
+  if (content_type == NULL)
+    content_type = g_strdup ("application/octet-stream");
+
+  asset = asset_new (content_type, g_bytes_new_take (contents, len));
+
+  g_free (content_type);
+  g_free (guessed);
+
+  return asset;
+}
+
+static void
+load_directory (ExampleAssets * assets)
+{
+  GFileEnumerator *enumerator;
+  GFileInfo *info;
+  GError *error = NULL;
+
+  g_hash_table_remove_all (assets->files);
+
+  enumerator = g_file_enumerate_children (assets->directory,
+      G_FILE_ATTRIBUTE_STANDARD_NAME, G_FILE_QUERY_INFO_NONE, NULL, &error);
+  if (enumerator == NULL) {
+    g_warning ("Could not read assets directory: %s", error->message);
+    g_error_free (error);
+    return;
+  }
+
+  while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL))) {
+    const gchar *name = g_file_info_get_name (info);
+    GFile *file = g_file_get_child (assets->directory, name);
+    Asset *asset = asset_load (file);
+
+    if (asset != NULL)
+      g_hash_table_replace (assets->files, g_strconcat ("/", name, NULL),
+          asset);
+
+    g_object_unref (file);
+    g_object_unref (info);
+  }
+  g_object_unref (enumerator);
+}
+
+static gboolean
+reload_cb (gpointer user_data)
+{
+  ExampleAssets *assets = (ExampleAssets *) user_data;
+
+  assets->reload_id = 0;
+  load_directory (assets);
+  g_message ("Reloaded %u assets", g_hash_table_size (assets->files));
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+directory_changed_cb (G_GNUC_UNUSED GFileMonitor * monitor,
+    G_GNUC_UNUSED GFile * file, G_GNUC_UNUSED GFile * other_file,
+    G_GNUC_UNUSED GFileMonitorEvent event_type, gpointer user_data)
+{
+  ExampleAssets *assets = (ExampleAssets *) user_data;
+  GSource *source;
+
+  if (assets->reload_id != 0)
+    return;
+
+  source = g_timeout_source_new (RELOAD_DELAY);
+  g_source_set_callback (source, reload_cb, assets, NULL);
+  assets->reload_id =
+      g_source_attach (source, g_main_context_get_thread_default ());
+  g_source_unref (source);
+}
+
+ExampleAssets *
+example_assets_new (const gchar * directory)
+{
+  ExampleAssets *assets = g_slice_new0 (ExampleAssets);
+
+  assets->files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      asset_free);
+  assets->embedded = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      asset_free);
+  assets->aliases = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      g_free);
+
+  if (directory == NULL)
+    return assets;
+
+  assets->directory = g_file_new_for_path (directory);
+  load_directory (assets);
+
+  assets->monitor = g_file_monitor_directory (assets->directory,
+      G_FILE_MONITOR_WATCH_MOVES, NULL, NULL);
+  if (assets->monitor != NULL)
+    g_signal_connect (assets->monitor, "changed",
+        G_CALLBACK (directory_changed_cb), assets);
+
+  return assets;
+}
+
+void
+example_assets_free (ExampleAssets * assets)
+{
+  if (assets->monitor != NULL) {
+    g_signal_handlers_disconnect_by_data (assets->monitor, assets);
+    g_file_monitor_cancel (assets->monitor);
+    g_object_unref (assets->monitor);
+  }
+  if (assets->reload_id != 0)
+    g_source_destroy (g_main_context_find_source_by_id
+        (g_main_context_get_thread_default (), assets->reload_id));
+  g_clear_object (&assets->directory);
+
+  g_hash_table_unref (assets->files);
+  g_hash_table_unref (assets->embedded);
+  g_hash_table_unref (assets->aliases);
+  g_slice_free (ExampleAssets, assets);
+}
+
+void
+example_assets_add_embedded (ExampleAssets * assets, const gchar * path,
+    const gchar * content_type, const gchar * data)
+{
+  g_hash_table_replace (assets->embedded, g_strdup (path),
+      asset_new (content_type, g_bytes_new_static (data, strlen (data))));
+}
+
+void
+example_assets_add_alias (ExampleAssets * assets, const gchar * alias,
+    const gchar * path)
+{
+  g_hash_table_replace (assets->aliases, g_strdup (alias), g_strdup (path));
+}
+
+static gboolean
+accepts_gzip (SoupMessage * message)
+{
+  const gchar *accept_encoding;
+  GSList *codings, *l;
+  gboolean gzip = FALSE;
+
+  accept_encoding = soup_message_headers_get_list (message->request_headers,
+      "Accept-Encoding");
+  if (accept_encoding == NULL)
+    return FALSE;
+
+  codings = soup_header_parse_quality_list (accept_encoding, NULL);
+  for (l = codings; l != NULL && !gzip; l = l->next)
+    gzip = g_ascii_strcasecmp (l->data, "gzip") == 0;
+  soup_header_free_list (codings);
+
+  return gzip;
+}
+
+static gboolean
+etag_matches (SoupMessage * message, const gchar * etag)
+{
+  const gchar *if_none_match;
+
+  if_none_match = soup_message_headers_get_list (message->request_headers,
+      "If-None-Match");
+  if (if_none_match == NULL)
+    return FALSE;
+
+  return g_strcmp0 (if_none_match, "*") == 0
+      || soup_header_contains (if_none_match, etag);
+}
+
+gboolean
+example_assets_serve (ExampleAssets * assets, SoupMessage * message,
+    const gchar * path)
+{
+  const gchar *target;
+  const gchar *etag;
+  GBytes *data;
+  Asset *asset;
+  gsize len;
+  gconstpointer contents;
+
+  target = g_hash_table_lookup (assets->aliases, path);
+  if (target != NULL)
+    path = target;
+
+  asset = g_hash_table_lookup (assets->files, path);
+  if (asset == NULL)
+    asset = g_hash_table_lookup (assets->embedded, path);
+  if (asset == NULL)
+    return FALSE;
+
+  if (message->method != SOUP_METHOD_GET && message->method != SOUP_METHOD_HEAD) {
+    soup_message_set_status (message, SOUP_STATUS_METHOD_NOT_ALLOWED);
+    soup_message_headers_append (message->response_headers, "Allow",
+        "GET, HEAD");
+    return TRUE;
+  }
+
+  if (asset->gzip_data != NULL && accepts_gzip (message)) {
+    data = asset->gzip_data;
+    etag = asset->gzip_etag;
+    soup_message_headers_replace (message->response_headers,
+        "Content-Encoding", "gzip");
+  } else {
+    data = asset->data;
+    etag = asset->etag;
+  }
+
+  soup_message_headers_replace (message->response_headers, "ETag", etag);
+  soup_message_headers_replace (message->response_headers, "Cache-Control",
+      asset->cache_control);
+  if (asset->gzip_data != NULL)
+    soup_message_headers_replace (message->response_headers, "Vary",
+        "Accept-Encoding");
+
+  if (etag_matches (message, etag)) {
+    soup_message_headers_remove (message->response_headers,
+        "Content-Encoding");
+    soup_message_set_status (message, SOUP_STATUS_NOT_MODIFIED);
+    return TRUE;
+  }
+
+  /* The body references the cached bytes, nothing is copied */
+  contents = g_bytes_get_data (data, &len);
+  soup_message_headers_set_content_type (message->response_headers,
+      asset->content_type, NULL);
+  soup_message_body_append_buffer (message->response_body,
+      soup_buffer_new_with_owner (contents, len, g_bytes_ref (data),
+          (GDestroyNotify) g_bytes_unref));
+  soup_message_set_status (message, SOUP_STATUS_OK);
+
+  return TRUE;
+}
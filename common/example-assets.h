@@ -0,0 +1,49 @@
+/* GStreamer examples - in-memory static asset serving
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#ifndef __EXAMPLE_ASSETS_INCLUDED__
+#define __EXAMPLE_ASSETS_INCLUDED__
+
+#include <glib.h>
+#include <libsoup/soup.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ExampleAssets ExampleAssets;
+
+/* Loads every regular file in @directory once, gzips the compressible ones
+ * and reloads them when the directory changes. @directory may be NULL to
+ * only serve embedded assets. Must be used from the thread-default main
+ * context it was created on. */
+ExampleAssets *example_assets_new (const gchar * directory);
+void example_assets_free (ExampleAssets * assets);
+
+/* Served when @path is not found in the directory, @data must be static */
+void example_assets_add_embedded (ExampleAssets * assets, const gchar * path,
+    const gchar * content_type, const gchar * data);
+void example_assets_add_alias (ExampleAssets * assets, const gchar * alias,
+    const gchar * path);
+
+/* Answers GET/HEAD requests with ETag, Cache-Control and, if accepted, gzip
+ * Content-Encoding. Returns FALSE without touching @message if there is no
+ * asset for @path. */
+gboolean example_assets_serve (ExampleAssets * assets, SoupMessage * message,
+    const gchar * path);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_ASSETS_INCLUDED__ */
@@ -0,0 +1,381 @@
+/* GStreamer examples - flow controlled data channel sending
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "example-datachannel.h"
+
+#include <string.h>
+
+/* Writing into the SCTP association as fast as the application produces
+ * data only grows buffered-amount until usrsctp runs out of send space and
+ * the channel errors out. Instead at most HIGH_WATERMARK bytes are kept in
+ * flight, everything else waits in a bounded queue of our own that is
+ * refilled from on-buffered-amount-low, which fires once buffered-amount
+ * falls below LOW_WATERMARK. */
+
+#define HIGH_WATERMARK (1024 * 1024)
+#define LOW_WATERMARK (256 * 1024)
+#define BATCH_MAX_MESSAGE 1024  /* bigger messages are framed on their own */
+#define BATCH_SIZE (16 * 1024)  /* well below the default max-message-size */
+#define BATCH_DELAY 2           /* ms */
+#define FRAME_HEADER_SIZE 4
+
+typedef struct
+{
+  GBytes *data;
+  gsize size;
+  guint n_messages;
+  gboolean is_string;
+} Pending;
+
+struct _ExampleChannelSender
+{
+  gint refcount;
+  GMutex lock;
+
+  GstWebRTCDataChannel *channel;
+  GMainContext *context;
+  gsize max_queued_bytes;
+  gboolean batch;
+  gboolean closed;
+
+  GQueue queue;                 /* Pending */
+  gsize queued_bytes;
+
+  GByteArray *pending_batch;
+  guint pending_batch_messages;
+  GSource *flush_source;
+
+  ExampleChannelStats stats;
+};
+
+static ExampleChannelSender *
+sender_ref (ExampleChannelSender * sender)
+{
+  g_atomic_int_inc (&sender->refcount);
+  return sender;
+}
+
+static void
+pending_free (Pending * pending)
+{
+  g_bytes_unref (pending->data);
+  g_slice_free (Pending, pending);
+}
+
+static void
+sender_unref (ExampleChannelSender * sender)
+{
+  if (!g_atomic_int_dec_and_test (&sender->refcount))
+    return;
+
+  g_queue_foreach (&sender->queue, (GFunc) pending_free, NULL);
+  g_queue_clear (&sender->queue);
+  g_byte_array_unref (sender->pending_batch);
+  gst_object_unref (sender->channel);
+  g_main_context_unref (sender->context);
+  g_mutex_clear (&sender->lock);
+  g_slice_free (ExampleChannelSender, sender);
+}
+
+/* Takes ownership of @data */
+static gboolean
+enqueue_locked (ExampleChannelSender * sender, GBytes * data,
+    guint n_messages, gboolean is_string)
+{
+  Pending *pending;
+  gsize size = g_bytes_get_size (data);
+
+  if (sender->queued_bytes + size > sender->max_queued_bytes) {
+    sender->stats.dropped += n_messages;
+    g_bytes_unref (data);
+    return FALSE;
+  }
+
+  pending = g_slice_new (Pending);
+  pending->data = data;
+  pending->size = is_string ? size - 1 : size;
+  pending->n_messages = n_messages;
+  pending->is_string = is_string;
+  g_queue_push_tail (&sender->queue, pending);
+
+  sender->queued_bytes += size;
+  sender->stats.max_queued_bytes =
+      MAX (sender->stats.max_queued_bytes, sender->queued_bytes);
+
+  return TRUE;
+}
+
+static void
+take_batch_locked (ExampleChannelSender * sender)
+{
+  GBytes *data;
+
+  if (sender->flush_source != NULL) {
+    g_source_destroy (sender->flush_source);
+    g_source_unref (sender->flush_source);
+    sender->flush_source = NULL;
+  }
+
+  if (sender->pending_batch->len == 0)
+    return;
+
+  data = g_byte_array_free_to_bytes (sender->pending_batch);
+  sender->pending_batch = g_byte_array_sized_new (BATCH_SIZE);
+  enqueue_locked (sender, data, sender->pending_batch_messages, FALSE);
+  sender->pending_batch_messages = 0;
+}
+
+static void
+pump_locked (ExampleChannelSender * sender)
+{
+  GstWebRTCDataChannelState state;
+  guint64 buffered;
+  Pending *pending;
+
+  if (sender->closed || g_queue_is_empty (&sender->queue))
+    return;
+
+  g_object_get (sender->channel, "ready-state", &state, "buffered-amount",
+      &buffered, NULL);
+  if (state != GST_WEBRTC_DATA_CHANNEL_STATE_OPEN)
+    return;
+
+  /* buffered-amount grows synchronously with every send, so it is only
+   * queried once per pump */
+  while (buffered < HIGH_WATERMARK
+      && (pending = g_queue_pop_head (&sender->queue)) != NULL) {
+    if (pending->is_string)
+      gst_webrtc_data_channel_send_string (sender->channel,
+          g_bytes_get_data (pending->data, NULL));
+    else
+      gst_webrtc_data_channel_send_data (sender->channel, pending->data);
+
+    buffered += pending->size;
+    sender->queued_bytes -= g_bytes_get_size (pending->data);
+    sender->stats.messages_sent += pending->n_messages;
+    sender->stats.bytes_sent += pending->size;
+    if (sender->batch && !pending->is_string)
+      sender->stats.batches_sent++;
+
+    pending_free (pending);
+  }
+}
+
+static void
+channel_writable_cb (G_GNUC_UNUSED GstWebRTCDataChannel * channel,
+    gpointer user_data)
+{
+  ExampleChannelSender *sender = (ExampleChannelSender *) user_data;
+
+  g_mutex_lock (&sender->lock);
+  pump_locked (sender);
+  g_mutex_unlock (&sender->lock);
+}
+
+static gboolean
+flush_timeout_cb (gpointer user_data)
+{
+  ExampleChannelSender *sender = (ExampleChannelSender *) user_data;
+
+  g_mutex_lock (&sender->lock);
+  /* Might have been replaced while we were waiting for the lock */
+  if (sender->flush_source == g_main_current_source ()) {
+    g_source_unref (sender->flush_source);
+    sender->flush_source = NULL;
+    take_batch_locked (sender);
+    pump_locked (sender);
+  }
+  g_mutex_unlock (&sender->lock);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_flush_locked (ExampleChannelSender * sender)
+{
+  if (sender->flush_source != NULL)
+    return;
+
+  sender->flush_source = g_timeout_source_new (BATCH_DELAY);
+  g_source_set_callback (sender->flush_source, flush_timeout_cb,
+      sender_ref (sender), (GDestroyNotify) sender_unref);
+  g_source_attach (sender->flush_source, sender->context);
+}
+
+ExampleChannelSender *
+example_channel_sender_new (GstWebRTCDataChannel * channel,
+    GMainContext * context, gsize max_queued_bytes, gboolean batch)
+{
+  ExampleChannelSender *sender = g_slice_new0 (ExampleChannelSender);
+
+  sender->refcount = 1;
+  g_mutex_init (&sender->lock);
+  sender->channel = gst_object_ref (channel);
+  sender->context = context ? g_main_context_ref (context) :
+      g_main_context_ref (g_main_context_default ());
+  sender->max_queued_bytes = max_queued_bytes;
+  sender->batch = batch;
+  g_queue_init (&sender->queue);
+  sender->pending_batch = g_byte_array_sized_new (BATCH_SIZE);
+
+  g_object_set (channel, "buffered-amount-low-threshold",
+      (guint64) LOW_WATERMARK, NULL);
+  g_signal_connect_data (channel, "on-buffered-amount-low",
+      G_CALLBACK (channel_writable_cb), sender_ref (sender),
+      (GClosureNotify) sender_unref, 0);
+  g_signal_connect_data (channel, "on-open",
+      G_CALLBACK (channel_writable_cb), sender_ref (sender),
+      (GClosureNotify) sender_unref, 0);
+
+  return sender;
+}
+
+void
+example_channel_sender_close (ExampleChannelSender * sender)
+{
+  g_mutex_lock (&sender->lock);
+  sender->closed = TRUE;
+  if (sender->flush_source != NULL) {
+    g_source_destroy (sender->flush_source);
+    g_source_unref (sender->flush_source);
+    sender->flush_source = NULL;
+  }
+  g_queue_foreach (&sender->queue, (GFunc) pending_free, NULL);
+  g_queue_clear (&sender->queue);
+  sender->queued_bytes = 0;
+  g_mutex_unlock (&sender->lock);
+
+  g_signal_handlers_disconnect_by_data (sender->channel, sender);
+  sender_unref (sender);
+}
+
+gboolean
+example_channel_sender_send_data (ExampleChannelSender * sender,
+    GBytes * data)
+{
+  gsize size = g_bytes_get_size (data);
+  guint8 header[FRAME_HEADER_SIZE];
+  gboolean ret = TRUE;
+
+  g_mutex_lock (&sender->lock);
+
+  if (sender->closed) {
+    g_mutex_unlock (&sender->lock);
+    return FALSE;
+  }
+
+  if (!sender->batch) {
+    ret = enqueue_locked (sender, g_bytes_ref (data), 1, FALSE);
+    pump_locked (sender);
+    g_mutex_unlock (&sender->lock);
+    return ret;
+  }
+
+  GST_WRITE_UINT32_BE (header, size);
+
+  /* Keep the message order, whatever is batched goes out first */
+  if (size > BATCH_MAX_MESSAGE
+      || sender->pending_batch->len + FRAME_HEADER_SIZE + size > BATCH_SIZE)
+    take_batch_locked (sender);
+
+  if (size > BATCH_MAX_MESSAGE) {
+    GByteArray *framed = g_byte_array_sized_new (FRAME_HEADER_SIZE + size);
+
+    g_byte_array_append (framed, header, FRAME_HEADER_SIZE);
+    g_byte_array_append (framed, g_bytes_get_data (data, NULL), size);
+    ret = enqueue_locked (sender, g_byte_array_free_to_bytes (framed), 1,
+        FALSE);
+  } else {
+    g_byte_array_append (sender->pending_batch, header, FRAME_HEADER_SIZE);
+    g_byte_array_append (sender->pending_batch, g_bytes_get_data (data, NULL),
+        size);
+    sender->pending_batch_messages++;
+    schedule_flush_locked (sender);
+  }
+
+  pump_locked (sender);
+  g_mutex_unlock (&sender->lock);
+
+  return ret;
+}
+
+gboolean
+example_channel_sender_send_string (ExampleChannelSender * sender,
+    const gchar * string)
+{
+  gboolean ret = FALSE;
+
+  g_mutex_lock (&sender->lock);
+  if (!sender->closed) {
+    take_batch_locked (sender);
+    ret = enqueue_locked (sender, g_bytes_new (string, strlen (string) + 1),
+        1, TRUE);
+    pump_locked (sender);
+  }
+  g_mutex_unlock (&sender->lock);
+
+  return ret;
+}
+
+void
+example_channel_sender_flush (ExampleChannelSender * sender)
+{
+  g_mutex_lock (&sender->lock);
+  if (!sender->closed) {
+    take_batch_locked (sender);
+    pump_locked (sender);
+  }
+  g_mutex_unlock (&sender->lock);
+}
+
+void
+example_channel_sender_get_stats (ExampleChannelSender * sender,
+    ExampleChannelStats * stats)
+{
+  g_mutex_lock (&sender->lock);
+  *stats = sender->stats;
+  stats->queued_bytes = sender->queued_bytes + sender->pending_batch->len;
+  g_mutex_unlock (&sender->lock);
+}
+
+gboolean
+example_channel_foreach_message (GBytes * data,
+    ExampleChannelMessageFunc func, gpointer user_data)
+{
+  gsize size;
+  const guint8 *p = g_bytes_get_data (data, &size);
+
+  while (size >= FRAME_HEADER_SIZE) {
+    guint32 len = GST_READ_UINT32_BE (p);
+
+    p += FRAME_HEADER_SIZE;
+    size -= FRAME_HEADER_SIZE;
+    if (len > size)
+      return FALSE;
+
+    func (p, len, user_data);
+    p += len;
+    size -= len;
+  }
+
+  return size == 0;
+}
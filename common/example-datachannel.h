@@ -0,0 +1,73 @@
+/* GStreamer examples - flow controlled data channel sending
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#ifndef __EXAMPLE_DATACHANNEL_INCLUDED__
+#define __EXAMPLE_DATACHANNEL_INCLUDED__
+
+#include <gst/gst.h>
+
+#ifndef GST_USE_UNSTABLE_API
+#define GST_USE_UNSTABLE_API
+#endif
+#include <gst/webrtc/webrtc.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ExampleChannelSender ExampleChannelSender;
+
+typedef struct
+{
+  guint64 messages_sent;
+  guint64 bytes_sent;
+  guint64 batches_sent;
+  guint64 dropped;
+  guint64 queued_bytes;
+  guint64 max_queued_bytes;
+} ExampleChannelStats;
+
+typedef void (*ExampleChannelMessageFunc) (gconstpointer data, gsize size,
+    gpointer user_data);
+
+/* Writes to @channel only while its buffered-amount is below a high
+ * watermark and queues up to @max_queued_bytes otherwise, the queue is
+ * drained from on-buffered-amount-low. With @batch, binary messages are
+ * framed with a 32 bit big-endian length and small ones are coalesced into
+ * one SCTP message, flushed when full or after a few milliseconds on
+ * @context (NULL for the global default context). */
+ExampleChannelSender *example_channel_sender_new (GstWebRTCDataChannel *
+    channel, GMainContext * context, gsize max_queued_bytes, gboolean batch);
+/* Drops everything still queued and releases @sender */
+void example_channel_sender_close (ExampleChannelSender * sender);
+
+/* Thread safe. Return FALSE if the queue is full and the message was
+ * dropped. */
+gboolean example_channel_sender_send_data (ExampleChannelSender * sender,
+    GBytes * data);
+gboolean example_channel_sender_send_string (ExampleChannelSender * sender,
+    const gchar * string);
+void example_channel_sender_flush (ExampleChannelSender * sender);
+void example_channel_sender_get_stats (ExampleChannelSender * sender,
+    ExampleChannelStats * stats);
+
+/* Calls @func for every message framed in @data by a batching sender.
+ * Returns FALSE if @data is truncated. */
+gboolean example_channel_foreach_message (GBytes * data,
+    ExampleChannelMessageFunc func, gpointer user_data);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_DATACHANNEL_INCLUDED__ */
@@ -0,0 +1,310 @@
+/* GStreamer examples - DTLS certificate pool
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "example-dtls.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+/* webrtcbin has no certificate property of its own, its DTLS transports
+ * bind theirs to the "pem" property of their dtlssrtpdec. The PEM is
+ * stored on the webrtcbin and set on each dtlssrtpdec as it is added,
+ * which is before the transport starts its handshake. dtlsdec keeps one
+ * agent per distinct PEM, so a pooled certificate is only parsed once. */
+
+#define PEM_DATA_KEY "example-dtls-pem"
+#define CERTIFICATE_DAYS 30
+#define MAX_POOL_SIZE 64
+
+struct _ExampleDtlsPool
+{
+  gchar *directory;
+  guint size;
+  guint rotate_seconds;
+
+  GMutex lock;
+  GPtrArray *pems;              /* gchar *, replaced as a whole on rotation */
+  guint next;
+  guint rotations;
+  guint64 assigned;
+
+  GThread *rotator;
+  GCond cond;
+  gboolean stop;
+};
+
+static gchar *
+read_pem (const gchar * path)
+{
+  GError *error = NULL;
+  gchar *pem;
+
+  if (!g_file_get_contents (path, &pem, NULL, &error)) {
+    g_warning ("Could not read DTLS certificate: %s", error->message);
+    g_error_free (error);
+    return NULL;
+  }
+
+  if (!strstr (pem, "CERTIFICATE-----") || !strstr (pem, "PRIVATE KEY-----")) {
+    g_warning ("%s needs both a certificate and a private key", path);
+    g_free (pem);
+    return NULL;
+  }
+
+  return pem;
+}
+
+/* ECDSA P-256 like browsers use, the key takes milliseconds instead of the
+ * RSA 2048 dtlsdec generates */
+static gchar *
+generate_pem (void)
+{
+  GError *error = NULL;
+  gchar *dir, *key_path, *cert_path, *key = NULL, *cert = NULL, *pem = NULL;
+  gchar *days = g_strdup_printf ("%d", CERTIFICATE_DAYS);
+  gint status;
+
+  dir = g_dir_make_tmp ("example-dtls-XXXXXX", &error);
+  if (dir == NULL) {
+    g_warning ("Could not create DTLS certificate: %s", error->message);
+    g_error_free (error);
+    g_free (days);
+    return NULL;
+  }
+  key_path = g_build_filename (dir, "key.pem", NULL);
+  cert_path = g_build_filename (dir, "cert.pem", NULL);
+
+  {
+    const gchar *argv[] = { "openssl", "req", "-x509", "-newkey", "ec",
+      "-pkeyopt", "ec_paramgen_curve:prime256v1", "-nodes", "-days", days,
+      "-subj", "/CN=gst-examples", "-keyout", key_path, "-out", cert_path,
+      NULL
+    };
+
+    if (!g_spawn_sync (NULL, (gchar **) argv, NULL,
+            G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL |
+            G_SPAWN_STDERR_TO_DEV_NULL, NULL, NULL, NULL, NULL, &status,
+            &error)) {
+      g_warning ("Could not run openssl: %s", error->message);
+      g_error_free (error);
+    } else if (status != 0) {
+      g_warning ("openssl could not create a DTLS certificate");
+    } else if (g_file_get_contents (cert_path, &cert, NULL, NULL)
+        && g_file_get_contents (key_path, &key, NULL, NULL)) {
+      pem = g_strconcat (cert, key, NULL);
+    }
+  }
+
+  g_unlink (key_path);
+  g_unlink (cert_path);
+  g_rmdir (dir);
+  g_free (key);
+  g_free (cert);
+  g_free (key_path);
+  g_free (cert_path);
+  g_free (dir);
+  g_free (days);
+
+  return pem;
+}
+
+static GPtrArray *
+build_pems (ExampleDtlsPool * pool)
+{
+  GPtrArray *pems = g_ptr_array_new_with_free_func (g_free);
+  gint64 start = g_get_monotonic_time ();
+  guint loaded = 0;
+  gchar *pem;
+
+  if (pool->directory != NULL) {
+    GError *error = NULL;
+    GDir *dir = g_dir_open (pool->directory, 0, &error);
+    const gchar *name;
+
+    if (dir == NULL) {
+      g_warning ("Could not read DTLS certificate directory: %s",
+          error->message);
+      g_error_free (error);
+    }
+    while (dir != NULL && pems->len < pool->size
+        && (name = g_dir_read_name (dir))) {
+      gchar *path;
+
+      if (!g_str_has_suffix (name, ".pem"))
+        continue;
+      path = g_build_filename (pool->directory, name, NULL);
+      if ((pem = read_pem (path)))
+        g_ptr_array_add (pems, pem);
+      g_free (path);
+    }
+    if (dir != NULL)
+      g_dir_close (dir);
+    loaded = pems->len;
+  }
+
+  while (pems->len < pool->size && (pem = generate_pem ()))
+    g_ptr_array_add (pems, pem);
+
+  g_message ("DTLS certificate pool: %u loaded, %u generated in %.1f ms",
+      loaded, pems->len - loaded,
+      (g_get_monotonic_time () - start) / 1000.0);
+
+  return pems;
+}
+
+static gpointer
+rotator_func (gpointer data)
+{
+  ExampleDtlsPool *pool = data;
+  GPtrArray *pems, *old;
+  gint64 next;
+
+  g_mutex_lock (&pool->lock);
+  next = g_get_monotonic_time () + pool->rotate_seconds * G_TIME_SPAN_SECOND;
+  while (!pool->stop) {
+    if (g_cond_wait_until (&pool->cond, &pool->lock, next))
+      continue;
+
+    g_mutex_unlock (&pool->lock);
+    pems = build_pems (pool);
+    g_mutex_lock (&pool->lock);
+
+    /* Keep the old ones if generating failed this time */
+    if (pems->len > 0) {
+      old = pool->pems;
+      pool->pems = pems;
+      pool->next = 0;
+      pool->rotations++;
+      pems = old;
+    }
+    g_ptr_array_unref (pems);
+    next += pool->rotate_seconds * G_TIME_SPAN_SECOND;
+  }
+  g_mutex_unlock (&pool->lock);
+
+  return NULL;
+}
+
+ExampleDtlsPool *
+example_dtls_pool_new (guint size, const gchar * directory,
+    guint rotate_seconds)
+{
+  ExampleDtlsPool *pool = g_new0 (ExampleDtlsPool, 1);
+
+  pool->directory = g_strdup (directory);
+  pool->size = CLAMP (size, 1, MAX_POOL_SIZE);
+  pool->rotate_seconds = rotate_seconds;
+  g_mutex_init (&pool->lock);
+  g_cond_init (&pool->cond);
+
+  pool->pems = build_pems (pool);
+  if (pool->pems->len == 0) {
+    example_dtls_pool_free (pool);
+    return NULL;
+  }
+
+  if (rotate_seconds > 0)
+    pool->rotator = g_thread_new ("dtls-rotator", rotator_func, pool);
+
+  return pool;
+}
+
+void
+example_dtls_pool_free (ExampleDtlsPool * pool)
+{
+  if (pool->rotator != NULL) {
+    g_mutex_lock (&pool->lock);
+    pool->stop = TRUE;
+    g_cond_signal (&pool->cond);
+    g_mutex_unlock (&pool->lock);
+    g_thread_join (pool->rotator);
+  }
+
+  g_ptr_array_unref (pool->pems);
+  g_cond_clear (&pool->cond);
+  g_mutex_clear (&pool->lock);
+  g_free (pool->directory);
+  g_free (pool);
+}
+
+static void
+set_pem (GstElement * element, const gchar * pem)
+{
+  GstElementFactory *factory = gst_element_get_factory (element);
+
+  if (factory != NULL
+      && g_strcmp0 (gst_plugin_feature_get_name (GST_PLUGIN_FEATURE
+              (factory)), "dtlssrtpdec") == 0)
+    g_object_set (element, "pem", pem, NULL);
+}
+
+static void
+set_pem_foreach (const GValue * item, gpointer pem)
+{
+  set_pem (g_value_get_object (item), pem);
+}
+
+static void
+deep_element_added_cb (GstBin * webrtcbin, G_GNUC_UNUSED GstBin * sub_bin,
+    GstElement * element, G_GNUC_UNUSED gpointer user_data)
+{
+  set_pem (element, g_object_get_data (G_OBJECT (webrtcbin), PEM_DATA_KEY));
+}
+
+void
+example_dtls_pool_attach (ExampleDtlsPool * pool, GstElement * webrtcbin)
+{
+  GstIterator *it;
+  gchar *pem;
+
+  g_mutex_lock (&pool->lock);
+  pem = g_strdup (g_ptr_array_index (pool->pems, pool->next));
+  pool->next = (pool->next + 1) % pool->pems->len;
+  pool->assigned++;
+  g_mutex_unlock (&pool->lock);
+
+  g_object_set_data_full (G_OBJECT (webrtcbin), PEM_DATA_KEY, pem, g_free);
+  g_signal_connect (webrtcbin, "deep-element-added",
+      G_CALLBACK (deep_element_added_cb), NULL);
+
+  /* Transports that exist already, depending on the webrtcbin version
+   * requesting the sink pads creates them */
+  it = gst_bin_iterate_recurse (GST_BIN (webrtcbin));
+  while (gst_iterator_foreach (it, set_pem_foreach, pem) ==
+      GST_ITERATOR_RESYNC)
+    gst_iterator_resync (it);
+  gst_iterator_free (it);
+}
+
+void
+example_dtls_pool_get_stats (ExampleDtlsPool * pool, guint * size,
+    guint * rotations, guint64 * assigned)
+{
+  g_mutex_lock (&pool->lock);
+  if (size)
+    *size = pool->pems->len;
+  if (rotations)
+    *rotations = pool->rotations;
+  if (assigned)
+    *assigned = pool->assigned;
+  g_mutex_unlock (&pool->lock);
+}
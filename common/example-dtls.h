@@ -0,0 +1,48 @@
+/* GStreamer examples - DTLS certificate pool
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#ifndef __EXAMPLE_DTLS_INCLUDED__
+#define __EXAMPLE_DTLS_INCLUDED__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ExampleDtlsPool ExampleDtlsPool;
+
+/* A few DTLS certificates shared round-robin by all new webrtcbins, so no
+ * session waits for key generation. They are read from the PEM files in
+ * @directory, each holding a certificate and its private key, and the rest
+ * up to @size is generated with the openssl command line tool. With
+ * @rotate_seconds > 0 the pool is rebuilt on that schedule in the
+ * background, running sessions keep the certificate they started with.
+ * Returns NULL if no certificate could be loaded or generated. */
+ExampleDtlsPool *example_dtls_pool_new (guint size, const gchar * directory,
+    guint rotate_seconds);
+void example_dtls_pool_free (ExampleDtlsPool * pool);
+
+/* Hands the next certificate to @webrtcbin, call before it negotiates.
+ * @webrtcbin doesn't reference @pool afterwards. */
+void example_dtls_pool_attach (ExampleDtlsPool * pool, GstElement * webrtcbin);
+
+/* Number of certificates, times rebuilt and sessions they were given to */
+void example_dtls_pool_get_stats (ExampleDtlsPool * pool, guint * size,
+    guint * rotations, guint64 * assigned);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_DTLS_INCLUDED__ */
@@ -0,0 +1,441 @@
+/* GStreamer examples - CPU driven encoder adaptation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "example-encoder-control.h"
+
+#include <string.h>
+
+/* The processing time of a frame is from it entering the encoder to the
+ * encoded frame with the same PTS leaving it. There are no B-frames, so
+ * frames leave in order and a few pending ones are enough to match them. */
+
+#define MAX_PENDING 16
+
+/* Above this share of the frame interval, or this share of frames
+ * dropped, the encoder is overloaded. Below the lower share it has room
+ * for a more expensive step. The gap between them is the hysteresis,
+ * "quality" costs easily twice as much as "realtime". */
+#define OVERUSE_LOAD 0.85
+#define OVERUSE_DROPS 0.02
+#define UNDERUSE_LOAD 0.4
+
+#define MIN_UPGRADE_INTERVALS 3
+#define MAX_UPGRADE_INTERVALS 48
+
+static const gchar *const degradation_names[] = {
+  "maintain-framerate", "maintain-resolution", "balanced",
+};
+
+typedef struct
+{
+  ExampleEncoderPreset preset;
+  gint scale_n, scale_d;
+  gint rate_n, rate_d;          /* share of the full frame rate */
+} Level;
+
+typedef struct
+{
+  ExampleEncoderControl *control;
+  GstElement *queue;
+  GstElement *capsfilter;
+  GstElement *encoder;
+  gint width, height;
+
+  GstPad *sinkpad;
+  GstPad *srcpad;
+  gulong sink_probe;
+  gulong src_probe;
+  gulong overrun_id;
+
+  /* Under the control's lock */
+  GstClockTime pending_pts[MAX_PENDING];
+  gint64 pending_time[MAX_PENDING];
+  guint n_pending;
+  guint64 frames;
+  guint64 dropped;
+  guint64 late;
+  gint64 busy;
+} Layer;
+
+struct _ExampleEncoderControl
+{
+  const ExampleEncoder *encoder;
+  ExampleDegradation degradation;
+  gint framerate;
+  GArray *levels;
+  guint level;
+  GPtrArray *layers;
+
+  /* Interval counters are read and reset under it */
+  GMutex lock;
+  gint64 frame_interval;        /* microseconds at the current level */
+  guint64 total_dropped;
+  guint64 total_late;
+  gdouble load;
+  gdouble drop_ratio;
+
+  guint settle;                 /* intervals to ignore after a step */
+  guint quiet_intervals;
+  guint upgrade_intervals;
+  gboolean upgraded;            /* last step was up, not proven yet */
+  guint changes;
+};
+
+gboolean
+example_degradation_from_string (const gchar * string,
+    ExampleDegradation * degradation)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (degradation_names); i++) {
+    if (g_strcmp0 (degradation_names[i], string) == 0) {
+      *degradation = (ExampleDegradation) i;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+const gchar *
+example_degradation_to_string (ExampleDegradation degradation)
+{
+  g_return_val_if_fail (degradation < G_N_ELEMENTS (degradation_names),
+      NULL);
+
+  return degradation_names[degradation];
+}
+
+static void
+add_level (GArray * levels, ExampleEncoderPreset preset, gint scale_n,
+    gint scale_d, gint rate_n, gint rate_d)
+{
+  Level level = { preset, scale_n, scale_d, rate_n, rate_d };
+
+  g_array_append_val (levels, level);
+}
+
+/* From the most to the least expensive */
+static GArray *
+build_levels (ExampleDegradation degradation)
+{
+  GArray *levels = g_array_new (FALSE, FALSE, sizeof (Level));
+
+  add_level (levels, EXAMPLE_ENCODER_PRESET_QUALITY, 1, 1, 1, 1);
+  add_level (levels, EXAMPLE_ENCODER_PRESET_REALTIME, 1, 1, 1, 1);
+  switch (degradation) {
+    case EXAMPLE_DEGRADATION_MAINTAIN_FRAMERATE:
+      add_level (levels, EXAMPLE_ENCODER_PRESET_REALTIME, 3, 4, 1, 1);
+      add_level (levels, EXAMPLE_ENCODER_PRESET_REALTIME, 1, 2, 1, 1);
+      break;
+    case EXAMPLE_DEGRADATION_MAINTAIN_RESOLUTION:
+      add_level (levels, EXAMPLE_ENCODER_PRESET_REALTIME, 1, 1, 2, 3);
+      add_level (levels, EXAMPLE_ENCODER_PRESET_REALTIME, 1, 1, 1, 2);
+      break;
+    case EXAMPLE_DEGRADATION_BALANCED:
+      add_level (levels, EXAMPLE_ENCODER_PRESET_REALTIME, 3, 4, 1, 1);
+      add_level (levels, EXAMPLE_ENCODER_PRESET_REALTIME, 3, 4, 2, 3);
+      add_level (levels, EXAMPLE_ENCODER_PRESET_REALTIME, 1, 2, 1, 2);
+      break;
+  }
+
+  return levels;
+}
+
+static GstCaps *
+level_caps (ExampleEncoderControl * control, const Level * level,
+    Layer * layer)
+{
+  /* Encoders want even dimensions */
+  gint width = (layer->width * level->scale_n / level->scale_d) & ~1;
+  gint height = (layer->height * level->scale_n / level->scale_d) & ~1;
+
+  return gst_caps_new_simple ("video/x-raw", "width", G_TYPE_INT, width,
+      "height", G_TYPE_INT, height, "framerate", GST_TYPE_FRACTION,
+      control->framerate * level->rate_n, level->rate_d, NULL);
+}
+
+static void
+overrun_cb (G_GNUC_UNUSED GstElement * queue, gpointer user_data)
+{
+  Layer *layer = user_data;
+
+  /* The leaky queue drops its oldest frame right after this */
+  g_mutex_lock (&layer->control->lock);
+  layer->dropped++;
+  g_mutex_unlock (&layer->control->lock);
+}
+
+static GstPadProbeReturn
+encoder_sink_probe_cb (G_GNUC_UNUSED GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  Layer *layer = user_data;
+  GstClockTime pts = GST_BUFFER_PTS (GST_PAD_PROBE_INFO_BUFFER (info));
+
+  if (!GST_CLOCK_TIME_IS_VALID (pts))
+    return GST_PAD_PROBE_OK;
+
+  g_mutex_lock (&layer->control->lock);
+  if (layer->n_pending == MAX_PENDING) {
+    layer->n_pending--;
+    memmove (layer->pending_pts, layer->pending_pts + 1,
+        layer->n_pending * sizeof (GstClockTime));
+    memmove (layer->pending_time, layer->pending_time + 1,
+        layer->n_pending * sizeof (gint64));
+  }
+  layer->pending_pts[layer->n_pending] = pts;
+  layer->pending_time[layer->n_pending] = g_get_monotonic_time ();
+  layer->n_pending++;
+  g_mutex_unlock (&layer->control->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+encoder_src_probe_cb (G_GNUC_UNUSED GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  Layer *layer = user_data;
+  ExampleEncoderControl *control = layer->control;
+  GstClockTime pts = GST_BUFFER_PTS (GST_PAD_PROBE_INFO_BUFFER (info));
+  gint64 processing;
+  guint i;
+
+  g_mutex_lock (&control->lock);
+  for (i = 0; i < layer->n_pending && layer->pending_pts[i] != pts; i++);
+  if (i < layer->n_pending) {
+    processing = g_get_monotonic_time () - layer->pending_time[i];
+    layer->frames++;
+    layer->busy += processing;
+    if (processing > control->frame_interval)
+      layer->late++;
+
+    /* Frames before it were dropped by the encoder */
+    layer->n_pending -= i + 1;
+    memmove (layer->pending_pts, layer->pending_pts + i + 1,
+        layer->n_pending * sizeof (GstClockTime));
+    memmove (layer->pending_time, layer->pending_time + i + 1,
+        layer->n_pending * sizeof (gint64));
+  }
+  g_mutex_unlock (&control->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+ExampleEncoderControl *
+example_encoder_control_new (const ExampleEncoder * encoder,
+    ExampleEncoderPreset preset, ExampleDegradation degradation,
+    gint framerate)
+{
+  ExampleEncoderControl *control = g_new0 (ExampleEncoderControl, 1);
+
+  control->encoder = encoder;
+  control->degradation = degradation;
+  control->framerate = MAX (framerate, 1);
+  control->levels = build_levels (degradation);
+  control->level = preset == EXAMPLE_ENCODER_PRESET_QUALITY ? 0 : 1;
+  control->layers = g_ptr_array_new ();
+  control->frame_interval = G_USEC_PER_SEC / control->framerate;
+  control->upgrade_intervals = MIN_UPGRADE_INTERVALS;
+  g_mutex_init (&control->lock);
+
+  return control;
+}
+
+void
+example_encoder_control_free (ExampleEncoderControl * control)
+{
+  guint i;
+
+  for (i = 0; i < control->layers->len; i++) {
+    Layer *layer = g_ptr_array_index (control->layers, i);
+
+    g_signal_handler_disconnect (layer->queue, layer->overrun_id);
+    gst_pad_remove_probe (layer->sinkpad, layer->sink_probe);
+    gst_pad_remove_probe (layer->srcpad, layer->src_probe);
+    gst_object_unref (layer->sinkpad);
+    gst_object_unref (layer->srcpad);
+    gst_object_unref (layer->queue);
+    gst_object_unref (layer->capsfilter);
+    gst_object_unref (layer->encoder);
+    g_free (layer);
+  }
+  g_ptr_array_unref (control->layers);
+  g_array_unref (control->levels);
+  g_mutex_clear (&control->lock);
+  g_free (control);
+}
+
+void
+example_encoder_control_add (ExampleEncoderControl * control,
+    GstElement * queue, GstElement * capsfilter, GstElement * encoder,
+    gint width, gint height)
+{
+  Layer *layer = g_new0 (Layer, 1);
+  GstCaps *caps;
+
+  layer->control = control;
+  layer->queue = gst_object_ref (queue);
+  layer->capsfilter = gst_object_ref (capsfilter);
+  layer->encoder = gst_object_ref (encoder);
+  layer->width = width;
+  layer->height = height;
+
+  layer->overrun_id = g_signal_connect (queue, "overrun",
+      G_CALLBACK (overrun_cb), layer);
+  layer->sinkpad = gst_element_get_static_pad (encoder, "sink");
+  layer->srcpad = gst_element_get_static_pad (encoder, "src");
+  layer->sink_probe = gst_pad_add_probe (layer->sinkpad,
+      GST_PAD_PROBE_TYPE_BUFFER, encoder_sink_probe_cb, layer, NULL);
+  layer->src_probe = gst_pad_add_probe (layer->srcpad,
+      GST_PAD_PROBE_TYPE_BUFFER, encoder_src_probe_cb, layer, NULL);
+
+  caps = level_caps (control,
+      &g_array_index (control->levels, Level, control->level), layer);
+  g_object_set (capsfilter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+
+  g_ptr_array_add (control->layers, layer);
+}
+
+static void
+set_level (ExampleEncoderControl * control, guint index)
+{
+  const Level *old = &g_array_index (control->levels, Level, control->level);
+  const Level *level = &g_array_index (control->levels, Level, index);
+  guint i;
+
+  for (i = 0; i < control->layers->len; i++) {
+    Layer *layer = g_ptr_array_index (control->layers, i);
+
+    if (level->scale_n * old->scale_d != old->scale_n * level->scale_d
+        || level->rate_n * old->rate_d != old->rate_n * level->rate_d) {
+      GstCaps *caps = level_caps (control, level, layer);
+
+      g_object_set (layer->capsfilter, "caps", caps, NULL);
+      gst_caps_unref (caps);
+    }
+    if (level->preset != old->preset)
+      example_encoder_set_preset (control->encoder, layer->encoder,
+          level->preset);
+  }
+
+  g_mutex_lock (&control->lock);
+  control->frame_interval = G_USEC_PER_SEC * level->rate_d /
+      (control->framerate * level->rate_n);
+  g_mutex_unlock (&control->lock);
+
+  g_message ("Encoder %s: %s preset, %d/%d of the resolution at %.1f fps",
+      index > control->level ? "overloaded" : "has room",
+      example_encoder_preset_to_string (level->preset), level->scale_n,
+      level->scale_d, (gdouble) control->framerate * level->rate_n /
+      level->rate_d);
+
+  control->level = index;
+  control->settle = 1;
+  control->changes++;
+}
+
+void
+example_encoder_control_update (ExampleEncoderControl * control)
+{
+  guint64 frames = 0, dropped = 0;
+  gdouble load = 0.0, drop_ratio;
+  gboolean overuse;
+  guint i;
+
+  g_mutex_lock (&control->lock);
+  for (i = 0; i < control->layers->len; i++) {
+    Layer *layer = g_ptr_array_index (control->layers, i);
+
+    /* The slowest encoder decides, they all share the CPU */
+    if (layer->frames > 0)
+      load = MAX (load, (gdouble) layer->busy / layer->frames /
+          control->frame_interval);
+    frames += layer->frames;
+    dropped += layer->dropped;
+    control->total_dropped += layer->dropped;
+    control->total_late += layer->late;
+    layer->frames = layer->dropped = layer->late = 0;
+    layer->busy = 0;
+  }
+  drop_ratio = frames + dropped > 0 ?
+      (gdouble) dropped / (frames + dropped) : 0.0;
+  control->load = load;
+  control->drop_ratio = drop_ratio;
+  g_mutex_unlock (&control->lock);
+
+  /* The interval after a step measured the restart, not the new level */
+  if (control->settle > 0) {
+    control->settle--;
+    return;
+  }
+  if (frames + dropped == 0)
+    return;
+
+  overuse = load > OVERUSE_LOAD || drop_ratio > OVERUSE_DROPS;
+  if (overuse) {
+    if (control->upgraded)
+      control->upgrade_intervals = MIN (control->upgrade_intervals * 2,
+          MAX_UPGRADE_INTERVALS);
+    control->upgraded = FALSE;
+    control->quiet_intervals = 0;
+    if (control->level + 1 < control->levels->len)
+      set_level (control, control->level + 1);
+    return;
+  }
+
+  control->upgraded = FALSE;
+  if (load < UNDERUSE_LOAD && dropped == 0)
+    control->quiet_intervals++;
+  else
+    control->quiet_intervals = 0;
+
+  if (control->level > 0
+      && control->quiet_intervals >= control->upgrade_intervals) {
+    control->quiet_intervals = 0;
+    set_level (control, control->level - 1);
+    control->upgraded = TRUE;
+  }
+}
+
+void
+example_encoder_control_get_stats (ExampleEncoderControl * control,
+    ExampleEncoderControlStats * stats)
+{
+  const Level *level = &g_array_index (control->levels, Level,
+      control->level);
+
+  stats->preset = level->preset;
+  stats->scale = (gdouble) level->scale_n / level->scale_d;
+  stats->framerate = (gdouble) control->framerate * level->rate_n /
+      level->rate_d;
+  stats->changes = control->changes;
+
+  g_mutex_lock (&control->lock);
+  stats->load = control->load;
+  stats->drop_ratio = control->drop_ratio;
+  stats->dropped = control->total_dropped;
+  stats->late = control->total_late;
+  g_mutex_unlock (&control->lock);
+}
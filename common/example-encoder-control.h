@@ -0,0 +1,82 @@
+/* GStreamer examples - CPU driven encoder adaptation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#ifndef __EXAMPLE_ENCODER_CONTROL_INCLUDED__
+#define __EXAMPLE_ENCODER_CONTROL_INCLUDED__
+
+#include <gst/gst.h>
+
+#include "example-encoders.h"
+
+G_BEGIN_DECLS
+
+/* What to give up once the cheapest preset is not enough, like the
+ * RTCDegradationPreference of the WebRTC API */
+typedef enum
+{
+  EXAMPLE_DEGRADATION_MAINTAIN_FRAMERATE = 0,
+  EXAMPLE_DEGRADATION_MAINTAIN_RESOLUTION,
+  EXAMPLE_DEGRADATION_BALANCED,
+} ExampleDegradation;
+
+gboolean example_degradation_from_string (const gchar * string,
+    ExampleDegradation * degradation);
+const gchar *example_degradation_to_string (ExampleDegradation degradation);
+
+typedef struct _ExampleEncoderControl ExampleEncoderControl;
+
+typedef struct
+{
+  ExampleEncoderPreset preset;
+  gdouble scale;                /* of the configured resolution */
+  gdouble framerate;
+  gdouble load;                 /* processing time per frame interval */
+  gdouble drop_ratio;
+  guint64 dropped;
+  guint64 late;
+  guint changes;
+} ExampleEncoderControlStats;
+
+/* Watches how long the encoders take per frame and how many frames they
+ * have no time for. An overloaded encoder first gets a cheaper preset,
+ * then a lower resolution or frame rate as @degradation prefers. Going
+ * back up takes a few quiet intervals in a row, twice as many each time
+ * the last step up had to be undone. Starts at @preset, with a frame rate
+ * of @framerate. */
+ExampleEncoderControl *example_encoder_control_new (const ExampleEncoder *
+    encoder, ExampleEncoderPreset preset, ExampleDegradation degradation,
+    gint framerate);
+void example_encoder_control_free (ExampleEncoderControl * control);
+
+/* One encoder to watch and adapt, all of them follow the same steps.
+ * @queue is the leaky queue in front that drops the frames the encoder has
+ * no time for, @capsfilter, after a videoscale and a videorate, sets its
+ * input size and rate. */
+void example_encoder_control_add (ExampleEncoderControl * control,
+    GstElement * queue, GstElement * capsfilter, GstElement * encoder,
+    gint width, gint height);
+
+/* Call every few seconds from the main loop, it looks at what happened
+ * since the previous call and may take one step */
+void example_encoder_control_update (ExampleEncoderControl * control);
+
+void example_encoder_control_get_stats (ExampleEncoderControl * control,
+    ExampleEncoderControlStats * stats);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_ENCODER_CONTROL_INCLUDED__ */
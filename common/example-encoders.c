@@ -0,0 +1,260 @@
+/* GStreamer examples - video encoder backends
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "example-encoders.h"
+
+#include <string.h>
+
+/* Both presets stay within what a real-time sender can afford: no
+ * lookahead, no B-frames, constant bitrate. "realtime" is the cheapest
+ * setting of each encoder, "quality" trades CPU for fewer artefacts at the
+ * same bitrate. */
+
+static const ExampleEncoder x264 = {
+  "x264", "x264enc", EXAMPLE_CODEC_H264, "H264",
+  "bitrate", 1, "key-int-max",
+  {"speed-preset=ultrafast tune=zerolatency",
+      "speed-preset=veryfast tune=zerolatency"},
+  "video/x-h264,profile=constrained-baseline",
+  "h264parse ! rtph264pay config-interval=-1 aggregate-mode=zero-latency",
+};
+
+static const ExampleEncoder openh264 = {
+  "openh264", "openh264enc", EXAMPLE_CODEC_H264, "H264",
+  "bitrate", 1000, "gop-size",
+  {"complexity=low rate-control=bitrate",
+      "complexity=high rate-control=bitrate"},
+  "video/x-h264,profile=constrained-baseline",
+  "h264parse ! rtph264pay config-interval=-1 aggregate-mode=zero-latency",
+};
+
+static const ExampleEncoder vp8 = {
+  "vp8", "vp8enc", EXAMPLE_CODEC_VP8, "VP8",
+  "target-bitrate", 1000, "keyframe-max-dist",
+  {"deadline=1 cpu-used=8 end-usage=cbr lag-in-frames=0 "
+        "error-resilient=partitions",
+      "deadline=1 cpu-used=4 end-usage=cbr lag-in-frames=0 "
+        "error-resilient=partitions"},
+  NULL,
+  "rtpvp8pay picture-id-mode=15-bit",
+};
+
+static const ExampleEncoder vp9 = {
+  "vp9", "vp9enc", EXAMPLE_CODEC_VP9, "VP9",
+  "target-bitrate", 1000, "keyframe-max-dist",
+  {"deadline=1 cpu-used=8 end-usage=cbr lag-in-frames=0",
+      "deadline=1 cpu-used=5 end-usage=cbr lag-in-frames=0"},
+  NULL,
+  "rtpvp9pay picture-id-mode=15-bit",
+};
+
+static const ExampleEncoder av1 = {
+  "av1", "av1enc", EXAMPLE_CODEC_AV1, "AV1",
+  "target-bitrate", 1, "keyframe-max-dist",
+  {"cpu-used=8 end-usage=cbr lag-in-frames=0",
+      "cpu-used=6 end-usage=cbr lag-in-frames=0"},
+  NULL,
+  "av1parse ! rtpav1pay",
+};
+
+static const ExampleEncoder *const encoders[] = {
+  &x264, &openh264, &vp8, &vp9, &av1, NULL,
+};
+
+static const gchar *const preset_names[EXAMPLE_ENCODER_N_PRESETS] = {
+  "realtime", "quality",
+};
+
+const ExampleEncoder *
+example_encoder_find (const gchar * name)
+{
+  gint i;
+
+  for (i = 0; encoders[i] != NULL; i++)
+    if (g_strcmp0 (encoders[i]->name, name) == 0
+        || g_strcmp0 (encoders[i]->factory, name) == 0)
+      return encoders[i];
+
+  return NULL;
+}
+
+const ExampleEncoder *const *
+example_encoder_list (void)
+{
+  return encoders;
+}
+
+static gboolean
+factories_available (const gchar * description)
+{
+  gchar **elements = g_strsplit (description, "!", -1);
+  gboolean available = TRUE;
+  gint i;
+
+  for (i = 0; elements[i] != NULL && available; i++) {
+    gchar *factory_name = g_strstrip (elements[i]);
+    GstElementFactory *factory;
+
+    factory_name[strcspn (factory_name, " ")] = '\0';
+    factory = gst_element_factory_find (factory_name);
+    available = factory != NULL;
+    if (factory != NULL)
+      gst_object_unref (factory);
+  }
+  g_strfreev (elements);
+
+  return available;
+}
+
+gboolean
+example_encoder_available (const ExampleEncoder * encoder)
+{
+  return factories_available (encoder->factory)
+      && factories_available (encoder->payloader);
+}
+
+gboolean
+example_encoder_preset_from_string (const gchar * string,
+    ExampleEncoderPreset * preset)
+{
+  gint i;
+
+  for (i = 0; i < EXAMPLE_ENCODER_N_PRESETS; i++) {
+    if (g_strcmp0 (preset_names[i], string) == 0) {
+      *preset = (ExampleEncoderPreset) i;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+const gchar *
+example_encoder_preset_to_string (ExampleEncoderPreset preset)
+{
+  g_return_val_if_fail (preset < EXAMPLE_ENCODER_N_PRESETS, NULL);
+
+  return preset_names[preset];
+}
+
+gchar *
+example_encoder_describe (const ExampleEncoder * encoder,
+    ExampleEncoderPreset preset, const gchar * name, gint bitrate_kbps,
+    gint keyframe_interval)
+{
+  GString *description = g_string_new (encoder->factory);
+
+  if (name != NULL)
+    g_string_append_printf (description, " name=%s", name);
+  g_string_append_printf (description, " %s=%d %s=%d %s",
+      encoder->bitrate_property, bitrate_kbps * encoder->bitrate_scale,
+      encoder->keyframe_property, keyframe_interval,
+      encoder->presets[preset]);
+  if (encoder->caps != NULL)
+    g_string_append_printf (description, " ! %s", encoder->caps);
+
+  return g_string_free (description, FALSE);
+}
+
+void
+example_encoder_set_bitrate (const ExampleEncoder * encoder,
+    GstElement * element, gint bitrate_kbps)
+{
+  g_object_set (element, encoder->bitrate_property,
+      bitrate_kbps * encoder->bitrate_scale, NULL);
+}
+
+typedef struct
+{
+  const ExampleEncoder *encoder;
+  GstElement *element;
+  ExampleEncoderPreset preset;
+} PresetChange;
+
+static void
+preset_change_free (gpointer data)
+{
+  PresetChange *change = data;
+
+  gst_object_unref (change->element);
+  g_free (change);
+}
+
+static void
+apply_preset (const ExampleEncoder * encoder, GstElement * element,
+    ExampleEncoderPreset preset)
+{
+  gchar **settings = g_strsplit (encoder->presets[preset], " ", -1);
+  gint i;
+
+  for (i = 0; settings[i] != NULL; i++) {
+    gchar *value = strchr (settings[i], '=');
+
+    if (value == NULL)
+      continue;
+    *value++ = '\0';
+    gst_util_set_object_arg (G_OBJECT (element), settings[i], value);
+  }
+  g_strfreev (settings);
+}
+
+/* Relinking makes the upstream pad send its sticky events again, the
+ * restarted encoder lost the ones it had */
+static GstPadProbeReturn
+restart_encoder_cb (GstPad * pad, G_GNUC_UNUSED GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  PresetChange *change = user_data;
+  GstPad *sinkpad = gst_element_get_static_pad (change->element, "sink");
+
+  gst_pad_unlink (pad, sinkpad);
+  gst_element_set_state (change->element, GST_STATE_NULL);
+  apply_preset (change->encoder, change->element, change->preset);
+  gst_element_sync_state_with_parent (change->element);
+  gst_pad_link (pad, sinkpad);
+  gst_object_unref (sinkpad);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+void
+example_encoder_set_preset (const ExampleEncoder * encoder,
+    GstElement * element, ExampleEncoderPreset preset)
+{
+  GstPad *sinkpad = gst_element_get_static_pad (element, "sink");
+  GstPad *peer = gst_pad_get_peer (sinkpad);
+  PresetChange *change;
+
+  gst_object_unref (sinkpad);
+  if (peer == NULL) {
+    apply_preset (encoder, element, preset);
+    return;
+  }
+
+  change = g_new (PresetChange, 1);
+  change->encoder = encoder;
+  change->element = gst_object_ref (element);
+  change->preset = preset;
+  gst_pad_add_probe (peer, GST_PAD_PROBE_TYPE_IDLE, restart_encoder_cb,
+      change, preset_change_free);
+  gst_object_unref (peer);
+}
@@ -0,0 +1,80 @@
+/* GStreamer examples - video encoder backends
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#ifndef __EXAMPLE_ENCODERS_INCLUDED__
+#define __EXAMPLE_ENCODERS_INCLUDED__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  EXAMPLE_CODEC_H264,
+  EXAMPLE_CODEC_VP8,
+  EXAMPLE_CODEC_VP9,
+  EXAMPLE_CODEC_AV1,
+} ExampleCodec;
+
+typedef enum
+{
+  EXAMPLE_ENCODER_PRESET_REALTIME = 0,
+  EXAMPLE_ENCODER_PRESET_QUALITY,
+  EXAMPLE_ENCODER_N_PRESETS,
+} ExampleEncoderPreset;
+
+typedef struct
+{
+  const gchar *name;
+  const gchar *factory;
+  ExampleCodec codec;
+  const gchar *encoding_name;   /* RTP encoding-name */
+
+  const gchar *bitrate_property;
+  gint bitrate_scale;           /* property units per kbit/s */
+  const gchar *keyframe_property;       /* in frames */
+  const gchar *presets[EXAMPLE_ENCODER_N_PRESETS];
+  const gchar *caps;            /* restricts the encoder output, or NULL */
+
+  /* Parser and payloader, properties of the payloader can be appended */
+  const gchar *payloader;
+} ExampleEncoder;
+
+const ExampleEncoder *example_encoder_find (const gchar * name);
+/* NULL terminated, in order of preference */
+const ExampleEncoder *const *example_encoder_list (void);
+gboolean example_encoder_available (const ExampleEncoder * encoder);
+gboolean example_encoder_preset_from_string (const gchar * string,
+    ExampleEncoderPreset * preset);
+const gchar *example_encoder_preset_to_string (ExampleEncoderPreset preset);
+
+/* Launch line for the encoder named @name followed by its caps filter,
+ * e.g. "x264enc name=encoder bitrate=600 ... ! video/x-h264,..." */
+gchar *example_encoder_describe (const ExampleEncoder * encoder,
+    ExampleEncoderPreset preset, const gchar * name, gint bitrate_kbps,
+    gint keyframe_interval);
+void example_encoder_set_bitrate (const ExampleEncoder * encoder,
+    GstElement * element, gint bitrate_kbps);
+/* Most encoders only take their preset settings when they start, @element
+ * is restarted with them once its input is idle. The first frame after
+ * that is a keyframe. */
+void example_encoder_set_preset (const ExampleEncoder * encoder,
+    GstElement * element, ExampleEncoderPreset preset);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_ENCODERS_INCLUDED__ */
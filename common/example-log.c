@@ -0,0 +1,464 @@
+/* GStreamer examples - asynchronous logging helpers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "example-log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* Every thread that logs gets its own single-producer/single-consumer ring,
+ * so logging from the main loop or a streaming thread costs one
+ * g_strdup_vprintf() and a couple of atomic operations. The flusher thread is
+ * the only consumer, it does all the formatting and the (blocking) writes. */
+
+#define RING_SIZE 1024          /* must be a power of two */
+#define RING_MASK (RING_SIZE - 1)
+#define FLUSH_INTERVAL (100 * G_TIME_SPAN_MILLISECOND)
+
+typedef struct
+{
+  gint64 time;
+  ExampleLogLevel level;
+  const gchar *event;
+  gchar *message;
+  gint suppressed;
+  guint thread;
+  guint seqnum;
+} LogEntry;
+
+typedef struct _LogRing LogRing;
+
+struct _LogRing
+{
+  LogEntry entries[RING_SIZE];
+  gint head;                    /* only advanced by the owning thread */
+  gint tail;                    /* only advanced by the flusher */
+  gint dropped;
+  gint in_use;
+  guint id;
+  LogRing *next;
+};
+
+static void ring_release (gpointer data);
+
+/* Rings are never freed: threads may still log while the process exits and
+ * rings of exited threads get adopted by new ones */
+static LogRing *rings = NULL;
+static gint n_rings = 0;
+static GPrivate ring_key = G_PRIVATE_INIT (ring_release);
+
+static gint max_level = EXAMPLE_LOG_LEVEL_INFO;
+static gint json_output = FALSE;
+static gint running = FALSE;
+/* Producers between their check of running and publishing their entry,
+ * deinit waits for them before the final drain */
+static gint pushing = 0;
+
+static GThread *flusher = NULL;
+static GMutex flush_lock;
+static GCond flush_cond;
+static gboolean flush_stop = FALSE;
+static gboolean flush_pending = FALSE;
+
+static const gchar *level_names[] = {
+  "none", "error", "warning", "info", "debug"
+};
+
+static void
+ring_release (gpointer data)
+{
+  LogRing *ring = data;
+
+  /* Pending entries stay in the ring until the flusher gets to them */
+  g_atomic_int_set (&ring->in_use, FALSE);
+}
+
+static LogRing *
+ring_get (void)
+{
+  LogRing *ring = g_private_get (&ring_key);
+
+  if (G_LIKELY (ring))
+    return ring;
+
+  for (ring = g_atomic_pointer_get (&rings); ring; ring = ring->next) {
+    if (g_atomic_int_compare_and_exchange (&ring->in_use, FALSE, TRUE))
+      break;
+  }
+
+  if (!ring) {
+    LogRing *head;
+
+    ring = g_new0 (LogRing, 1);
+    ring->in_use = TRUE;
+    ring->id = g_atomic_int_add (&n_rings, 1);
+    do {
+      head = g_atomic_pointer_get (&rings);
+      ring->next = head;
+    } while (!g_atomic_pointer_compare_and_exchange (&rings, head, ring));
+  }
+
+  g_private_set (&ring_key, ring);
+
+  return ring;
+}
+
+static void
+append_json_string (GString * out, const gchar * str)
+{
+  const gchar *p;
+
+  g_string_append_c (out, '"');
+  for (p = str; *p; p++) {
+    switch (*p) {
+      case '"':
+        g_string_append (out, "\\\"");
+        break;
+      case '\\':
+        g_string_append (out, "\\\\");
+        break;
+      case '\n':
+        g_string_append (out, "\\n");
+        break;
+      case '\r':
+        g_string_append (out, "\\r");
+        break;
+      case '\t':
+        g_string_append (out, "\\t");
+        break;
+      default:
+        if ((guchar) * p < 0x20)
+          g_string_append_printf (out, "\\u%04x", (guint) (guchar) * p);
+        else
+          g_string_append_c (out, *p);
+        break;
+    }
+  }
+  g_string_append_c (out, '"');
+}
+
+static void
+format_entry (GString * out, const LogEntry * entry)
+{
+  if (g_atomic_int_get (&json_output)) {
+    g_string_append_printf (out,
+        "{\"ts\":%" G_GINT64_FORMAT ",\"level\":\"%s\",\"thread\":%u,"
+        "\"event\":", entry->time, level_names[entry->level], entry->thread);
+    append_json_string (out, entry->event ? entry->event : "");
+    g_string_append (out, ",\"message\":");
+    append_json_string (out, entry->message);
+    if (entry->suppressed > 0)
+      g_string_append_printf (out, ",\"suppressed\":%d", entry->suppressed);
+    g_string_append (out, "}\n");
+  } else {
+    g_string_append (out, entry->message);
+    if (entry->suppressed > 0)
+      g_string_append_printf (out, " (%d similar lines suppressed)",
+          entry->suppressed);
+    g_string_append_c (out, '\n');
+  }
+}
+
+static void
+write_out (GString * out)
+{
+  if (out->len == 0)
+    return;
+
+  fwrite (out->str, 1, out->len, stdout);
+  fflush (stdout);
+  g_string_truncate (out, 0);
+}
+
+static gint
+compare_entries (gconstpointer a, gconstpointer b)
+{
+  const LogEntry *ea = a, *eb = b;
+
+  if (ea->time != eb->time)
+    return ea->time < eb->time ? -1 : 1;
+  if (ea->thread != eb->thread)
+    return ea->thread < eb->thread ? -1 : 1;
+  if (ea->seqnum != eb->seqnum)
+    return ea->seqnum < eb->seqnum ? -1 : 1;
+
+  return 0;
+}
+
+static void
+log_drain (GString * out, GArray * batch)
+{
+  LogRing *ring;
+  guint i;
+
+  for (ring = g_atomic_pointer_get (&rings); ring; ring = ring->next) {
+    guint tail = (guint) g_atomic_int_get (&ring->tail);
+    guint head = (guint) g_atomic_int_get (&ring->head);
+    gint dropped;
+
+    for (; tail != head; tail++) {
+      LogEntry *entry = &ring->entries[tail & RING_MASK];
+
+      g_array_append_vals (batch, entry, 1);
+      entry->message = NULL;
+    }
+    g_atomic_int_set (&ring->tail, (gint) tail);
+
+    dropped = g_atomic_int_get (&ring->dropped);
+    if (dropped > 0
+        && g_atomic_int_compare_and_exchange (&ring->dropped, dropped, 0)) {
+      LogEntry entry = { 0, };
+
+      entry.time = g_get_real_time ();
+      entry.level = EXAMPLE_LOG_LEVEL_WARNING;
+      entry.event = "log-dropped";
+      entry.message = g_strdup_printf ("%d log lines dropped, ring full",
+          dropped);
+      entry.thread = ring->id;
+      entry.seqnum = G_MAXUINT;
+      g_array_append_val (batch, entry);
+    }
+  }
+
+  /* Keep the output roughly in order across threads */
+  g_array_sort (batch, compare_entries);
+
+  for (i = 0; i < batch->len; i++) {
+    LogEntry *entry = &g_array_index (batch, LogEntry, i);
+
+    format_entry (out, entry);
+    g_free (entry->message);
+  }
+  g_array_set_size (batch, 0);
+
+  write_out (out);
+}
+
+static gpointer
+flusher_func (G_GNUC_UNUSED gpointer user_data)
+{
+  GString *out = g_string_sized_new (4096);
+  GArray *batch = g_array_new (FALSE, FALSE, sizeof (LogEntry));
+  gboolean stop;
+
+  do {
+    gint64 end_time = g_get_monotonic_time () + FLUSH_INTERVAL;
+
+    g_mutex_lock (&flush_lock);
+    while (!flush_stop && !flush_pending) {
+      if (!g_cond_wait_until (&flush_cond, &flush_lock, end_time))
+        break;
+    }
+    flush_pending = FALSE;
+    stop = flush_stop;
+    g_mutex_unlock (&flush_lock);
+
+    log_drain (out, batch);
+  } while (!stop);
+
+  g_array_free (batch, TRUE);
+  g_string_free (out, TRUE);
+
+  return NULL;
+}
+
+static void
+log_wake (void)
+{
+  g_mutex_lock (&flush_lock);
+  flush_pending = TRUE;
+  g_cond_signal (&flush_cond);
+  g_mutex_unlock (&flush_lock);
+}
+
+static void
+log_push (ExampleLogLevel level, const gchar * event, gint suppressed,
+    const gchar * format, va_list args)
+{
+  LogRing *ring;
+  LogEntry *entry;
+  guint head, tail;
+
+  g_atomic_int_inc (&pushing);
+  if (!g_atomic_int_get (&running)) {
+    LogEntry sync_entry = { 0, };
+    GString *out = g_string_new (NULL);
+
+    g_atomic_int_add (&pushing, -1);
+    sync_entry.time = g_get_real_time ();
+    sync_entry.level = level;
+    sync_entry.event = event;
+    sync_entry.suppressed = suppressed;
+    sync_entry.message = g_strdup_vprintf (format, args);
+    format_entry (out, &sync_entry);
+    write_out (out);
+    g_free (sync_entry.message);
+    g_string_free (out, TRUE);
+    return;
+  }
+
+  ring = ring_get ();
+  head = (guint) g_atomic_int_get (&ring->head);
+  tail = (guint) g_atomic_int_get (&ring->tail);
+  if (head - tail >= RING_SIZE) {
+    g_atomic_int_inc (&ring->dropped);
+    g_atomic_int_add (&pushing, -1);
+    return;
+  }
+
+  entry = &ring->entries[head & RING_MASK];
+  entry->time = g_get_real_time ();
+  entry->level = level;
+  entry->event = event;
+  entry->suppressed = suppressed;
+  entry->thread = ring->id;
+  entry->seqnum = head;
+  entry->message = g_strdup_vprintf (format, args);
+  g_atomic_int_set (&ring->head, (gint) (head + 1));
+  g_atomic_int_add (&pushing, -1);
+
+  /* Errors go out right away, everything else waits for the next flush
+   * unless the ring is filling up */
+  if (level <= EXAMPLE_LOG_LEVEL_ERROR || head - tail == RING_SIZE / 2)
+    log_wake ();
+}
+
+static ExampleLogLevel
+level_from_string (const gchar * str)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (level_names); i++) {
+    if (g_ascii_strcasecmp (str, level_names[i]) == 0)
+      return (ExampleLogLevel) i;
+  }
+
+  return EXAMPLE_LOG_LEVEL_INFO;
+}
+
+void
+example_log_set_level (ExampleLogLevel level)
+{
+  g_atomic_int_set (&max_level, level);
+}
+
+void
+example_log_set_json (gboolean json)
+{
+  g_atomic_int_set (&json_output, json);
+}
+
+gboolean
+example_log_enabled (ExampleLogLevel level)
+{
+  return level != EXAMPLE_LOG_LEVEL_NONE
+      && (gint) level <= g_atomic_int_get (&max_level);
+}
+
+void
+example_log_init (void)
+{
+  const gchar *env;
+
+  if (g_atomic_int_get (&running))
+    return;
+
+  env = g_getenv ("EXAMPLE_LOG_LEVEL");
+  if (env)
+    example_log_set_level (level_from_string (env));
+
+  env = g_getenv ("EXAMPLE_LOG_FORMAT");
+  if (env)
+    example_log_set_json (g_ascii_strcasecmp (env, "json") == 0);
+
+  flush_stop = FALSE;
+  flusher = g_thread_new ("example-log", flusher_func, NULL);
+  g_atomic_int_set (&running, TRUE);
+}
+
+void
+example_log_deinit (void)
+{
+  if (!g_atomic_int_get (&running))
+    return;
+
+  /* New lines are written synchronously from here on. Lines already on
+   * their way into a ring are waited for, the flusher drains them before
+   * exiting. */
+  g_atomic_int_set (&running, FALSE);
+  while (g_atomic_int_get (&pushing) > 0)
+    g_thread_yield ();
+
+  g_mutex_lock (&flush_lock);
+  flush_stop = TRUE;
+  g_cond_signal (&flush_cond);
+  g_mutex_unlock (&flush_lock);
+
+  g_thread_join (flusher);
+  flusher = NULL;
+}
+
+void
+example_log (ExampleLogLevel level, const gchar * event,
+    const gchar * format, ...)
+{
+  va_list args;
+
+  if (!example_log_enabled (level))
+    return;
+
+  va_start (args, format);
+  log_push (level, event, 0, format, args);
+  va_end (args);
+}
+
+void
+example_log_ratelimited (ExampleLogRateLimit * limit, gint per_second,
+    ExampleLogLevel level, const gchar * event, const gchar * format, ...)
+{
+  va_list args;
+  gint now, window, suppressed;
+
+  if (!example_log_enabled (level))
+    return;
+
+  now = (gint) (g_get_monotonic_time () / G_USEC_PER_SEC);
+  window = g_atomic_int_get (&limit->window);
+  if (window != now
+      && g_atomic_int_compare_and_exchange (&limit->window, window, now))
+    g_atomic_int_set (&limit->count, 0);
+
+  if (g_atomic_int_add (&limit->count, 1) >= per_second) {
+    g_atomic_int_inc (&limit->suppressed);
+    return;
+  }
+
+  do {
+    suppressed = g_atomic_int_get (&limit->suppressed);
+  } while (suppressed > 0
+      && !g_atomic_int_compare_and_exchange (&limit->suppressed, suppressed,
+          0));
+
+  va_start (args, format);
+  log_push (level, event, suppressed, format, args);
+  va_end (args);
+}
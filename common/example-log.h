@@ -0,0 +1,79 @@
+/* GStreamer examples - asynchronous logging helpers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#ifndef __EXAMPLE_LOG_INCLUDED__
+#define __EXAMPLE_LOG_INCLUDED__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  EXAMPLE_LOG_LEVEL_NONE = 0,
+  EXAMPLE_LOG_LEVEL_ERROR,
+  EXAMPLE_LOG_LEVEL_WARNING,
+  EXAMPLE_LOG_LEVEL_INFO,
+  EXAMPLE_LOG_LEVEL_DEBUG,
+} ExampleLogLevel;
+
+/* Per call-site state for example_log_ratelimited(), zero-initialise it */
+typedef struct
+{
+  gint window;
+  gint count;
+  gint suppressed;
+} ExampleLogRateLimit;
+
+/* Starts the background flusher. The level and output format are taken from
+ * the EXAMPLE_LOG_LEVEL (error, warning, info, debug) and EXAMPLE_LOG_FORMAT
+ * (text, json) environment variables. Before init and after deinit every
+ * line is printed synchronously. */
+void example_log_init (void);
+void example_log_deinit (void);
+
+void example_log_set_level (ExampleLogLevel level);
+void example_log_set_json (gboolean json);
+gboolean example_log_enabled (ExampleLogLevel level);
+
+/* @event must be a static string, it is only read by the flusher thread */
+void example_log (ExampleLogLevel level, const gchar * event,
+    const gchar * format, ...) G_GNUC_PRINTF (3, 4);
+void example_log_ratelimited (ExampleLogRateLimit * limit, gint per_second,
+    ExampleLogLevel level, const gchar * event, const gchar * format, ...)
+    G_GNUC_PRINTF (5, 6);
+
+#define EXAMPLE_LOG_ERROR(event, ...) \
+    example_log (EXAMPLE_LOG_LEVEL_ERROR, event, __VA_ARGS__)
+#define EXAMPLE_LOG_WARNING(event, ...) \
+    example_log (EXAMPLE_LOG_LEVEL_WARNING, event, __VA_ARGS__)
+#define EXAMPLE_LOG_INFO(event, ...) \
+    example_log (EXAMPLE_LOG_LEVEL_INFO, event, __VA_ARGS__)
+#define EXAMPLE_LOG_DEBUG(event, ...) \
+    example_log (EXAMPLE_LOG_LEVEL_DEBUG, event, __VA_ARGS__)
+
+/* Logs at most @per_second lines per second from this call site, the number
+ * of suppressed lines is reported with the next line that gets through */
+#define EXAMPLE_LOG_RATELIMITED(per_second, level, event, ...) G_STMT_START { \
+  static ExampleLogRateLimit _example_log_limit = { 0, };                    \
+  example_log_ratelimited (&_example_log_limit, per_second, level, event,     \
+      __VA_ARGS__);                                                           \
+} G_STMT_END
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_LOG_INCLUDED__ */
@@ -0,0 +1,287 @@
+/* GStreamer examples - RTP packet pacer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "example-pacer.h"
+
+/* The queue holds the burst and its streaming thread does the waiting: a
+ * probe on the sink pad notes when each packet arrived, one on the src pad
+ * sleeps until the bucket has room for it. The queue is FIFO, so arrival
+ * times are kept in the same order in a ring. Payloaders push a fragmented
+ * frame as one buffer list, which is split on the way in to pace the
+ * packets and not the frames. A state change empties the queue without
+ * flush events, so the ring is also reset when the src pad is
+ * (de)activated. */
+
+#define MIN_ARRIVALS 256
+
+struct _ExamplePacer
+{
+  GstPad *sinkpad;
+  GstPad *srcpad;
+  gulong sink_probe;
+  gulong src_probe;
+  GstPadActivateModeFunction activatemode;
+  gdouble multiplier;
+  gint64 max_delay;             /* microseconds */
+
+  GMutex lock;
+  GCond cond;
+  gboolean flushing;
+  guint kbps;
+  gint64 next_send;             /* when the bucket is empty again */
+
+  gint64 *arrivals;
+  guint arrivals_size;
+  guint first_arrival;
+  guint n_arrivals;
+
+  guint64 packets;
+  guint64 delayed;
+  guint64 overflows;
+  gint64 delay_sum;
+  gint64 delay_max;
+};
+
+static void
+push_arrival (ExamplePacer * pacer, gint64 time)
+{
+  if (pacer->n_arrivals == pacer->arrivals_size) {
+    guint size = MAX (pacer->arrivals_size * 2, MIN_ARRIVALS);
+    gint64 *arrivals = g_new (gint64, size);
+    guint i;
+
+    for (i = 0; i < pacer->n_arrivals; i++)
+      arrivals[i] = pacer->arrivals[(pacer->first_arrival + i) %
+          pacer->arrivals_size];
+    g_free (pacer->arrivals);
+    pacer->arrivals = arrivals;
+    pacer->arrivals_size = size;
+    pacer->first_arrival = 0;
+  }
+
+  pacer->arrivals[(pacer->first_arrival + pacer->n_arrivals) %
+      pacer->arrivals_size] = time;
+  pacer->n_arrivals++;
+}
+
+static gint64
+pop_arrival (ExamplePacer * pacer, gint64 now)
+{
+  gint64 time;
+
+  /* Flushed while the packet was on its way out */
+  if (pacer->n_arrivals == 0)
+    return now;
+
+  time = pacer->arrivals[pacer->first_arrival];
+  pacer->first_arrival = (pacer->first_arrival + 1) % pacer->arrivals_size;
+  pacer->n_arrivals--;
+
+  return time;
+}
+
+static void
+reset (ExamplePacer * pacer)
+{
+  pacer->n_arrivals = 0;
+  pacer->next_send = 0;
+}
+
+typedef struct
+{
+  GstPad *pad;
+  GstFlowReturn ret;
+} ChainData;
+
+static gboolean
+chain_buffer (GstBuffer ** buffer, G_GNUC_UNUSED guint idx, gpointer user_data)
+{
+  ChainData *data = user_data;
+
+  data->ret = gst_pad_chain (data->pad, gst_buffer_ref (*buffer));
+
+  return data->ret == GST_FLOW_OK;
+}
+
+static GstPadProbeReturn
+sink_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  ExamplePacer *pacer = user_data;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+    ChainData data = { pad, GST_FLOW_OK };
+
+    /* Comes back here once per buffer, the first error goes upstream so
+     * the payloader stops on shutdown like without the pacer */
+    gst_buffer_list_foreach (list, chain_buffer, &data);
+    gst_buffer_list_unref (list);
+    GST_PAD_PROBE_INFO_FLOW_RETURN (info) = data.ret;
+    return GST_PAD_PROBE_HANDLED;
+  }
+
+  g_mutex_lock (&pacer->lock);
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    push_arrival (pacer, g_get_monotonic_time ());
+  } else if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) ==
+      GST_EVENT_FLUSH_START) {
+    pacer->flushing = TRUE;
+    g_cond_broadcast (&pacer->cond);
+  } else if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) ==
+      GST_EVENT_FLUSH_STOP) {
+    pacer->flushing = FALSE;
+    reset (pacer);
+  }
+  g_mutex_unlock (&pacer->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+src_probe_cb (G_GNUC_UNUSED GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  ExamplePacer *pacer = user_data;
+  gsize size = gst_buffer_get_size (GST_PAD_PROBE_INFO_BUFFER (info));
+  gint64 now, arrival, send, delay;
+
+  g_mutex_lock (&pacer->lock);
+  now = g_get_monotonic_time ();
+  arrival = pop_arrival (pacer, now);
+
+  send = MAX (now, pacer->next_send);
+  if (pacer->kbps == 0) {
+    send = now;
+  } else if (send > arrival + pacer->max_delay) {
+    send = MAX (now, arrival + pacer->max_delay);
+    pacer->overflows++;
+  }
+
+  if (send > now)
+    pacer->delayed++;
+  while (!pacer->flushing && g_get_monotonic_time () < send)
+    g_cond_wait_until (&pacer->cond, &pacer->lock, send);
+
+  now = g_get_monotonic_time ();
+  if (pacer->kbps > 0) {
+    gint64 cost = size * 8000 / (pacer->kbps * pacer->multiplier);
+
+    /* Don't build up more debt than the delay allows */
+    pacer->next_send = MIN (MAX (pacer->next_send, now) + cost,
+        now + pacer->max_delay);
+  }
+
+  delay = now - arrival;
+  pacer->packets++;
+  pacer->delay_sum += delay;
+  pacer->delay_max = MAX (pacer->delay_max, delay);
+  g_mutex_unlock (&pacer->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static gboolean
+src_activate_mode (GstPad * pad, GstObject * parent, GstPadMode mode,
+    gboolean active)
+{
+  ExamplePacer *pacer = g_object_get_data (G_OBJECT (pad), "example-pacer");
+  gboolean ret;
+
+  /* Wakes up the streaming thread so the queue can stop its task */
+  g_mutex_lock (&pacer->lock);
+  pacer->flushing = !active;
+  g_cond_broadcast (&pacer->cond);
+  g_mutex_unlock (&pacer->lock);
+
+  ret = pacer->activatemode (pad, parent, mode, active);
+
+  g_mutex_lock (&pacer->lock);
+  reset (pacer);
+  g_mutex_unlock (&pacer->lock);
+
+  return ret;
+}
+
+ExamplePacer *
+example_pacer_new (GstElement * queue, gdouble multiplier, guint max_delay_ms)
+{
+  ExamplePacer *pacer = g_new0 (ExamplePacer, 1);
+
+  pacer->multiplier = MAX (multiplier, 1.0);
+  pacer->max_delay = (gint64) max_delay_ms * G_TIME_SPAN_MILLISECOND;
+  g_mutex_init (&pacer->lock);
+  g_cond_init (&pacer->cond);
+
+  g_object_set (queue, "max-size-buffers", 0, "max-size-bytes", 0,
+      "max-size-time", (guint64) 0, NULL);
+
+  pacer->sinkpad = gst_element_get_static_pad (queue, "sink");
+  pacer->srcpad = gst_element_get_static_pad (queue, "src");
+  pacer->sink_probe = gst_pad_add_probe (pacer->sinkpad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST |
+      GST_PAD_PROBE_TYPE_EVENT_FLUSH, sink_probe_cb, pacer, NULL);
+  pacer->src_probe = gst_pad_add_probe (pacer->srcpad,
+      GST_PAD_PROBE_TYPE_BUFFER, src_probe_cb, pacer, NULL);
+
+  pacer->activatemode = GST_PAD_ACTIVATEMODEFUNC (pacer->srcpad);
+  g_object_set_data (G_OBJECT (pacer->srcpad), "example-pacer", pacer);
+  gst_pad_set_activatemode_function (pacer->srcpad, src_activate_mode);
+
+  return pacer;
+}
+
+void
+example_pacer_free (ExamplePacer * pacer)
+{
+  gst_pad_remove_probe (pacer->sinkpad, pacer->sink_probe);
+  gst_pad_remove_probe (pacer->srcpad, pacer->src_probe);
+  gst_pad_set_activatemode_function (pacer->srcpad, pacer->activatemode);
+  g_object_set_data (G_OBJECT (pacer->srcpad), "example-pacer", NULL);
+  gst_object_unref (pacer->sinkpad);
+  gst_object_unref (pacer->srcpad);
+
+  g_free (pacer->arrivals);
+  g_cond_clear (&pacer->cond);
+  g_mutex_clear (&pacer->lock);
+  g_free (pacer);
+}
+
+void
+example_pacer_set_bitrate (ExamplePacer * pacer, guint kbps)
+{
+  g_mutex_lock (&pacer->lock);
+  pacer->kbps = kbps;
+  g_mutex_unlock (&pacer->lock);
+}
+
+void
+example_pacer_get_stats (ExamplePacer * pacer, ExamplePacerStats * stats)
+{
+  g_mutex_lock (&pacer->lock);
+  stats->packets = pacer->packets;
+  stats->delayed = pacer->delayed;
+  stats->overflows = pacer->overflows;
+  stats->delay_avg_ms = pacer->packets > 0 ?
+      pacer->delay_sum / 1000.0 / pacer->packets : 0.0;
+  stats->delay_max_ms = pacer->delay_max / 1000.0;
+  g_mutex_unlock (&pacer->lock);
+}
@@ -0,0 +1,55 @@
+/* GStreamer examples - RTP packet pacer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#ifndef __EXAMPLE_PACER_INCLUDED__
+#define __EXAMPLE_PACER_INCLUDED__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ExamplePacer ExamplePacer;
+
+typedef struct
+{
+  guint64 packets;
+  guint64 delayed;              /* held back to keep the rate */
+  guint64 overflows;            /* sent early to stay within the delay */
+  gdouble delay_avg_ms;
+  gdouble delay_max_ms;
+} ExamplePacerStats;
+
+/* Spreads the RTP packets going through @queue, which has to be linked
+ * after the payloader, over time like a leaky bucket draining at @multiplier
+ * times the bitrate set with example_pacer_set_bitrate(). A keyframe then
+ * leaves as a steady stream instead of one burst that overruns router
+ * buffers. No packet is held longer than @max_delay_ms, the bucket drains
+ * faster instead. The queue must not limit its size, the pacer bounds it.
+ * Free the pacer after the pipeline is stopped. */
+ExamplePacer *example_pacer_new (GstElement * queue, gdouble multiplier,
+    guint max_delay_ms);
+void example_pacer_free (ExamplePacer * pacer);
+
+/* Target bitrate of the stream, 0 lets the packets pass unpaced */
+void example_pacer_set_bitrate (ExamplePacer * pacer, guint kbps);
+
+/* Totals since the pacer was created */
+void example_pacer_get_stats (ExamplePacer * pacer, ExamplePacerStats * stats);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_PACER_INCLUDED__ */
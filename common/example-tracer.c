@@ -0,0 +1,779 @@
+/* GStreamer examples - per-element processing time tracer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "example-tracer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* The pad push hooks run in the streaming threads, they only append fixed
+ * size records to a single-producer/single-consumer ring owned by the
+ * thread, like example-log does. One dump thread drains all rings every
+ * interval, aggregates per element and writes the lines.
+ *
+ * Processing time is measured around pushes: the time between the push
+ * into an element's sink pad and its return, minus the time of the pushes
+ * that element did itself from within it, which is kept on a per-thread
+ * stack. Work sources do in their own task before pushing isn't seen. */
+
+#define RING_SIZE 4096          /* must be a power of two */
+#define RING_MASK (RING_SIZE - 1)
+#define MAX_DEPTH 64
+#define INPUT_SLOTS 16
+#define DEFAULT_INTERVAL 1000   /* ms */
+
+typedef struct _ElementStats ElementStats;
+
+typedef enum
+{
+  RECORD_PROCESSING,
+  RECORD_LATENCY,
+} RecordType;
+
+typedef struct
+{
+  ElementStats *stats;
+  RecordType type;
+  GstClockTime value;
+} Record;
+
+typedef struct
+{
+  ElementStats *stats;          /* NULL when not pushing into an element */
+  GstClockTime start;
+  GstClockTime children;
+} Frame;
+
+typedef struct _TraceRing TraceRing;
+
+struct _TraceRing
+{
+  Record records[RING_SIZE];
+  gint head;                    /* only advanced by the owning thread */
+  gint tail;                    /* only advanced by the dump thread */
+  gint dropped;
+  gint in_use;
+  TraceRing *next;
+
+  /* Owning thread only */
+  Frame stack[MAX_DEPTH];
+  gint depth;
+};
+
+struct _ElementStats
+{
+  GWeakRef element;
+  gchar *name;
+  const gchar *factory;
+  gboolean is_queue;
+  ElementStats *next;
+
+  /* PTS and time of the last buffers that went in */
+  GMutex lock;
+  GstClockTime input_pts[INPUT_SLOTS];
+  GstClockTime input_time[INPUT_SLOTS];
+  guint next_input;
+
+  /* Dump thread only, reset every interval */
+  guint64 buffers;
+  GstClockTime processing;
+  GstClockTime processing_max;
+  guint64 latencies;
+  GstClockTime latency;
+  GstClockTime latency_max;
+};
+
+typedef struct
+{
+  GstTracer parent;
+} ExampleTracer;
+
+typedef struct
+{
+  GstTracerClass parent_class;
+} ExampleTracerClass;
+
+/* example_tracer_init() is the public entry point, hence the longer prefix */
+G_DEFINE_TYPE (ExampleTracer, example_tracer_object, GST_TYPE_TRACER);
+
+static void ring_release (gpointer data);
+
+/* Rings are never freed and get adopted by new threads, the same as the
+ * log rings */
+static TraceRing *rings = NULL;
+static GPrivate ring_key = G_PRIVATE_INIT (ring_release);
+
+static GMutex registry_lock;
+static ElementStats *registry = NULL;
+static GQuark stats_quark = 0;
+
+static gint running = FALSE;
+/* Created by example_tracer_init(), not in plugin form */
+static GstTracer *tracer_instance = NULL;
+static FILE *output = NULL;
+static gboolean csv = FALSE;
+static gint interval = DEFAULT_INTERVAL;
+static gint64 start_time;
+static gint64 last_dump;
+
+static GThread *dumper = NULL;
+static GMutex dump_lock;
+static GCond dump_cond;
+static gboolean dump_stop = FALSE;
+
+static gchar *trace_location = NULL;
+static gint trace_interval = DEFAULT_INTERVAL;
+
+static void
+ring_release (gpointer data)
+{
+  TraceRing *ring = data;
+
+  g_atomic_int_set (&ring->in_use, FALSE);
+}
+
+static TraceRing *
+ring_get (void)
+{
+  TraceRing *ring = g_private_get (&ring_key);
+
+  if (G_LIKELY (ring))
+    return ring;
+
+  for (ring = g_atomic_pointer_get (&rings); ring; ring = ring->next) {
+    if (g_atomic_int_compare_and_exchange (&ring->in_use, FALSE, TRUE))
+      break;
+  }
+
+  if (!ring) {
+    TraceRing *head;
+
+    ring = g_new0 (TraceRing, 1);
+    ring->in_use = TRUE;
+    do {
+      head = g_atomic_pointer_get (&rings);
+      ring->next = head;
+    } while (!g_atomic_pointer_compare_and_exchange (&rings, head, ring));
+  }
+
+  ring->depth = 0;
+  g_private_set (&ring_key, ring);
+
+  return ring;
+}
+
+static void
+ring_push (TraceRing * ring, ElementStats * stats, RecordType type,
+    GstClockTime value)
+{
+  gint head = ring->head;
+  Record *record;
+
+  if (((head + 1) & RING_MASK) == g_atomic_int_get (&ring->tail)) {
+    g_atomic_int_inc (&ring->dropped);
+    return;
+  }
+
+  record = &ring->records[head];
+  record->stats = stats;
+  record->type = type;
+  record->value = value;
+  g_atomic_int_set (&ring->head, (head + 1) & RING_MASK);
+}
+
+static gchar *
+element_path (GstElement * element)
+{
+  GString *path = g_string_new (NULL);
+  GstObject *object = gst_object_ref (element), *parent;
+
+  while (object != NULL) {
+    gchar *name = gst_object_get_name (object);
+
+    g_string_prepend (path, name);
+    g_free (name);
+    parent = gst_object_get_parent (object);
+    gst_object_unref (object);
+    object = parent;
+    if (object != NULL)
+      g_string_prepend_c (path, '/');
+  }
+
+  return g_string_free (path, FALSE);
+}
+
+static ElementStats *
+element_stats_get (GstElement * element)
+{
+  ElementStats *stats = g_object_get_qdata (G_OBJECT (element), stats_quark);
+  GstElementFactory *factory;
+  gint i;
+
+  if (G_LIKELY (stats))
+    return stats;
+
+  g_mutex_lock (&registry_lock);
+  stats = g_object_get_qdata (G_OBJECT (element), stats_quark);
+  if (stats == NULL) {
+    stats = g_slice_new0 (ElementStats);
+    g_weak_ref_init (&stats->element, element);
+    stats->name = element_path (element);
+    factory = gst_element_get_factory (element);
+    stats->factory = factory ?
+        gst_plugin_feature_get_name (GST_PLUGIN_FEATURE (factory)) : "";
+    stats->is_queue = g_strcmp0 (stats->factory, "queue") == 0
+        || g_strcmp0 (stats->factory, "queue2") == 0;
+    g_mutex_init (&stats->lock);
+    for (i = 0; i < INPUT_SLOTS; i++)
+      stats->input_pts[i] = stats->input_time[i] = GST_CLOCK_TIME_NONE;
+
+    stats->next = registry;
+    registry = stats;
+    g_object_set_qdata (G_OBJECT (element), stats_quark, stats);
+  }
+  g_mutex_unlock (&registry_lock);
+
+  return stats;
+}
+
+static void
+element_stats_free (ElementStats * stats)
+{
+  g_weak_ref_clear (&stats->element);
+  g_mutex_clear (&stats->lock);
+  g_free (stats->name);
+  g_slice_free (ElementStats, stats);
+}
+
+/* Ghost and proxy pads belong to bins, only real elements are traced */
+static GstElement *
+pad_element (GstPad * pad)
+{
+  GstObject *parent;
+
+  if (pad == NULL || GST_IS_PROXY_PAD (pad))
+    return NULL;
+
+  parent = GST_OBJECT_PARENT (pad);
+  return GST_IS_ELEMENT (parent) ? GST_ELEMENT_CAST (parent) : NULL;
+}
+
+static void
+element_input (ElementStats * stats, GstClockTime pts, GstClockTime ts)
+{
+  guint last;
+
+  g_mutex_lock (&stats->lock);
+  /* Packets of one frame share the PTS, the first one counts */
+  last = (stats->next_input + INPUT_SLOTS - 1) % INPUT_SLOTS;
+  if (stats->input_pts[last] != pts) {
+    stats->input_pts[stats->next_input] = pts;
+    stats->input_time[stats->next_input] = ts;
+    stats->next_input = (stats->next_input + 1) % INPUT_SLOTS;
+  }
+  g_mutex_unlock (&stats->lock);
+}
+
+static void
+element_output (TraceRing * ring, ElementStats * stats, GstClockTime pts,
+    GstClockTime ts)
+{
+  GstClockTime latency = GST_CLOCK_TIME_NONE;
+  guint i;
+
+  g_mutex_lock (&stats->lock);
+  for (i = 0; i < INPUT_SLOTS; i++) {
+    if (stats->input_pts[i] == pts
+        && GST_CLOCK_TIME_IS_VALID (stats->input_time[i])) {
+      if (ts > stats->input_time[i])
+        latency = ts - stats->input_time[i];
+      stats->input_time[i] = GST_CLOCK_TIME_NONE;
+      break;
+    }
+  }
+  g_mutex_unlock (&stats->lock);
+
+  if (GST_CLOCK_TIME_IS_VALID (latency))
+    ring_push (ring, stats, RECORD_LATENCY, latency);
+}
+
+static void
+push_pre (GstClockTime ts, GstPad * pad, GstBuffer * buffer)
+{
+  TraceRing *ring;
+  GstElement *sender, *receiver;
+  ElementStats *stats = NULL;
+  GstClockTime pts;
+  Frame *frame;
+
+  if (!g_atomic_int_get (&running))
+    return;
+
+  ring = ring_get ();
+  sender = pad_element (pad);
+  receiver = pad_element (GST_PAD_PEER (pad));
+  pts = buffer != NULL ? GST_BUFFER_PTS (buffer) : GST_CLOCK_TIME_NONE;
+
+  if (sender != NULL && GST_CLOCK_TIME_IS_VALID (pts))
+    element_output (ring, element_stats_get (sender), pts, ts);
+
+  if (receiver != NULL) {
+    stats = element_stats_get (receiver);
+    if (GST_CLOCK_TIME_IS_VALID (pts))
+      element_input (stats, pts, ts);
+  }
+
+  if (ring->depth < MAX_DEPTH) {
+    frame = &ring->stack[ring->depth];
+    frame->stats = stats;
+    frame->start = ts;
+    frame->children = 0;
+  }
+  ring->depth++;
+}
+
+static void
+push_post (GstClockTime ts)
+{
+  TraceRing *ring;
+  GstClockTime elapsed;
+  Frame *frame;
+  gint depth;
+
+  if (!g_atomic_int_get (&running))
+    return;
+
+  /* Pushes that were already running when tracing started */
+  ring = ring_get ();
+  if (ring->depth == 0)
+    return;
+
+  depth = --ring->depth;
+  if (depth >= MAX_DEPTH)
+    return;
+
+  frame = &ring->stack[depth];
+  elapsed = ts > frame->start ? ts - frame->start : 0;
+  if (frame->stats != NULL)
+    ring_push (ring, frame->stats, RECORD_PROCESSING,
+        elapsed - MIN (frame->children, elapsed));
+  if (depth > 0)
+    ring->stack[depth - 1].children += elapsed;
+}
+
+static void
+do_push_buffer_pre (G_GNUC_UNUSED GstTracer * self, GstClockTime ts,
+    GstPad * pad, GstBuffer * buffer)
+{
+  push_pre (ts, pad, buffer);
+}
+
+static void
+do_push_list_pre (G_GNUC_UNUSED GstTracer * self, GstClockTime ts,
+    GstPad * pad, GstBufferList * list)
+{
+  push_pre (ts, pad, gst_buffer_list_length (list) > 0 ?
+      gst_buffer_list_get (list, 0) : NULL);
+}
+
+static void
+do_push_post (G_GNUC_UNUSED GstTracer * self, GstClockTime ts,
+    G_GNUC_UNUSED GstPad * pad, G_GNUC_UNUSED GstFlowReturn res)
+{
+  push_post (ts);
+}
+
+static void
+append_double (GString * out, const gchar * format, gdouble value)
+{
+  gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+
+  /* The examples call setlocale(), keep the decimal point a point */
+  g_string_append (out, g_ascii_formatd (buffer, sizeof (buffer), format,
+          value));
+}
+
+static void
+append_quoted (GString * out, const gchar * str)
+{
+  const gchar *p;
+
+  g_string_append_c (out, '"');
+  for (p = str; *p; p++) {
+    if (csv && *p == '"')
+      g_string_append (out, "\"\"");
+    else if (!csv && (*p == '"' || *p == '\\'))
+      g_string_append_printf (out, "\\%c", *p);
+    else if ((guchar) * p >= 0x20)
+      g_string_append_c (out, *p);
+  }
+  g_string_append_c (out, '"');
+}
+
+/* Appends one field, as "name":value in JSON or value, in CSV. A negative
+ * value leaves it out, or empty */
+static void
+append_field (GString * out, const gchar * name, const gchar * format,
+    gdouble value)
+{
+  if (csv) {
+    g_string_append_c (out, ',');
+    if (value >= 0)
+      append_double (out, format, value);
+  } else if (value >= 0) {
+    g_string_append_printf (out, ",\"%s\":", name);
+    append_double (out, format, value);
+  }
+}
+
+static void
+write_stats (GString * out, ElementStats * stats, gdouble now,
+    gdouble seconds)
+{
+  GObject *element;
+  guint level_buffers = 0, level_bytes = 0;
+  guint64 level_time = 0;
+  gboolean has_level = FALSE;
+
+  if (stats->is_queue && (element = g_weak_ref_get (&stats->element))) {
+    g_object_get (element, "current-level-buffers", &level_buffers,
+        "current-level-bytes", &level_bytes, "current-level-time",
+        &level_time, NULL);
+    g_object_unref (element);
+    has_level = TRUE;
+  }
+
+  if (stats->buffers == 0 && stats->latencies == 0 && !has_level)
+    return;
+
+  if (csv) {
+    append_double (out, "%.3f", now);
+    g_string_append_c (out, ',');
+    append_quoted (out, stats->name);
+    g_string_append_printf (out, ",%s,%" G_GUINT64_FORMAT, stats->factory,
+        stats->buffers);
+  } else {
+    g_string_append (out, "{\"ts\":");
+    append_double (out, "%.3f", now);
+    g_string_append (out, ",\"element\":");
+    append_quoted (out, stats->name);
+    g_string_append_printf (out, ",\"factory\":\"%s\",\"buffers\":%"
+        G_GUINT64_FORMAT, stats->factory, stats->buffers);
+  }
+
+  append_field (out, "processing-avg-us", "%.1f", stats->buffers > 0 ?
+      stats->processing / 1000.0 / stats->buffers : -1);
+  append_field (out, "processing-max-us", "%.1f", stats->buffers > 0 ?
+      stats->processing_max / 1000.0 : -1);
+  append_field (out, "cpu", "%.4f", stats->buffers > 0 ?
+      stats->processing / 1e9 / seconds : -1);
+  append_field (out, "latency-avg-ms", "%.3f", stats->latencies > 0 ?
+      stats->latency / 1e6 / stats->latencies : -1);
+  append_field (out, "latency-max-ms", "%.3f", stats->latencies > 0 ?
+      stats->latency_max / 1e6 : -1);
+  append_field (out, "queue-buffers", "%.0f", has_level ? level_buffers : -1);
+  append_field (out, "queue-bytes", "%.0f", has_level ? level_bytes : -1);
+  append_field (out, "queue-time-ms", "%.3f", has_level ?
+      level_time / 1e6 : -1);
+  g_string_append (out, csv ? "\n" : "}\n");
+
+  stats->buffers = stats->latencies = 0;
+  stats->processing = stats->processing_max = 0;
+  stats->latency = stats->latency_max = 0;
+}
+
+static void
+dump (void)
+{
+  GPtrArray *snapshot = g_ptr_array_new ();
+  GSList *gone = NULL, *l;
+  GString *out = g_string_new (NULL);
+  ElementStats *stats, **prev;
+  TraceRing *ring;
+  gint64 now = g_get_monotonic_time ();
+  gint dropped = 0, head, tail;
+  GObject *element;
+  guint i;
+
+  /* Elements found gone here can't get new records, the ones they left in
+   * the rings are drained below before their stats are freed */
+  g_mutex_lock (&registry_lock);
+  for (prev = &registry; *prev != NULL;) {
+    stats = *prev;
+    g_ptr_array_add (snapshot, stats);
+    element = g_weak_ref_get (&stats->element);
+    if (element == NULL) {
+      *prev = stats->next;
+      gone = g_slist_prepend (gone, stats);
+    } else {
+      prev = &stats->next;
+      g_object_unref (element);
+    }
+  }
+  g_mutex_unlock (&registry_lock);
+
+  for (ring = g_atomic_pointer_get (&rings); ring; ring = ring->next) {
+    head = g_atomic_int_get (&ring->head);
+    for (tail = ring->tail; tail != head; tail = (tail + 1) & RING_MASK) {
+      Record *record = &ring->records[tail];
+
+      stats = record->stats;
+      if (record->type == RECORD_PROCESSING) {
+        stats->buffers++;
+        stats->processing += record->value;
+        stats->processing_max = MAX (stats->processing_max, record->value);
+      } else {
+        stats->latencies++;
+        stats->latency += record->value;
+        stats->latency_max = MAX (stats->latency_max, record->value);
+      }
+    }
+    g_atomic_int_set (&ring->tail, tail);
+
+    head = g_atomic_int_get (&ring->dropped);
+    if (head > 0) {
+      g_atomic_int_add (&ring->dropped, -head);
+      dropped += head;
+    }
+  }
+
+  for (i = 0; i < snapshot->len; i++)
+    write_stats (out, g_ptr_array_index (snapshot, i),
+        (now - start_time) / (gdouble) G_USEC_PER_SEC,
+        MAX (now - last_dump, 1) / (gdouble) G_USEC_PER_SEC);
+  last_dump = now;
+
+  if (out->len > 0) {
+    fwrite (out->str, 1, out->len, output);
+    fflush (output);
+  }
+  if (dropped > 0)
+    g_printerr ("example-tracer: %d records dropped, the interval is too "
+        "long for the buffer rate\n", dropped);
+
+  for (l = gone; l != NULL; l = l->next)
+    element_stats_free (l->data);
+  g_slist_free (gone);
+  g_ptr_array_unref (snapshot);
+  g_string_free (out, TRUE);
+}
+
+static gpointer
+dumper_func (G_GNUC_UNUSED gpointer data)
+{
+  gint64 next = g_get_monotonic_time () + interval * G_TIME_SPAN_MILLISECOND;
+
+  g_mutex_lock (&dump_lock);
+  while (!dump_stop) {
+    if (!g_cond_wait_until (&dump_cond, &dump_lock, next)) {
+      g_mutex_unlock (&dump_lock);
+      dump ();
+      g_mutex_lock (&dump_lock);
+      next += interval * G_TIME_SPAN_MILLISECOND;
+    }
+  }
+  g_mutex_unlock (&dump_lock);
+
+  dump ();
+
+  return NULL;
+}
+
+static gboolean
+tracer_start (const gchar * location, const gchar * format, gint interval_ms)
+{
+  if (g_atomic_int_get (&running))
+    return TRUE;
+
+  if (location == NULL || g_strcmp0 (location, "-") == 0) {
+    output = stderr;
+  } else if (!(output = fopen (location, "w"))) {
+    g_printerr ("example-tracer: could not open %s\n", location);
+    return FALSE;
+  }
+
+  if (format != NULL)
+    csv = g_ascii_strcasecmp (format, "csv") == 0;
+  else
+    csv = location != NULL && g_str_has_suffix (location, ".csv");
+  interval = interval_ms > 0 ? interval_ms : DEFAULT_INTERVAL;
+
+  if (csv)
+    fprintf (output, "ts,element,factory,buffers,processing_avg_us,"
+        "processing_max_us,cpu,latency_avg_ms,latency_max_ms,queue_buffers,"
+        "queue_bytes,queue_time_ms\n");
+
+  stats_quark = g_quark_from_static_string ("example-tracer-stats");
+  start_time = last_dump = g_get_monotonic_time ();
+  dump_stop = FALSE;
+  g_atomic_int_set (&running, TRUE);
+  dumper = g_thread_new ("example-tracer", dumper_func, NULL);
+
+  return TRUE;
+}
+
+static void
+tracer_stop (void)
+{
+  if (!g_atomic_int_get (&running))
+    return;
+
+  g_atomic_int_set (&running, FALSE);
+
+  g_mutex_lock (&dump_lock);
+  dump_stop = TRUE;
+  g_cond_signal (&dump_cond);
+  g_mutex_unlock (&dump_lock);
+
+  g_thread_join (dumper);
+  dumper = NULL;
+
+  if (output != stderr)
+    fclose (output);
+  output = NULL;
+}
+
+/* In plugin form the settings come from GST_TRACERS, e.g.
+ * exampletracer(file=trace.csv,format=csv,interval=500) */
+static void
+example_tracer_object_constructed (GObject * object)
+{
+  GstTracer *tracer = GST_TRACER (object);
+  GstStructure *params = NULL;
+  gchar *params_string = NULL, *description;
+  const gchar *location = NULL, *format = NULL;
+  gint interval_ms = DEFAULT_INTERVAL;
+
+  G_OBJECT_CLASS (example_tracer_object_parent_class)->constructed (object);
+
+  g_object_get (object, "params", &params_string, NULL);
+  if (params_string != NULL) {
+    description = g_strdup_printf ("exampletracer,%s", params_string);
+    params = gst_structure_from_string (description, NULL);
+    g_free (description);
+  }
+  if (params != NULL) {
+    location = gst_structure_get_string (params, "file");
+    format = gst_structure_get_string (params, "format");
+    gst_structure_get_int (params, "interval", &interval_ms);
+  }
+
+  tracer_start (location, format, interval_ms);
+
+  gst_tracing_register_hook (tracer, "pad-push-pre",
+      G_CALLBACK (do_push_buffer_pre));
+  gst_tracing_register_hook (tracer, "pad-push-post",
+      G_CALLBACK (do_push_post));
+  gst_tracing_register_hook (tracer, "pad-push-list-pre",
+      G_CALLBACK (do_push_list_pre));
+  gst_tracing_register_hook (tracer, "pad-push-list-post",
+      G_CALLBACK (do_push_post));
+
+  if (params != NULL)
+    gst_structure_free (params);
+  g_free (params_string);
+}
+
+static void
+example_tracer_object_finalize (GObject * object)
+{
+  tracer_stop ();
+
+  G_OBJECT_CLASS (example_tracer_object_parent_class)->finalize (object);
+}
+
+static void
+example_tracer_object_class_init (ExampleTracerClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->constructed = example_tracer_object_constructed;
+  gobject_class->finalize = example_tracer_object_finalize;
+}
+
+static void
+example_tracer_object_init (ExampleTracer * self)
+{
+}
+
+static GOptionEntry trace_entries[] = {
+  {"trace", 0, 0, G_OPTION_ARG_FILENAME, &trace_location,
+        "Write per-element processing time, latency and queue levels to "
+        "FILE, CSV if it ends in .csv, - for stderr", "FILE"},
+  {"trace-interval", 0, 0, G_OPTION_ARG_INT, &trace_interval,
+      "Milliseconds between trace lines (default: 1000)", "MS"},
+  {NULL},
+};
+
+GOptionGroup *
+example_tracer_get_option_group (void)
+{
+  GOptionGroup *group;
+
+  group = g_option_group_new ("trace", "Pipeline tracing options",
+      "Show pipeline tracing options", NULL, NULL);
+  g_option_group_add_entries (group, trace_entries);
+
+  return group;
+}
+
+void
+example_tracer_init (void)
+{
+  const gchar *location = trace_location;
+
+  if (location == NULL)
+    location = g_getenv ("EXAMPLE_TRACE");
+  if (location == NULL || *location == '\0'
+      || g_atomic_int_get (&running))
+    return;
+
+  if (!tracer_start (location, NULL, trace_interval))
+    return;
+
+  tracer_instance = gst_object_ref_sink (g_object_new
+      (example_tracer_object_get_type (), NULL));
+}
+
+void
+example_tracer_deinit (void)
+{
+  tracer_stop ();
+
+  /* The hooks stay registered, they don't use the instance and do nothing
+   * once tracing stopped */
+  gst_clear_object (&tracer_instance);
+}
+
+#ifdef EXAMPLE_TRACER_PLUGIN
+static gboolean
+plugin_init (GstPlugin * plugin)
+{
+  return gst_tracer_register (plugin, "exampletracer",
+      example_tracer_object_get_type ());
+}
+
+GST_PLUGIN_DEFINE (GST_VERSION_MAJOR, GST_VERSION_MINOR, exampletracers,
+    "Per-element processing time, latency and queue level tracer",
+    plugin_init, "1.0", "LGPL", "gst-examples",
+    "https://gitlab.freedesktop.org/gstreamer/gst-examples")
+#endif
@@ -0,0 +1,50 @@
+/* GStreamer examples - per-element processing time tracer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#ifndef __EXAMPLE_TRACER_INCLUDED__
+#define __EXAMPLE_TRACER_INCLUDED__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* A GstTracer that records, for every element of every pipeline in the
+ * process:
+ *  - the time spent in its chain function, without what it spends pushing
+ *    downstream,
+ *  - the latency from a buffer entering to a buffer with the same PTS
+ *    leaving it,
+ *  - the fill level of queue and queue2.
+ * Every interval one line per active element is written as JSON or CSV.
+ *
+ * The same tracer is built as the "exampletracer" plugin, e.g.
+ *   GST_TRACERS="exampletracer(file=trace.csv,interval=500)" gst-launch-1.0 ...
+ */
+
+/* Adds --trace=FILE and --trace-interval=MS. FILE ending in .csv selects
+ * CSV, anything else JSON lines, "-" writes to stderr */
+GOptionGroup *example_tracer_get_option_group (void);
+
+/* Call after gst_init(), starts tracing if --trace was given or the
+ * EXAMPLE_TRACE environment variable names a file */
+void example_tracer_init (void);
+/* Writes the last interval and closes the file, call before gst_deinit() */
+void example_tracer_deinit (void);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_TRACER_INCLUDED__ */
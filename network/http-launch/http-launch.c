@@ -24,6 +24,9 @@
 #include <gst/gst.h>
 #include <gio/gio.h>
 
+#include "example-log.h"
+#include "example-tracer.h"
+
 typedef struct
 {
   gchar *name;
@@ -56,7 +59,8 @@ static gboolean caps_resolved = FALSE;
 static void
 remove_client (Client * client)
 {
-  gst_print ("Removing connection %s\n", client->name);
+  EXAMPLE_LOG_RATELIMITED (50, EXAMPLE_LOG_LEVEL_INFO, "connection-removed",
+      "Removing connection %s", client->name);
 
   G_LOCK (clients);
   clients = g_list_remove (clients, client);
@@ -96,7 +100,7 @@ write_bytes (Client * client, const gchar * data, guint len)
 
   if (w <= 0) {
     if (err) {
-      gst_print ("Write error %s\n", err->message);
+      EXAMPLE_LOG_WARNING ("write-error", "Write error %s", err->message);
       g_clear_error (&err);
     }
     remove_client (client);
@@ -167,7 +171,8 @@ client_message (Client * client, const gchar * data, guint len)
         g_source_destroy (client->tosource);
         g_source_unref (client->tosource);
         client->tosource = NULL;
-        gst_print ("Starting to stream to %s\n", client->name);
+        EXAMPLE_LOG_INFO ("stream-started", "Starting to stream to %s",
+            client->name);
         g_signal_emit_by_name (multisocketsink, "add", client->socket);
       }
 
@@ -204,7 +209,7 @@ client_message (Client * client, const gchar * data, guint len)
 static gboolean
 on_timeout (Client * client)
 {
-  gst_print ("Timeout\n");
+  EXAMPLE_LOG_RATELIMITED (10, EXAMPLE_LOG_LEVEL_INFO, "timeout", "Timeout");
   remove_client (client);
 
   return FALSE;
@@ -250,14 +255,15 @@ on_read_bytes (GPollableInputStream * stream, Client * client)
     }
 
     if (client->current_message->len >= 1024 * 1024) {
-      gst_print ("No complete request after 1MB of data\n");
+      EXAMPLE_LOG_WARNING ("request-too-large",
+          "No complete request after 1MB of data");
       remove_client (client);
       return FALSE;
     }
 
     return TRUE;
   } else {
-    gst_print ("Read error %s\n", err->message);
+    EXAMPLE_LOG_WARNING ("read-error", "Read error %s", err->message);
     g_clear_error (&err);
     remove_client (client);
     return FALSE;
@@ -284,7 +290,8 @@ on_new_connection (GSocketService * service, GSocketConnection * connection,
   g_free (ip);
   g_object_unref (addr);
 
-  gst_print ("New connection %s\n", client->name);
+  EXAMPLE_LOG_RATELIMITED (50, EXAMPLE_LOG_LEVEL_INFO, "connection-new",
+      "New connection %s", client->name);
 
   client->waiting_200_ok = FALSE;
   client->http_version = g_strdup ("");
@@ -404,7 +411,8 @@ on_stream_caps_changed (GObject * obj, GParamSpec * pspec, gpointer user_data)
       } else {
         content_type = g_strdup_printf ("Content-Type: %s\r\n", mimetype);
       }
-      gst_print ("%s", content_type);
+      EXAMPLE_LOG_INFO ("content-type", "%.*s",
+          (gint) strlen (content_type) - 2, content_type);
       break;
     }
     i++;
@@ -439,8 +447,21 @@ main (gint argc, gchar ** argv)
   GstPad *srcpad, *ghostpad, *sinkpad;
   GError *err = NULL;
   GstBus *bus;
+  GOptionContext *context;
+
+  context = g_option_context_new ("PORT <launch line>");
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  g_option_context_add_group (context, example_tracer_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &err)) {
+    gst_printerr ("Error initializing: %s\n", err->message);
+    g_clear_error (&err);
+    g_option_context_free (context);
+    return -1;
+  }
+  g_option_context_free (context);
 
-  gst_init (&argc, &argv);
+  example_log_init ();
+  example_tracer_init ();
 
   if (argc < 4) {
     gst_print ("usage: %s PORT <launch line>\n"
@@ -538,5 +559,8 @@ main (gint argc, gchar ** argv)
 
   g_main_loop_unref (loop);
 
+  example_tracer_deinit ();
+  example_log_deinit ();
+
   return 0;
 }
@@ -30,6 +30,7 @@
 #include <math.h>
 
 #include "gst-play-kb.h"
+#include "example-tracer.h"
 #include <gst/play/play.h>
 
 #define VOLUME_STEPS 20
@@ -678,6 +679,7 @@ main (int argc, char **argv)
   ctx = g_option_context_new ("FILE1|URI1 [FILE2|URI2] [FILE3|URI3] ...");
   g_option_context_add_main_entries (ctx, options, NULL);
   g_option_context_add_group (ctx, gst_init_get_option_group ());
+  g_option_context_add_group (ctx, example_tracer_get_option_group ());
   if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
     gst_print ("Error initializing: %s\n", GST_STR_NULL (err->message));
     g_clear_error (&err);
@@ -770,12 +772,14 @@ main (int argc, char **argv)
   }
 
   /* play */
+  example_tracer_init ();
   do_play (play);
 
   /* clean up */
   play_free (play);
 
   gst_print ("\n");
+  example_tracer_deinit ();
   gst_deinit ();
   return 0;
 }
@@ -17,6 +17,11 @@
 
 #include <string.h>
 
+#include "example-dtls.h"
+#include "example-tracer.h"
+
+#define DTLS_ROTATE (24 * 60 * 60)       /* seconds */
+
 enum AppState
 {
   APP_STATE_UNKNOWN = 0,
@@ -51,6 +56,9 @@ static gchar *server_url = NULL;
 static gchar *local_id = NULL;
 static gchar *room_id = NULL;
 static gboolean strict_ssl = TRUE;
+static gint dtls_pool_size = 0;
+static gchar *dtls_cert_dir = NULL;
+static ExampleDtlsPool *dtls_pool = NULL;
 
 static GOptionEntry entries[] = {
   {"name", 0, 0, G_OPTION_ARG_STRING, &local_id,
@@ -59,6 +67,12 @@ static GOptionEntry entries[] = {
       "Room name to join or create", "ID"},
   {"server", 0, 0, G_OPTION_ARG_STRING, &server_url,
       "Signalling server to connect to", "URL"},
+  {"dtls-pool", 0, 0, G_OPTION_ARG_INT, &dtls_pool_size,
+        "Share this many DTLS certificates between all peers, renewed "
+        "daily, instead of one per peer", "N"},
+  {"dtls-cert-dir", 0, 0, G_OPTION_ARG_FILENAME, &dtls_cert_dir,
+        "Load the pooled DTLS certificates from the PEM files in this "
+        "directory", "DIR"},
   {NULL}
 };
 
@@ -341,6 +355,8 @@ add_peer_to_pipeline (const gchar * peer_id, gboolean offer)
   q = gst_element_factory_make ("queue", tmp);
   g_free (tmp);
   webrtc = gst_element_factory_make ("webrtcbin", peer_id);
+  if (dtls_pool != NULL)
+    example_dtls_pool_attach (dtls_pool, webrtc);
 
   gst_bin_add_many (GST_BIN (pipeline), q, webrtc, NULL);
 
@@ -931,6 +947,7 @@ main (int argc, char *argv[])
   context = g_option_context_new ("- gstreamer webrtc sendrecv demo");
   g_option_context_add_main_entries (context, entries, NULL);
   g_option_context_add_group (context, gst_init_get_option_group ());
+  g_option_context_add_group (context, example_tracer_get_option_group ());
   if (!g_option_context_parse (context, &argc, &argv, &error)) {
     gst_printerr ("Error initializing: %s\n", error->message);
     return -1;
@@ -965,6 +982,12 @@ main (int argc, char *argv[])
     gst_uri_unref (uri);
   }
 
+  example_tracer_init ();
+
+  if (dtls_pool_size > 0 || dtls_cert_dir != NULL)
+    dtls_pool = example_dtls_pool_new (MAX (dtls_pool_size, 1), dtls_cert_dir,
+        DTLS_ROTATE);
+
   loop = g_main_loop_new (NULL, FALSE);
 
   connect_to_websocket_server_async ();
@@ -975,6 +998,9 @@ main (int argc, char *argv[])
   gst_print ("Pipeline stopped\n");
 
   gst_object_unref (pipeline);
+  if (dtls_pool != NULL)
+    example_dtls_pool_free (dtls_pool);
+  example_tracer_deinit ();
   g_free (server_url);
   g_free (local_id);
   g_free (room_id);
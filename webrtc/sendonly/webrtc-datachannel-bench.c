@@ -0,0 +1,274 @@
+#include <locale.h>
+#include <glib.h>
+#include <gst/gst.h>
+
+#define GST_USE_UNSTABLE_API
+#include <gst/webrtc/webrtc.h>
+
+#include "example-datachannel.h"
+
+/* Measures data channel throughput between two webrtcbins in the same
+ * process, the offer/answer and candidates are handed over directly. The
+ * sending side goes through the same flow controlled sender as the
+ * datachannel server, so --batch and --queue-kb can be compared. */
+
+#define PRODUCE_INTERVAL 1      /* ms */
+
+static gint duration = 10;
+static gint message_size = 1024;
+static gint rate = 0;
+static gboolean batch = FALSE;
+static gint queue_kb = 4096;
+
+static GMainLoop *loop;
+static GstElement *pipeline, *offerer, *answerer;
+static GstWebRTCDataChannel *channel;
+static ExampleChannelSender *sender;
+static GBytes *message;
+static gint64 start_time;
+
+static GMutex received_lock;
+static guint64 received_messages;
+static guint64 received_bytes;
+
+static void
+count_message (G_GNUC_UNUSED gconstpointer data, gsize size,
+    G_GNUC_UNUSED gpointer user_data)
+{
+  received_messages++;
+  received_bytes += size;
+}
+
+static void
+on_message_data_cb (G_GNUC_UNUSED GstWebRTCDataChannel * self, GBytes * data,
+    G_GNUC_UNUSED gpointer user_data)
+{
+  g_mutex_lock (&received_lock);
+  if (!batch)
+    count_message (NULL, g_bytes_get_size (data), NULL);
+  else if (!example_channel_foreach_message (data, count_message, NULL))
+    g_printerr ("Received a truncated batch\n");
+  g_mutex_unlock (&received_lock);
+}
+
+static void
+on_data_channel_cb (G_GNUC_UNUSED GstElement * webrtcbin,
+    GstWebRTCDataChannel * remote_channel, G_GNUC_UNUSED gpointer user_data)
+{
+  g_signal_connect (remote_channel, "on-message-data",
+      G_CALLBACK (on_message_data_cb), NULL);
+}
+
+static void
+print_results (void)
+{
+  ExampleChannelStats stats;
+  gdouble elapsed;
+
+  elapsed = (g_get_monotonic_time () - start_time) / (gdouble) G_USEC_PER_SEC;
+  example_channel_sender_get_stats (sender, &stats);
+
+  g_mutex_lock (&received_lock);
+  gst_print ("message size %d bytes, %s, %.1f s\n", message_size,
+      batch ? "batched" : "not batched", elapsed);
+  gst_print ("sent:     %" G_GUINT64_FORMAT " messages in %" G_GUINT64_FORMAT
+      " SCTP messages, %" G_GUINT64_FORMAT " dropped, peak queue %"
+      G_GUINT64_FORMAT " bytes\n", stats.messages_sent,
+      batch ? stats.batches_sent : stats.messages_sent, stats.dropped,
+      stats.max_queued_bytes);
+  gst_print ("received: %" G_GUINT64_FORMAT " messages, %.0f messages/s, "
+      "%.2f Mbit/s\n", received_messages, received_messages / elapsed,
+      received_bytes * 8 / elapsed / 1000000);
+  g_mutex_unlock (&received_lock);
+}
+
+static gboolean
+produce_cb (G_GNUC_UNUSED gpointer user_data)
+{
+  static gint64 last_time = 0;
+  static gdouble credit = 0;
+  ExampleChannelStats stats;
+  gint64 now = g_get_monotonic_time ();
+
+  if (now - start_time >= duration * G_USEC_PER_SEC) {
+    print_results ();
+    g_main_loop_quit (loop);
+    return G_SOURCE_REMOVE;
+  }
+
+  if (rate > 0) {
+    if (last_time != 0)
+      credit += rate * (now - last_time) / (gdouble) G_USEC_PER_SEC;
+    last_time = now;
+
+    for (; credit >= 1; credit--)
+      example_channel_sender_send_data (sender, message);
+    return G_SOURCE_CONTINUE;
+  }
+
+  /* Unpaced: keep the queue half full so nothing is dropped */
+  do {
+    if (!example_channel_sender_send_data (sender, message))
+      break;
+    example_channel_sender_get_stats (sender, &stats);
+  } while (stats.queued_bytes < (guint64) queue_kb * 1024 / 2);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+start_producing (G_GNUC_UNUSED gpointer user_data)
+{
+  gst_print ("Data channel open, sending for %d s\n", duration);
+  start_time = g_get_monotonic_time ();
+  g_timeout_add (PRODUCE_INTERVAL, produce_cb, NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+on_open_cb (G_GNUC_UNUSED GstWebRTCDataChannel * self,
+    G_GNUC_UNUSED gpointer user_data)
+{
+  g_main_context_invoke (NULL, start_producing, NULL);
+}
+
+static void
+on_answer_created_cb (GstPromise * promise, G_GNUC_UNUSED gpointer user_data)
+{
+  GstWebRTCSessionDescription *answer = NULL;
+
+  gst_structure_get (gst_promise_get_reply (promise), "answer",
+      GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &answer, NULL);
+  gst_promise_unref (promise);
+
+  g_signal_emit_by_name (answerer, "set-local-description", answer, NULL);
+  g_signal_emit_by_name (offerer, "set-remote-description", answer, NULL);
+  gst_webrtc_session_description_free (answer);
+}
+
+static void
+on_offer_created_cb (GstPromise * promise, G_GNUC_UNUSED gpointer user_data)
+{
+  GstWebRTCSessionDescription *offer = NULL;
+
+  gst_structure_get (gst_promise_get_reply (promise), "offer",
+      GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &offer, NULL);
+  gst_promise_unref (promise);
+
+  g_signal_emit_by_name (offerer, "set-local-description", offer, NULL);
+  g_signal_emit_by_name (answerer, "set-remote-description", offer, NULL);
+  gst_webrtc_session_description_free (offer);
+
+  promise = gst_promise_new_with_change_func (on_answer_created_cb, NULL,
+      NULL);
+  g_signal_emit_by_name (answerer, "create-answer", NULL, promise);
+}
+
+static void
+on_negotiation_needed_cb (GstElement * webrtcbin,
+    G_GNUC_UNUSED gpointer user_data)
+{
+  GstPromise *promise;
+
+  promise = gst_promise_new_with_change_func (on_offer_created_cb, NULL,
+      NULL);
+  g_signal_emit_by_name (webrtcbin, "create-offer", NULL, promise);
+}
+
+static void
+on_ice_candidate_cb (G_GNUC_UNUSED GstElement * webrtcbin, guint mline_index,
+    gchar * candidate, gpointer user_data)
+{
+  GstElement *other = (GstElement *) user_data;
+
+  g_signal_emit_by_name (other, "add-ice-candidate", mline_index, candidate);
+}
+
+static GOptionEntry entries[] = {
+  {"duration", 0, 0, G_OPTION_ARG_INT, &duration,
+      "Seconds to send for (default: 10)", "S"},
+  {"message-size", 0, 0, G_OPTION_ARG_INT, &message_size,
+      "Size of every message in bytes (default: 1024)", "BYTES"},
+  {"rate", 0, 0, G_OPTION_ARG_INT, &rate,
+        "Messages per second, 0 sends as fast as flow control allows "
+        "(default: 0)", "N"},
+  {"batch", 0, 0, G_OPTION_ARG_NONE, &batch,
+      "Coalesce small messages into one SCTP message", NULL},
+  {"queue-kb", 0, 0, G_OPTION_ARG_INT, &queue_kb,
+      "Send queue limit (default: 4096)", "KB"},
+  {NULL},
+};
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+
+  setlocale (LC_ALL, "");
+
+  context = g_option_context_new ("- webrtc data channel throughput benchmark");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("Error initializing: %s\n", error->message);
+    return -1;
+  }
+  g_option_context_free (context);
+
+  if (message_size <= 0 || queue_kb <= 0 || duration <= 0) {
+    g_printerr ("Sizes and duration must be positive\n");
+    return -1;
+  }
+
+  loop = g_main_loop_new (NULL, FALSE);
+  message = g_bytes_new_take (g_malloc0 (message_size), message_size);
+
+  pipeline = gst_pipeline_new (NULL);
+  offerer = gst_element_factory_make ("webrtcbin", "offerer");
+  answerer = gst_element_factory_make ("webrtcbin", "answerer");
+  if (offerer == NULL || answerer == NULL) {
+    g_printerr ("webrtcbin is not available\n");
+    return -1;
+  }
+  gst_bin_add_many (GST_BIN (pipeline), offerer, answerer, NULL);
+
+  g_signal_connect (offerer, "on-negotiation-needed",
+      G_CALLBACK (on_negotiation_needed_cb), NULL);
+  g_signal_connect (offerer, "on-ice-candidate",
+      G_CALLBACK (on_ice_candidate_cb), answerer);
+  g_signal_connect (answerer, "on-ice-candidate",
+      G_CALLBACK (on_ice_candidate_cb), offerer);
+  g_signal_connect (answerer, "on-data-channel",
+      G_CALLBACK (on_data_channel_cb), NULL);
+
+  if (gst_element_set_state (pipeline, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_FAILURE) {
+    g_printerr ("Could not start the pipeline\n");
+    return -1;
+  }
+
+  g_signal_emit_by_name (offerer, "create-data-channel", "bench", NULL,
+      &channel);
+  if (channel == NULL) {
+    g_printerr ("Could not create a data channel\n");
+    return -1;
+  }
+  sender = example_channel_sender_new (channel, NULL,
+      (gsize) queue_kb * 1024, batch);
+  g_signal_connect (channel, "on-open", G_CALLBACK (on_open_cb), NULL);
+
+  g_main_loop_run (loop);
+
+  example_channel_sender_close (sender);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (channel);
+  gst_object_unref (pipeline);
+  g_bytes_unref (message);
+  g_main_loop_unref (loop);
+
+  gst_deinit ();
+
+  return 0;
+}
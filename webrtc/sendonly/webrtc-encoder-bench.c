@@ -0,0 +1,469 @@
+#include <locale.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#ifdef G_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#include "example-encoders.h"
+
+/* Encodes the same sequence with every encoder backend the sendonly server
+ * can use, at a ladder of bitrates, and reports for each run:
+ *  - the speed when encoding as fast as possible,
+ *  - the CPU time one real-time stream costs, the source excluded,
+ *  - the bitrate actually produced,
+ *  - the luma PSNR of the decoded result against the source.
+ * From the PSNR curve it interpolates the bitrate each backend needs to
+ * reach --target-psnr, which is the number to compare deployments by. */
+
+#define MAX_PSNR 100.0
+
+static gchar *encoder_names = NULL;
+static gchar *bitrate_list = NULL;
+static gchar *location = NULL;
+static gchar *pattern = NULL;
+static gint frames = 300;
+static gint width = 640;
+static gint height = 360;
+static gint framerate = 15;
+static gint keyframe_interval = 15;
+static gdouble target_psnr = 38.0;
+
+typedef struct
+{
+  GMutex lock;
+  guint64 encoded_bytes;
+  GHashTable *references;       /* PTS -> luma plane */
+  gdouble psnr_sum;
+  guint compared;
+} BenchRun;
+
+static gdouble
+get_cpu_time (void)
+{
+#ifdef G_OS_UNIX
+  struct rusage usage;
+
+  if (getrusage (RUSAGE_SELF, &usage) == 0)
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+        + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+
+  return -1;
+}
+
+static gchar *
+describe_source (void)
+{
+  if (location != NULL)
+    return g_strdup_printf ("filesrc location=\"%s\" ! decodebin ! "
+        "videoconvert ! videoscale ! videorate ! "
+        "video/x-raw,format=I420,width=%d,height=%d,framerate=%d/1 ! "
+        "identity eos-after=%d", location, width, height, framerate, frames);
+
+  return g_strdup_printf ("videotestsrc num-buffers=%d pattern=%s "
+      "horizontal-speed=4 ! "
+      "video/x-raw,format=I420,width=%d,height=%d,framerate=%d/1", frames,
+      pattern, width, height, framerate);
+}
+
+static GstPadProbeReturn
+count_bytes_cb (G_GNUC_UNUSED GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  BenchRun *run = (BenchRun *) user_data;
+
+  g_mutex_lock (&run->lock);
+  run->encoded_bytes += gst_buffer_get_size (GST_PAD_PROBE_INFO_BUFFER (info));
+  g_mutex_unlock (&run->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static gboolean
+map_frame (GstPad * pad, GstBuffer * buffer, GstVideoFrame * frame)
+{
+  GstVideoInfo vinfo;
+  GstCaps *caps = gst_pad_get_current_caps (pad);
+  gboolean ret;
+
+  if (caps == NULL)
+    return FALSE;
+  ret = gst_video_info_from_caps (&vinfo, caps)
+      && gst_video_frame_map (frame, &vinfo, buffer, GST_MAP_READ);
+  gst_caps_unref (caps);
+
+  return ret;
+}
+
+static void
+reference_handoff_cb (G_GNUC_UNUSED GstElement * sink, GstBuffer * buffer,
+    GstPad * pad, gpointer user_data)
+{
+  BenchRun *run = (BenchRun *) user_data;
+  GstVideoFrame frame;
+  guint64 *pts;
+  guint8 *luma;
+  gint y;
+
+  if (!map_frame (pad, buffer, &frame))
+    return;
+
+  luma = g_malloc (width * height);
+  for (y = 0; y < height; y++)
+    memcpy (luma + y * width, (guint8 *) GST_VIDEO_FRAME_COMP_DATA (&frame,
+            0) + y * GST_VIDEO_FRAME_COMP_STRIDE (&frame, 0), width);
+  gst_video_frame_unmap (&frame);
+
+  pts = g_new (guint64, 1);
+  *pts = GST_BUFFER_PTS (buffer);
+
+  g_mutex_lock (&run->lock);
+  g_hash_table_replace (run->references, pts, luma);
+  g_mutex_unlock (&run->lock);
+}
+
+static void
+decoded_handoff_cb (G_GNUC_UNUSED GstElement * sink, GstBuffer * buffer,
+    GstPad * pad, gpointer user_data)
+{
+  BenchRun *run = (BenchRun *) user_data;
+  GstVideoFrame frame;
+  guint64 pts = GST_BUFFER_PTS (buffer);
+  const guint8 *reference, *decoded;
+  gdouble sse = 0, mse;
+  gint stride, x, y;
+
+  if (!map_frame (pad, buffer, &frame))
+    return;
+
+  g_mutex_lock (&run->lock);
+  reference = g_hash_table_lookup (run->references, &pts);
+  if (reference != NULL) {
+    decoded = GST_VIDEO_FRAME_COMP_DATA (&frame, 0);
+    stride = GST_VIDEO_FRAME_COMP_STRIDE (&frame, 0);
+    for (y = 0; y < height; y++) {
+      for (x = 0; x < width; x++) {
+        gint diff = reference[y * width + x] - decoded[y * stride + x];
+
+        sse += diff * diff;
+      }
+    }
+
+    mse = sse / (width * height);
+    run->psnr_sum += mse > 0 ? MIN (10 * log10 (255.0 * 255.0 / mse),
+        MAX_PSNR) : MAX_PSNR;
+    run->compared++;
+    g_hash_table_remove (run->references, &pts);
+  }
+  g_mutex_unlock (&run->lock);
+
+  gst_video_frame_unmap (&frame);
+}
+
+static gboolean
+run_pipeline (const gchar * description, BenchRun * run)
+{
+  GstElement *pipeline, *element;
+  GstMessage *message;
+  GstBus *bus;
+  GError *error = NULL;
+  gboolean ret;
+
+  pipeline = gst_parse_launch (description, &error);
+  if (error != NULL) {
+    g_printerr ("Could not create pipeline: %s\n", error->message);
+    g_error_free (error);
+    gst_clear_object (&pipeline);
+    return FALSE;
+  }
+
+  if ((element = gst_bin_get_by_name (GST_BIN (pipeline), "encoder"))) {
+    GstPad *pad = gst_element_get_static_pad (element, "src");
+
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, count_bytes_cb, run,
+        NULL);
+    gst_object_unref (pad);
+    gst_object_unref (element);
+  }
+  if ((element = gst_bin_get_by_name (GST_BIN (pipeline), "reference"))) {
+    g_signal_connect (element, "handoff", G_CALLBACK (reference_handoff_cb),
+        run);
+    gst_object_unref (element);
+  }
+  if ((element = gst_bin_get_by_name (GST_BIN (pipeline), "decoded"))) {
+    g_signal_connect (element, "handoff", G_CALLBACK (decoded_handoff_cb),
+        run);
+    gst_object_unref (element);
+  }
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  message = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  ret = GST_MESSAGE_TYPE (message) == GST_MESSAGE_EOS;
+  if (!ret) {
+    gst_message_parse_error (message, &error, NULL);
+    g_printerr ("Pipeline failed: %s\n", error->message);
+    g_error_free (error);
+  }
+  gst_message_unref (message);
+  gst_object_unref (bus);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  return ret;
+}
+
+static void
+bench_run_init (BenchRun * run)
+{
+  memset (run, 0, sizeof (BenchRun));
+  g_mutex_init (&run->lock);
+  run->references = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+      g_free, g_free);
+}
+
+static void
+bench_run_clear (BenchRun * run)
+{
+  g_hash_table_unref (run->references);
+  g_mutex_clear (&run->lock);
+}
+
+/* Wall and CPU time of a pipeline that does nothing but produce the
+ * sequence, subtracted from every encoder run */
+static gboolean
+measure_source (gdouble * cpu)
+{
+  gchar *source = describe_source ();
+  gchar *description = g_strdup_printf ("%s ! fakesink sync=false", source);
+  gdouble start = get_cpu_time ();
+  gboolean ret = run_pipeline (description, NULL);
+
+  *cpu = get_cpu_time () - start;
+  g_free (description);
+  g_free (source);
+
+  return ret;
+}
+
+static gboolean
+bench_encoder (const ExampleEncoder * encoder, ExampleEncoderPreset preset,
+    gint bitrate, gdouble source_cpu, gdouble * psnr)
+{
+  gchar *source = describe_source ();
+  gchar *encode = example_encoder_describe (encoder, preset, "encoder",
+      bitrate, keyframe_interval);
+  gchar *description;
+  gdouble seconds = frames / (gdouble) framerate;
+  gdouble cpu_start, cpu;
+  gint64 start, wall;
+  BenchRun run;
+  gboolean ret;
+
+  /* Speed and bitrate, nothing else in the pipeline */
+  bench_run_init (&run);
+  description = g_strdup_printf ("%s ! %s ! fakesink sync=false", source,
+      encode);
+  cpu_start = get_cpu_time ();
+  start = g_get_monotonic_time ();
+  ret = run_pipeline (description, &run);
+  wall = g_get_monotonic_time () - start;
+  cpu = get_cpu_time () - cpu_start - source_cpu;
+  g_free (description);
+
+  if (ret) {
+    gst_print ("%-9s %-9s %6d %8.0f %8.1f ", encoder->name,
+        example_encoder_preset_to_string (preset), bitrate,
+        run.encoded_bytes * 8 / seconds / 1000,
+        frames / (wall / (gdouble) G_USEC_PER_SEC));
+    if (cpu_start >= 0)
+      gst_print ("%8.1f ", MAX (cpu, 0) / seconds * 100);
+    else
+      gst_print ("%8s ", "n/a");
+  }
+  bench_run_clear (&run);
+
+  /* Quality, the decoded frames are matched to the source by PTS */
+  if (ret) {
+    bench_run_init (&run);
+    description = g_strdup_printf ("%s ! tee name=t "
+        "t. ! queue ! %s ! decodebin ! videoconvert ! "
+        "video/x-raw,format=I420 ! fakesink name=decoded sync=false "
+        "signal-handoffs=true "
+        "t. ! queue ! fakesink name=reference sync=false "
+        "signal-handoffs=true", source, encode);
+    ret = run_pipeline (description, &run);
+    g_free (description);
+
+    *psnr = run.compared > 0 ? run.psnr_sum / run.compared : 0;
+    if (ret)
+      gst_print ("%7.2f %5u\n", *psnr, run.compared);
+    else
+      gst_print ("\n");
+    bench_run_clear (&run);
+  }
+
+  g_free (encode);
+  g_free (source);
+
+  return ret;
+}
+
+/* PSNR grows roughly linearly with the logarithm of the bitrate */
+static gdouble
+bitrate_for_psnr (const gint * bitrates, const gdouble * psnrs, gint n)
+{
+  gint i;
+
+  for (i = 1; i < n; i++) {
+    if (psnrs[i - 1] < target_psnr && psnrs[i] >= target_psnr) {
+      gdouble t = (target_psnr - psnrs[i - 1]) / (psnrs[i] - psnrs[i - 1]);
+
+      return exp (log (bitrates[i - 1]) + t * (log (bitrates[i]) -
+              log (bitrates[i - 1])));
+    }
+  }
+
+  if (n > 0 && psnrs[0] >= target_psnr)
+    return bitrates[0];
+
+  return -1;
+}
+
+static GOptionEntry entries[] = {
+  {"encoders", 0, 0, G_OPTION_ARG_STRING, &encoder_names,
+        "Comma separated encoders to compare (default: all installed of "
+        "x264, openh264, vp8, vp9, av1)", "LIST"},
+  {"bitrates", 0, 0, G_OPTION_ARG_STRING, &bitrate_list,
+      "Comma separated bitrates in kbit/s (default: 150,300,600,1200,2400)",
+      "LIST"},
+  {"target-psnr", 0, 0, G_OPTION_ARG_DOUBLE, &target_psnr,
+      "Quality to compare the encoders at, in dB (default: 38)", "DB"},
+  {"location", 0, 0, G_OPTION_ARG_FILENAME, &location,
+      "Encode this file instead of a test pattern", "FILE"},
+  {"pattern", 0, 0, G_OPTION_ARG_STRING, &pattern,
+      "videotestsrc pattern (default: smpte, moving)", "PATTERN"},
+  {"frames", 0, 0, G_OPTION_ARG_INT, &frames,
+      "Length of the sequence (default: 300)", "N"},
+  {"width", 0, 0, G_OPTION_ARG_INT, &width, "Frame width (default: 640)",
+      "PIXELS"},
+  {"height", 0, 0, G_OPTION_ARG_INT, &height, "Frame height (default: 360)",
+      "PIXELS"},
+  {"framerate", 0, 0, G_OPTION_ARG_INT, &framerate,
+      "Frames per second (default: 15)", "FPS"},
+  {"keyframe-interval", 0, 0, G_OPTION_ARG_INT, &keyframe_interval,
+      "Frames between keyframes (default: 15)", "N"},
+  {NULL},
+};
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  const ExampleEncoder *const *all;
+  GPtrArray *encoders;
+  gchar **names, **bitrate_strings;
+  gint *bitrates, n_bitrates, i, j, preset;
+  gdouble *psnrs, source_cpu;
+
+  setlocale (LC_ALL, "");
+
+  context = g_option_context_new ("- compare the sendonly encoder backends");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("Error initializing: %s\n", error->message);
+    return -1;
+  }
+  g_option_context_free (context);
+
+  if (pattern == NULL)
+    pattern = g_strdup ("smpte");
+  if (frames <= 0 || width <= 0 || height <= 0 || framerate <= 0) {
+    g_printerr ("Sequence dimensions must be positive\n");
+    return -1;
+  }
+
+  encoders = g_ptr_array_new ();
+  if (encoder_names != NULL) {
+    names = g_strsplit (encoder_names, ",", -1);
+    for (i = 0; names[i] != NULL; i++) {
+      const ExampleEncoder *encoder =
+          example_encoder_find (g_strstrip (names[i]));
+
+      if (encoder == NULL || !example_encoder_available (encoder))
+        g_printerr ("Skipping unavailable encoder %s\n", names[i]);
+      else
+        g_ptr_array_add (encoders, (gpointer) encoder);
+    }
+    g_strfreev (names);
+  } else {
+    for (all = example_encoder_list (); *all != NULL; all++)
+      if (example_encoder_available (*all))
+        g_ptr_array_add (encoders, (gpointer) * all);
+  }
+  if (encoders->len == 0) {
+    g_printerr ("No encoder to benchmark\n");
+    return -1;
+  }
+
+  bitrate_strings = g_strsplit (bitrate_list ? bitrate_list :
+      "150,300,600,1200,2400", ",", -1);
+  n_bitrates = g_strv_length (bitrate_strings);
+  bitrates = g_new0 (gint, n_bitrates);
+  psnrs = g_new0 (gdouble, n_bitrates);
+  for (i = 0; i < n_bitrates; i++)
+    bitrates[i] = atoi (bitrate_strings[i]);
+  g_strfreev (bitrate_strings);
+
+  if (!measure_source (&source_cpu)) {
+    g_printerr ("Could not produce the test sequence\n");
+    return -1;
+  }
+
+  gst_print ("%d frames %dx%d@%d, keyframe every %d frames\n", frames,
+      width, height, framerate, keyframe_interval);
+  gst_print ("%-9s %-9s %6s %8s %8s %8s %7s %5s\n", "encoder", "preset",
+      "kbps", "actual", "fps", "cpu%", "psnr", "n");
+
+  for (i = 0; i < (gint) encoders->len; i++) {
+    const ExampleEncoder *encoder = g_ptr_array_index (encoders, i);
+
+    for (preset = 0; preset < EXAMPLE_ENCODER_N_PRESETS; preset++) {
+      gdouble needed;
+
+      for (j = 0; j < n_bitrates; j++)
+        if (!bench_encoder (encoder, preset, bitrates[j], source_cpu,
+                &psnrs[j]))
+          psnrs[j] = 0;
+
+      needed = bitrate_for_psnr (bitrates, psnrs, n_bitrates);
+      if (needed > 0)
+        gst_print ("%s %s reaches %.1f dB at ~%.0f kbit/s\n\n",
+            encoder->name, example_encoder_preset_to_string (preset),
+            target_psnr, needed);
+      else
+        gst_print ("%s %s does not reach %.1f dB in the tested range\n\n",
+            encoder->name, example_encoder_preset_to_string (preset),
+            target_psnr);
+    }
+  }
+
+  g_free (bitrates);
+  g_free (psnrs);
+  g_ptr_array_unref (encoders);
+  g_free (pattern);
+
+  gst_deinit ();
+
+  return 0;
+}
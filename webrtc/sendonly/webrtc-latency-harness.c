@@ -0,0 +1,514 @@
+#include <locale.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#define GST_USE_UNSTABLE_API
+#include <gst/webrtc/webrtc.h>
+
+/* Glass-to-glass latency of the sendonly video path on one host. Every
+ * captured frame gets its sequence number painted into the top rows as
+ * black and white blocks, which survive any encoder, and goes through the
+ * same encode/payload chain as webrtc-unidirectional-h264 into a second
+ * webrtcbin. There it is decoded like in webrtc-recvonly-h264 and read back
+ * when the sink renders it, so the difference to the capture time covers
+ * queueing, encoding, packetization, the jitterbuffer, decoding and sink
+ * synchronisation. */
+
+#define RTP_PAYLOAD_TYPE "96"
+
+#define STAMP_BITS 32           /* 24 bit sequence number, 8 bit check */
+#define STAMP_HEIGHT 16
+#define CAPTURE_RING 1024
+
+static gint duration = 20;
+static gint warmup = 3;
+static gint width = 640;
+static gint height = 360;
+static gint framerate = 15;
+static gint queue_buffers = 1;
+static gint jitterbuffer_latency = 200;
+static gchar *encoder = NULL;
+static gchar *aggregate_mode = NULL;
+static gchar *csv_path = NULL;
+
+static GMainLoop *loop;
+static GstElement *pipeline, *sender, *receiver;
+
+static GMutex lock;
+static gint64 capture_times[CAPTURE_RING];
+static guint32 next_seqnum;
+static gint64 measure_start;
+static guint32 first_seqnum;
+static gboolean measuring;
+static GArray *latencies;       /* gint64 us, in render order */
+static guint undecodable;
+
+static guint8
+stamp_check (guint32 seqnum)
+{
+  return (seqnum ^ (seqnum >> 8) ^ (seqnum >> 16) ^ 0x5a) & 0xff;
+}
+
+static void
+paint_stamp (GstVideoFrame * frame, guint32 seqnum)
+{
+  guint32 code = (seqnum & 0xffffff) << 8 | stamp_check (seqnum);
+  guint8 *pixels = GST_VIDEO_FRAME_COMP_DATA (frame, 0);
+  gint stride = GST_VIDEO_FRAME_COMP_STRIDE (frame, 0);
+  gint block_width = GST_VIDEO_FRAME_WIDTH (frame) / STAMP_BITS;
+  gint bit, y;
+
+  for (bit = 0; bit < STAMP_BITS; bit++) {
+    guint8 luma = (code >> (STAMP_BITS - 1 - bit)) & 1 ? 235 : 16;
+
+    for (y = 0; y < STAMP_HEIGHT; y++)
+      memset (pixels + y * stride + bit * block_width, luma, block_width);
+  }
+}
+
+/* Only looks at the middle of every block so ringing at the edges does not
+ * matter */
+static gboolean
+read_stamp (GstVideoFrame * frame, guint32 * seqnum)
+{
+  const guint8 *pixels = GST_VIDEO_FRAME_COMP_DATA (frame, 0);
+  gint stride = GST_VIDEO_FRAME_COMP_STRIDE (frame, 0);
+  gint block_width = GST_VIDEO_FRAME_WIDTH (frame) / STAMP_BITS;
+  guint32 code = 0;
+  gint bit, x, y;
+
+  for (bit = 0; bit < STAMP_BITS; bit++) {
+    guint sum = 0, n = 0;
+
+    for (y = STAMP_HEIGHT / 4; y < STAMP_HEIGHT * 3 / 4; y++)
+      for (x = block_width / 4; x < block_width * 3 / 4; x++, n++)
+        sum += pixels[y * stride + bit * block_width + x];
+
+    code = code << 1 | (n > 0 && sum / n > 128);
+  }
+
+  *seqnum = code >> 8;
+  return (code & 0xff) == stamp_check (*seqnum);
+}
+
+static GstPadProbeReturn
+capture_probe_cb (GstPad * pad, GstPadProbeInfo * info,
+    G_GNUC_UNUSED gpointer user_data)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstVideoFrame frame;
+  GstVideoInfo vinfo;
+  GstCaps *caps;
+  guint32 seqnum;
+
+  caps = gst_pad_get_current_caps (pad);
+  if (caps == NULL || !gst_video_info_from_caps (&vinfo, caps)) {
+    gst_clear_caps (&caps);
+    return GST_PAD_PROBE_OK;
+  }
+  gst_caps_unref (caps);
+
+  buffer = gst_buffer_make_writable (buffer);
+  GST_PAD_PROBE_INFO_DATA (info) = buffer;
+
+  g_mutex_lock (&lock);
+  seqnum = next_seqnum++ & 0xffffff;
+  capture_times[seqnum % CAPTURE_RING] = g_get_monotonic_time ();
+  if (!measuring && measure_start != 0
+      && capture_times[seqnum % CAPTURE_RING] >= measure_start) {
+    measuring = TRUE;
+    first_seqnum = seqnum;
+  }
+  g_mutex_unlock (&lock);
+
+  if (gst_video_frame_map (&frame, &vinfo, buffer, GST_MAP_WRITE)) {
+    paint_stamp (&frame, seqnum);
+    gst_video_frame_unmap (&frame);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* fakesink emits this after waiting for the clock, i.e. at render time */
+static void
+render_handoff_cb (G_GNUC_UNUSED GstElement * sink, GstBuffer * buffer,
+    GstPad * pad, G_GNUC_UNUSED gpointer user_data)
+{
+  gint64 now = g_get_monotonic_time ();
+  GstVideoFrame frame;
+  GstVideoInfo vinfo;
+  GstCaps *caps;
+  guint32 seqnum;
+  gboolean valid;
+
+  caps = gst_pad_get_current_caps (pad);
+  if (caps == NULL || !gst_video_info_from_caps (&vinfo, caps)) {
+    gst_clear_caps (&caps);
+    return;
+  }
+  gst_caps_unref (caps);
+
+  if (!gst_video_frame_map (&frame, &vinfo, buffer, GST_MAP_READ))
+    return;
+  valid = read_stamp (&frame, &seqnum);
+  gst_video_frame_unmap (&frame);
+
+  g_mutex_lock (&lock);
+  if (measuring && !valid) {
+    undecodable++;
+  } else if (measuring && seqnum >= first_seqnum
+      && next_seqnum - seqnum < CAPTURE_RING) {
+    gint64 latency = now - capture_times[seqnum % CAPTURE_RING];
+
+    g_array_append_val (latencies, latency);
+  }
+  g_mutex_unlock (&lock);
+}
+
+static gint
+compare_latency (gconstpointer a, gconstpointer b)
+{
+  gint64 la = *(const gint64 *) a, lb = *(const gint64 *) b;
+
+  return la < lb ? -1 : la > lb;
+}
+
+static gdouble
+percentile (GArray * sorted, gdouble p)
+{
+  guint index = (guint) (p / 100 * (sorted->len - 1) + 0.5);
+
+  return g_array_index (sorted, gint64, index) / 1000.0;
+}
+
+static void
+print_results (void)
+{
+  GArray *sorted;
+  guint captured, i;
+  gdouble sum = 0;
+
+  g_mutex_lock (&lock);
+  captured = measuring ? next_seqnum - first_seqnum : 0;
+  sorted = g_array_sized_new (FALSE, FALSE, sizeof (gint64), latencies->len);
+  g_array_append_vals (sorted, latencies->data, latencies->len);
+  g_mutex_unlock (&lock);
+
+  gst_print ("encoder: %s\n", encoder);
+  gst_print ("%dx%d@%d, queue max-size-buffers=%d, aggregate-mode=%s, "
+      "jitterbuffer latency %d ms\n", width, height, framerate, queue_buffers,
+      aggregate_mode, jitterbuffer_latency);
+  gst_print ("frames: %u captured, %u rendered, %u unreadable\n", captured,
+      sorted->len, undecodable);
+
+  if (sorted->len == 0) {
+    gst_print ("no frames measured\n");
+    g_array_unref (sorted);
+    return;
+  }
+
+  if (csv_path != NULL) {
+    FILE *csv = fopen (csv_path, "w");
+
+    if (csv != NULL) {
+      fprintf (csv, "frame,latency_ms\n");
+      for (i = 0; i < sorted->len; i++)
+        fprintf (csv, "%u,%.3f\n", i, g_array_index (sorted, gint64,
+                i) / 1000.0);
+      fclose (csv);
+    } else {
+      g_printerr ("Could not write %s\n", csv_path);
+    }
+  }
+
+  g_array_sort (sorted, compare_latency);
+  for (i = 0; i < sorted->len; i++)
+    sum += g_array_index (sorted, gint64, i);
+
+  gst_print ("latency ms: mean %.1f, min %.1f, p50 %.1f, p90 %.1f, "
+      "p95 %.1f, p99 %.1f, max %.1f\n", sum / sorted->len / 1000.0,
+      percentile (sorted, 0), percentile (sorted, 50), percentile (sorted, 90),
+      percentile (sorted, 95), percentile (sorted, 99),
+      percentile (sorted, 100));
+
+  g_array_unref (sorted);
+}
+
+static gboolean
+stop_cb (G_GNUC_UNUSED gpointer user_data)
+{
+  print_results ();
+  g_main_loop_quit (loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+start_measuring_cb (G_GNUC_UNUSED gpointer user_data)
+{
+  g_mutex_lock (&lock);
+  measure_start = g_get_monotonic_time ();
+  g_mutex_unlock (&lock);
+
+  gst_print ("Measuring for %d s\n", duration);
+  g_timeout_add_seconds (duration, stop_cb, NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+on_incoming_decodebin_stream (G_GNUC_UNUSED GstElement * decodebin,
+    GstPad * pad, G_GNUC_UNUSED gpointer user_data)
+{
+  GstElement *render_bin, *sink;
+  GstPad *sinkpad;
+  GError *error = NULL;
+
+  render_bin = gst_parse_bin_from_description ("queue ! videoconvert ! "
+      "video/x-raw,format=I420 ! fakesink name=render sync=true "
+      "signal-handoffs=true", TRUE, &error);
+  if (error != NULL)
+    g_error ("Could not create render bin: %s", error->message);
+
+  sink = gst_bin_get_by_name (GST_BIN (render_bin), "render");
+  g_signal_connect (sink, "handoff", G_CALLBACK (render_handoff_cb), NULL);
+  gst_object_unref (sink);
+
+  gst_bin_add (GST_BIN (pipeline), render_bin);
+  gst_element_sync_state_with_parent (render_bin);
+
+  sinkpad = gst_element_get_static_pad (render_bin, "sink");
+  if (gst_pad_link (pad, sinkpad) != GST_PAD_LINK_OK)
+    g_error ("Could not link the decoder");
+  gst_object_unref (sinkpad);
+
+  gst_print ("Receiving, warming up for %d s\n", warmup);
+  g_timeout_add_seconds (warmup, start_measuring_cb, NULL);
+}
+
+static void
+on_incoming_stream (G_GNUC_UNUSED GstElement * webrtcbin, GstPad * pad,
+    G_GNUC_UNUSED gpointer user_data)
+{
+  GstElement *decodebin;
+  GstPad *sinkpad;
+
+  if (GST_PAD_DIRECTION (pad) != GST_PAD_SRC)
+    return;
+
+  decodebin = gst_element_factory_make ("decodebin", NULL);
+  g_signal_connect (decodebin, "pad-added",
+      G_CALLBACK (on_incoming_decodebin_stream), NULL);
+  gst_bin_add (GST_BIN (pipeline), decodebin);
+  gst_element_sync_state_with_parent (decodebin);
+
+  sinkpad = gst_element_get_static_pad (decodebin, "sink");
+  gst_pad_link (pad, sinkpad);
+  gst_object_unref (sinkpad);
+}
+
+static void
+on_answer_created_cb (GstPromise * promise, G_GNUC_UNUSED gpointer user_data)
+{
+  GstWebRTCSessionDescription *answer = NULL;
+
+  gst_structure_get (gst_promise_get_reply (promise), "answer",
+      GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &answer, NULL);
+  gst_promise_unref (promise);
+
+  g_signal_emit_by_name (receiver, "set-local-description", answer, NULL);
+  g_signal_emit_by_name (sender, "set-remote-description", answer, NULL);
+  gst_webrtc_session_description_free (answer);
+}
+
+static void
+on_offer_created_cb (GstPromise * promise, G_GNUC_UNUSED gpointer user_data)
+{
+  GstWebRTCSessionDescription *offer = NULL;
+
+  gst_structure_get (gst_promise_get_reply (promise), "offer",
+      GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &offer, NULL);
+  gst_promise_unref (promise);
+
+  g_signal_emit_by_name (sender, "set-local-description", offer, NULL);
+  g_signal_emit_by_name (receiver, "set-remote-description", offer, NULL);
+  gst_webrtc_session_description_free (offer);
+
+  promise = gst_promise_new_with_change_func (on_answer_created_cb, NULL,
+      NULL);
+  g_signal_emit_by_name (receiver, "create-answer", NULL, promise);
+}
+
+static void
+on_negotiation_needed_cb (GstElement * webrtcbin,
+    G_GNUC_UNUSED gpointer user_data)
+{
+  GstPromise *promise;
+
+  promise = gst_promise_new_with_change_func (on_offer_created_cb, NULL,
+      NULL);
+  g_signal_emit_by_name (webrtcbin, "create-offer", NULL, promise);
+}
+
+static void
+on_ice_candidate_cb (G_GNUC_UNUSED GstElement * webrtcbin, guint mline_index,
+    gchar * candidate, gpointer user_data)
+{
+  GstElement *other = (GstElement *) user_data;
+
+  g_signal_emit_by_name (other, "add-ice-candidate", mline_index, candidate);
+}
+
+static gboolean
+bus_watch_cb (G_GNUC_UNUSED GstBus * bus, GstMessage * message,
+    G_GNUC_UNUSED gpointer user_data)
+{
+  if (GST_MESSAGE_TYPE (message) == GST_MESSAGE_ERROR) {
+    GError *error = NULL;
+    gchar *debug = NULL;
+
+    gst_message_parse_error (message, &error, &debug);
+    g_printerr ("Error on bus: %s (debug: %s)\n", error->message, debug);
+    g_error_free (error);
+    g_free (debug);
+    g_main_loop_quit (loop);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static GOptionEntry entries[] = {
+  {"duration", 0, 0, G_OPTION_ARG_INT, &duration,
+      "Seconds to measure for (default: 20)", "S"},
+  {"warmup", 0, 0, G_OPTION_ARG_INT, &warmup,
+      "Seconds to skip after the first frame arrives (default: 3)", "S"},
+  {"width", 0, 0, G_OPTION_ARG_INT, &width, "Frame width (default: 640)",
+      "PIXELS"},
+  {"height", 0, 0, G_OPTION_ARG_INT, &height, "Frame height (default: 360)",
+      "PIXELS"},
+  {"framerate", 0, 0, G_OPTION_ARG_INT, &framerate,
+      "Frames per second (default: 15)", "FPS"},
+  {"encoder", 0, 0, G_OPTION_ARG_STRING, &encoder,
+        "H.264 encoder with its properties (default: x264enc bitrate=600 "
+        "speed-preset=ultrafast tune=zerolatency key-int-max=15)", "ELEMENT"},
+  {"queue-buffers", 0, 0, G_OPTION_ARG_INT, &queue_buffers,
+      "max-size-buffers of the queue in front of the encoder (default: 1)",
+      "N"},
+  {"aggregate-mode", 0, 0, G_OPTION_ARG_STRING, &aggregate_mode,
+        "aggregate-mode of rtph264pay (default: zero-latency)", "MODE"},
+  {"jitterbuffer-latency", 0, 0, G_OPTION_ARG_INT, &jitterbuffer_latency,
+        "Jitterbuffer latency of the receiving webrtcbin in ms (default: 200)",
+      "MS"},
+  {"csv", 0, 0, G_OPTION_ARG_FILENAME, &csv_path,
+      "Also write every frame's latency to this file", "FILE"},
+  {NULL},
+};
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GstElement *capture;
+  GstPad *pad;
+  GstBus *bus;
+  GArray *transceivers;
+  gchar *description;
+
+  setlocale (LC_ALL, "");
+
+  context = g_option_context_new ("- webrtc glass-to-glass latency harness");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("Error initializing: %s\n", error->message);
+    return -1;
+  }
+  g_option_context_free (context);
+
+  if (encoder == NULL)
+    encoder = g_strdup ("x264enc bitrate=600 speed-preset=ultrafast "
+        "tune=zerolatency key-int-max=15");
+  if (aggregate_mode == NULL)
+    aggregate_mode = g_strdup ("zero-latency");
+  if (width < STAMP_BITS * 4 || height < STAMP_HEIGHT || framerate <= 0) {
+    g_printerr ("The frame is too small to carry the stamp\n");
+    return -1;
+  }
+
+  loop = g_main_loop_new (NULL, FALSE);
+  latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  /* Same chain as the sendonly server from capture to webrtcbin */
+  description = g_strdup_printf ("videotestsrc is-live=true pattern=ball ! "
+      "video/x-raw,format=I420,width=%d,height=%d,framerate=%d/1 ! "
+      "identity name=capture ! queue max-size-buffers=%d ! %s ! "
+      "video/x-h264,profile=constrained-baseline ! "
+      "queue max-size-time=100000000 ! h264parse ! "
+      "rtph264pay config-interval=-1 aggregate-mode=%s ! "
+      "application/x-rtp,media=video,encoding-name=H264,payload="
+      RTP_PAYLOAD_TYPE " ! webrtcbin name=sender bundle-policy=max-bundle "
+      "webrtcbin name=receiver bundle-policy=max-bundle latency=%d",
+      width, height, framerate, queue_buffers, encoder, aggregate_mode,
+      jitterbuffer_latency);
+  pipeline = gst_parse_launch (description, &error);
+  g_free (description);
+  if (error != NULL) {
+    g_printerr ("Could not create pipeline: %s\n", error->message);
+    g_error_free (error);
+    return -1;
+  }
+
+  sender = gst_bin_get_by_name (GST_BIN (pipeline), "sender");
+  receiver = gst_bin_get_by_name (GST_BIN (pipeline), "receiver");
+
+  g_signal_emit_by_name (sender, "get-transceivers", &transceivers);
+  g_assert (transceivers != NULL && transceivers->len > 0);
+  g_object_set (g_array_index (transceivers, GstWebRTCRTPTransceiver *, 0),
+      "direction", GST_WEBRTC_RTP_TRANSCEIVER_DIRECTION_SENDONLY, NULL);
+  g_array_unref (transceivers);
+
+  capture = gst_bin_get_by_name (GST_BIN (pipeline), "capture");
+  pad = gst_element_get_static_pad (capture, "src");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, capture_probe_cb, NULL,
+      NULL);
+  gst_object_unref (pad);
+  gst_object_unref (capture);
+
+  g_signal_connect (sender, "on-negotiation-needed",
+      G_CALLBACK (on_negotiation_needed_cb), NULL);
+  g_signal_connect (sender, "on-ice-candidate",
+      G_CALLBACK (on_ice_candidate_cb), receiver);
+  g_signal_connect (receiver, "on-ice-candidate",
+      G_CALLBACK (on_ice_candidate_cb), sender);
+  g_signal_connect (receiver, "pad-added", G_CALLBACK (on_incoming_stream),
+      NULL);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_bus_add_watch (bus, bus_watch_cb, NULL);
+  gst_object_unref (bus);
+
+  if (gst_element_set_state (pipeline, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_FAILURE) {
+    g_printerr ("Could not start the pipeline\n");
+    return -1;
+  }
+
+  g_main_loop_run (loop);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (sender);
+  gst_object_unref (receiver);
+  gst_object_unref (pipeline);
+  g_array_unref (latencies);
+  g_main_loop_unref (loop);
+  g_free (encoder);
+  g_free (aggregate_mode);
+
+  gst_deinit ();
+
+  return 0;
+}
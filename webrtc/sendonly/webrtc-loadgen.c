@@ -0,0 +1,829 @@
+#include <locale.h>
+#include <string.h>
+#include <glib.h>
+#include <gst/gst.h>
+#include <gst/sdp/sdp.h>
+#include <gst/rtp/rtp.h>
+
+#ifdef G_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#define GST_USE_UNSTABLE_API
+#include <gst/webrtc/webrtc.h>
+
+#include <libsoup/soup.h>
+#include <json-glib/json-glib.h>
+
+/* Synthetic viewers for capacity planning of webrtc-unidirectional-h264.
+ * Every viewer is a websocket connection to the server and a receive-only
+ * webrtcbin whose streams end in fakesinks, so nothing is decoded. The
+ * viewers are spread over a few worker threads and added in steps; after
+ * every step the join time, time to first frame, received bitrate and the
+ * CPU time of the server (from its /stats page) and of this process are
+ * printed. */
+
+static gchar *server = NULL;
+static gint max_viewers = 50;
+static gint step = 10;
+static gint step_interval = 10;
+static gint n_workers = 4;
+static gboolean csv = FALSE;
+
+typedef struct
+{
+  GThread *thread;
+  GMainContext *context;
+  GMainLoop *loop;
+  SoupSession *session;
+} Worker;
+
+typedef struct
+{
+  guint id;
+  Worker *worker;
+
+  /* Worker context only */
+  SoupWebsocketConnection *connection;
+  GstElement *pipeline;
+  GstElement *webrtcbin;
+
+  /* Protected by stats_lock, times in us */
+  gint64 start_time;
+  gint64 join_time;
+  gint64 first_frame_time;
+  guint64 bytes;
+  guint64 reported_bytes;
+  gboolean failed;
+} Viewer;
+
+typedef struct
+{
+  Viewer *viewer;
+  gchar *text;
+} ViewerSend;
+
+static GMainLoop *loop;
+static Worker *workers;
+static GPtrArray *viewers;
+static GMutex stats_lock;
+static SoupSession *stats_session;
+
+static gint64 last_report_time;
+static gdouble last_server_cpu = -1;
+static gdouble last_local_cpu = -1;
+
+static gdouble
+get_cpu_time (void)
+{
+#ifdef G_OS_UNIX
+  struct rusage usage;
+
+  if (getrusage (RUSAGE_SELF, &usage) == 0)
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+        + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+
+  return -1;
+}
+
+static gchar *
+get_string_from_json_object (JsonObject * object)
+{
+  JsonNode *root;
+  JsonGenerator *generator;
+  gchar *text;
+
+  root = json_node_init_object (json_node_alloc (), object);
+  generator = json_generator_new ();
+  json_generator_set_root (generator, root);
+  text = json_generator_to_data (generator, NULL);
+
+  g_object_unref (generator);
+  json_node_free (root);
+  return text;
+}
+
+static gboolean
+viewer_send_cb (gpointer user_data)
+{
+  ViewerSend *send = (ViewerSend *) user_data;
+  SoupWebsocketConnection *connection = send->viewer->connection;
+
+  if (connection != NULL && soup_websocket_connection_get_state (connection)
+      == SOUP_WEBSOCKET_STATE_OPEN)
+    soup_websocket_connection_send_text (connection, send->text);
+
+  g_free (send->text);
+  g_slice_free (ViewerSend, send);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* webrtcbin calls back from its own threads, the websocket belongs to the
+ * worker. Takes ownership of @text */
+static void
+viewer_send (Viewer * viewer, gchar * text)
+{
+  ViewerSend *send = g_slice_new (ViewerSend);
+
+  send->viewer = viewer;
+  send->text = text;
+  g_main_context_invoke (viewer->worker->context, viewer_send_cb, send);
+}
+
+static void
+viewer_fail (Viewer * viewer, const gchar * reason)
+{
+  g_mutex_lock (&stats_lock);
+  if (!viewer->failed)
+    g_printerr ("Viewer %u failed: %s\n", viewer->id, reason);
+  viewer->failed = TRUE;
+  g_mutex_unlock (&stats_lock);
+}
+
+static GstPadProbeReturn
+rtp_probe_cb (G_GNUC_UNUSED GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  Viewer *viewer = (Viewer *) user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+
+  g_mutex_lock (&stats_lock);
+  viewer->bytes += gst_buffer_get_size (buffer);
+  g_mutex_unlock (&stats_lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* The marker bit ends a video frame, so the first one is the first frame a
+ * browser could show */
+static GstPadProbeReturn
+video_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  Viewer *viewer = (Viewer *) user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  gboolean marker;
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp))
+    return GST_PAD_PROBE_OK;
+  marker = gst_rtp_buffer_get_marker (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  if (!marker)
+    return GST_PAD_PROBE_OK;
+
+  g_mutex_lock (&stats_lock);
+  viewer->first_frame_time = g_get_monotonic_time ();
+  g_mutex_unlock (&stats_lock);
+
+  gst_pad_remove_probe (pad, info->id);
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+on_pad_added_cb (G_GNUC_UNUSED GstElement * webrtcbin, GstPad * pad,
+    gpointer user_data)
+{
+  Viewer *viewer = (Viewer *) user_data;
+  GstElement *sink;
+  GstPad *sinkpad;
+  GstCaps *caps;
+  const gchar *media = NULL;
+
+  if (GST_PAD_DIRECTION (pad) != GST_PAD_SRC)
+    return;
+
+  caps = gst_pad_get_current_caps (pad);
+  if (caps == NULL)
+    caps = gst_pad_query_caps (pad, NULL);
+  if (!gst_caps_is_empty (caps))
+    media = gst_structure_get_string (gst_caps_get_structure (caps, 0),
+        "media");
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, rtp_probe_cb, viewer,
+      NULL);
+  if (g_strcmp0 (media, "video") == 0)
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, video_probe_cb, viewer,
+        NULL);
+  gst_caps_unref (caps);
+
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (sink, "async", FALSE, "sync", FALSE, NULL);
+  gst_bin_add (GST_BIN (viewer->pipeline), sink);
+  gst_element_sync_state_with_parent (sink);
+
+  sinkpad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_link (pad, sinkpad);
+  gst_object_unref (sinkpad);
+}
+
+static void
+on_ice_connection_state_notify (GstElement * webrtcbin,
+    G_GNUC_UNUSED GParamSpec * pspec, gpointer user_data)
+{
+  Viewer *viewer = (Viewer *) user_data;
+  GstWebRTCICEConnectionState state;
+
+  g_object_get (webrtcbin, "ice-connection-state", &state, NULL);
+  if (state == GST_WEBRTC_ICE_CONNECTION_STATE_FAILED) {
+    viewer_fail (viewer, "ICE failed");
+  } else if (state == GST_WEBRTC_ICE_CONNECTION_STATE_CONNECTED
+      || state == GST_WEBRTC_ICE_CONNECTION_STATE_COMPLETED) {
+    g_mutex_lock (&stats_lock);
+    if (viewer->join_time == 0)
+      viewer->join_time = g_get_monotonic_time ();
+    g_mutex_unlock (&stats_lock);
+  }
+}
+
+static void
+on_ice_candidate_cb (G_GNUC_UNUSED GstElement * webrtcbin, guint mline_index,
+    gchar * candidate, gpointer user_data)
+{
+  JsonObject *ice_json, *ice_data_json;
+
+  ice_json = json_object_new ();
+  json_object_set_string_member (ice_json, "type", "ice");
+  ice_data_json = json_object_new ();
+  json_object_set_int_member (ice_data_json, "sdpMLineIndex", mline_index);
+  json_object_set_string_member (ice_data_json, "candidate", candidate);
+  json_object_set_object_member (ice_json, "data", ice_data_json);
+
+  viewer_send ((Viewer *) user_data, get_string_from_json_object (ice_json));
+  json_object_unref (ice_json);
+}
+
+static void
+on_answer_created_cb (GstPromise * promise, gpointer user_data)
+{
+  Viewer *viewer = (Viewer *) user_data;
+  GstWebRTCSessionDescription *answer = NULL;
+  JsonObject *sdp_json, *sdp_data_json;
+  gchar *sdp_string;
+
+  if (gst_promise_wait (promise) == GST_PROMISE_RESULT_REPLIED)
+    gst_structure_get (gst_promise_get_reply (promise), "answer",
+        GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &answer, NULL);
+  gst_promise_unref (promise);
+  if (answer == NULL) {
+    viewer_fail (viewer, "could not create an answer");
+    return;
+  }
+
+  g_signal_emit_by_name (viewer->webrtcbin, "set-local-description", answer,
+      NULL);
+
+  sdp_string = gst_sdp_message_as_text (answer->sdp);
+  sdp_json = json_object_new ();
+  json_object_set_string_member (sdp_json, "type", "sdp");
+  sdp_data_json = json_object_new ();
+  json_object_set_string_member (sdp_data_json, "type", "answer");
+  json_object_set_string_member (sdp_data_json, "sdp", sdp_string);
+  json_object_set_object_member (sdp_json, "data", sdp_data_json);
+
+  viewer_send (viewer, get_string_from_json_object (sdp_json));
+  json_object_unref (sdp_json);
+  g_free (sdp_string);
+  gst_webrtc_session_description_free (answer);
+}
+
+static void
+on_remote_description_set_cb (GstPromise * promise, gpointer user_data)
+{
+  Viewer *viewer = (Viewer *) user_data;
+
+  gst_promise_unref (promise);
+  promise = gst_promise_new_with_change_func (on_answer_created_cb, viewer,
+      NULL);
+  g_signal_emit_by_name (viewer->webrtcbin, "create-answer", NULL, promise);
+}
+
+static void
+handle_offer (Viewer * viewer, const gchar * text)
+{
+  GstWebRTCSessionDescription *offer;
+  GstSDPMessage *sdp;
+  GstPromise *promise;
+
+  gst_sdp_message_new (&sdp);
+  if (gst_sdp_message_parse_buffer ((guint8 *) text, strlen (text), sdp)
+      != GST_SDP_OK) {
+    gst_sdp_message_free (sdp);
+    viewer_fail (viewer, "could not parse the offer");
+    return;
+  }
+
+  offer = gst_webrtc_session_description_new (GST_WEBRTC_SDP_TYPE_OFFER, sdp);
+  promise = gst_promise_new_with_change_func (on_remote_description_set_cb,
+      viewer, NULL);
+  g_signal_emit_by_name (viewer->webrtcbin, "set-remote-description", offer,
+      promise);
+  gst_webrtc_session_description_free (offer);
+}
+
+static void
+add_ice_candidate (Viewer * viewer, JsonObject * candidate_json)
+{
+  if (!json_object_has_member (candidate_json, "candidate")
+      || !json_object_has_member (candidate_json, "sdpMLineIndex"))
+    return;
+
+  g_signal_emit_by_name (viewer->webrtcbin, "add-ice-candidate",
+      (guint) json_object_get_int_member (candidate_json, "sdpMLineIndex"),
+      json_object_get_string_member (candidate_json, "candidate"));
+}
+
+static void
+on_message_cb (G_GNUC_UNUSED SoupWebsocketConnection * connection,
+    SoupWebsocketDataType data_type, GBytes * message, gpointer user_data)
+{
+  Viewer *viewer = (Viewer *) user_data;
+  JsonParser *parser;
+  JsonNode *root;
+  JsonObject *object, *data;
+  const gchar *type;
+  gsize size;
+  const gchar *text;
+
+  if (data_type != SOUP_WEBSOCKET_DATA_TEXT)
+    return;
+
+  text = g_bytes_get_data (message, &size);
+  parser = json_parser_new ();
+  if (!json_parser_load_from_data (parser, text, size, NULL))
+    goto out;
+  root = json_parser_get_root (parser);
+  if (!JSON_NODE_HOLDS_OBJECT (root))
+    goto out;
+
+  object = json_node_get_object (root);
+  type = json_object_get_string_member (object, "type");
+  if (!json_object_has_member (object, "data"))
+    goto out;
+  data = json_object_get_object_member (object, "data");
+
+  if (g_strcmp0 (type, "sdp") == 0) {
+    if (g_strcmp0 (json_object_get_string_member (data, "type"),
+            "offer") == 0)
+      handle_offer (viewer, json_object_get_string_member (data, "sdp"));
+  } else if (g_strcmp0 (type, "ice") == 0) {
+    add_ice_candidate (viewer, data);
+  } else if (g_strcmp0 (type, "ice-batch") == 0) {
+    JsonArray *candidates = json_object_get_array_member (data,
+        "candidates");
+    guint i;
+
+    for (i = 0; candidates != NULL && i < json_array_get_length (candidates);
+        i++)
+      add_ice_candidate (viewer, json_array_get_object_element (candidates,
+              i));
+  }
+
+out:
+  g_object_unref (parser);
+}
+
+static void
+on_closed_cb (G_GNUC_UNUSED SoupWebsocketConnection * connection,
+    gpointer user_data)
+{
+  viewer_fail ((Viewer *) user_data, "server closed the connection");
+}
+
+static void
+on_connected_cb (SoupSession * session, GAsyncResult * result,
+    gpointer user_data)
+{
+  Viewer *viewer = (Viewer *) user_data;
+  GError *error = NULL;
+
+  viewer->connection = soup_session_websocket_connect_finish (session, result,
+      &error);
+  if (error != NULL) {
+    viewer_fail (viewer, error->message);
+    g_error_free (error);
+    return;
+  }
+
+  g_signal_connect (viewer->connection, "message", G_CALLBACK (on_message_cb),
+      viewer);
+  g_signal_connect (viewer->connection, "closed", G_CALLBACK (on_closed_cb),
+      viewer);
+}
+
+static gboolean
+viewer_start_cb (gpointer user_data)
+{
+  Viewer *viewer = (Viewer *) user_data;
+  SoupMessage *message;
+  gchar *url;
+
+  viewer->pipeline = gst_pipeline_new (NULL);
+  viewer->webrtcbin = gst_element_factory_make ("webrtcbin", NULL);
+  g_object_set (viewer->webrtcbin, "bundle-policy",
+      GST_WEBRTC_BUNDLE_POLICY_MAX_BUNDLE, NULL);
+  gst_bin_add (GST_BIN (viewer->pipeline), viewer->webrtcbin);
+
+  g_signal_connect (viewer->webrtcbin, "pad-added",
+      G_CALLBACK (on_pad_added_cb), viewer);
+  g_signal_connect (viewer->webrtcbin, "on-ice-candidate",
+      G_CALLBACK (on_ice_candidate_cb), viewer);
+  g_signal_connect (viewer->webrtcbin, "notify::ice-connection-state",
+      G_CALLBACK (on_ice_connection_state_notify), viewer);
+  gst_element_set_state (viewer->pipeline, GST_STATE_PLAYING);
+
+  url = g_strdup_printf ("ws://%s/ws", server);
+  message = soup_message_new (SOUP_METHOD_GET, url);
+  g_free (url);
+
+  g_mutex_lock (&stats_lock);
+  viewer->start_time = g_get_monotonic_time ();
+  g_mutex_unlock (&stats_lock);
+
+  soup_session_websocket_connect_async (viewer->worker->session, message,
+      NULL, NULL, NULL, (GAsyncReadyCallback) on_connected_cb, viewer);
+  g_object_unref (message);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+viewer_stop_cb (gpointer user_data)
+{
+  Viewer *viewer = (Viewer *) user_data;
+
+  if (viewer->connection != NULL) {
+    g_signal_handlers_disconnect_by_data (viewer->connection, viewer);
+    if (soup_websocket_connection_get_state (viewer->connection) ==
+        SOUP_WEBSOCKET_STATE_OPEN)
+      soup_websocket_connection_close (viewer->connection,
+          SOUP_WEBSOCKET_CLOSE_NORMAL, NULL);
+    g_clear_object (&viewer->connection);
+  }
+
+  gst_element_set_state (viewer->pipeline, GST_STATE_NULL);
+  gst_clear_object (&viewer->pipeline);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+add_viewers (gint count)
+{
+  gint i;
+
+  for (i = 0; i < count; i++) {
+    Viewer *viewer = g_slice_new0 (Viewer);
+
+    viewer->id = viewers->len + 1;
+    viewer->worker = &workers[viewers->len % n_workers];
+    g_ptr_array_add (viewers, viewer);
+    g_main_context_invoke (viewer->worker->context, viewer_start_cb, viewer);
+  }
+}
+
+static gpointer
+worker_thread (gpointer user_data)
+{
+  Worker *worker = (Worker *) user_data;
+
+  g_main_context_push_thread_default (worker->context);
+  /* Picks up the thread default context for its callbacks */
+  worker->session = soup_session_new ();
+  g_main_loop_run (worker->loop);
+  g_clear_object (&worker->session);
+  g_main_context_pop_thread_default (worker->context);
+
+  return NULL;
+}
+
+static gboolean
+worker_quit_cb (gpointer user_data)
+{
+  g_main_loop_quit ((GMainLoop *) user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+workers_init (void)
+{
+  gint i;
+
+  workers = g_new0 (Worker, n_workers);
+  for (i = 0; i < n_workers; i++) {
+    Worker *worker = &workers[i];
+    gchar *name = g_strdup_printf ("loadgen-worker-%d", i);
+
+    worker->context = g_main_context_new ();
+    worker->loop = g_main_loop_new (worker->context, FALSE);
+    worker->thread = g_thread_new (name, worker_thread, worker);
+    g_free (name);
+  }
+}
+
+/* Stops the viewers first, they are queued on the workers ahead of the quit */
+static void
+workers_deinit (void)
+{
+  guint i;
+
+  for (i = 0; i < viewers->len; i++) {
+    Viewer *viewer = g_ptr_array_index (viewers, i);
+
+    g_main_context_invoke (viewer->worker->context, viewer_stop_cb, viewer);
+  }
+
+  for (i = 0; i < (guint) n_workers; i++) {
+    Worker *worker = &workers[i];
+
+    g_main_context_invoke (worker->context, worker_quit_cb, worker->loop);
+    g_thread_join (worker->thread);
+    g_main_loop_unref (worker->loop);
+    g_main_context_unref (worker->context);
+  }
+  g_clear_pointer (&workers, g_free);
+}
+
+/* The "totals" of the server's /stats page, NULL if unavailable */
+static JsonObject *
+get_server_totals (void)
+{
+  SoupMessage *message;
+  JsonParser *parser;
+  JsonNode *root;
+  JsonObject *totals = NULL;
+  gchar *url;
+
+  url = g_strdup_printf ("http://%s/stats", server);
+  message = soup_message_new (SOUP_METHOD_GET, url);
+  g_free (url);
+  if (message == NULL)
+    return NULL;
+
+  if (soup_session_send_message (stats_session, message) == SOUP_STATUS_OK) {
+    parser = json_parser_new ();
+    if (json_parser_load_from_data (parser, message->response_body->data,
+            message->response_body->length, NULL)) {
+      root = json_parser_get_root (parser);
+      if (JSON_NODE_HOLDS_OBJECT (root)
+          && json_object_has_member (json_node_get_object (root), "totals"))
+        totals =
+            json_object_ref (json_object_get_object_member (json_node_get_object
+                (root), "totals"));
+    }
+    g_object_unref (parser);
+  }
+  g_object_unref (message);
+
+  return totals;
+}
+
+/* Returns the CPU seconds the server has used so far and fills in its open
+ * sockets and resident memory. Each is -1 if the server doesn't report it */
+static gdouble
+get_server_usage (gint64 * sockets, gint64 * rss_kb)
+{
+  JsonObject *totals = get_server_totals ();
+  gdouble cpu = -1;
+
+  *sockets = *rss_kb = -1;
+  if (totals == NULL)
+    return -1;
+  if (json_object_has_member (totals, "cpu-seconds"))
+    cpu = json_object_get_double_member (totals, "cpu-seconds");
+  if (json_object_has_member (totals, "sockets"))
+    *sockets = json_object_get_int_member (totals, "sockets");
+  if (json_object_has_member (totals, "rss-kb"))
+    *rss_kb = json_object_get_int_member (totals, "rss-kb");
+  json_object_unref (totals);
+
+  return cpu;
+}
+
+/* Runs with different server options are only comparable when it is
+ * clear which is which */
+static void
+print_server_setup (void)
+{
+  JsonObject *totals = get_server_totals ();
+
+  if (totals == NULL) {
+    g_printerr ("Could not get http://%s/stats\n", server);
+    return;
+  }
+
+  gst_print ("%sserver %s: video encoder %s, audio %s\n", csv ? "# " : "",
+      server, json_object_has_member (totals, "encoder") ?
+      json_object_get_string_member (totals, "encoder") : "unknown",
+      json_object_has_member (totals, "audio") ?
+      json_object_get_string_member (totals, "audio") : "unknown");
+  /* Join times with and without --dtls-pool show what it saves */
+  if (json_object_has_member (totals, "dtls")) {
+    JsonObject *dtls = json_object_get_object_member (totals, "dtls");
+
+    gst_print ("%sserver shares %" G_GINT64_FORMAT " DTLS certificates\n",
+        csv ? "# " : "", json_object_get_int_member (dtls, "certificates"));
+  } else
+    gst_print ("%sserver generates DTLS certificates per session\n",
+        csv ? "# " : "");
+  json_object_unref (totals);
+}
+
+static gint
+compare_doubles (gconstpointer a, gconstpointer b)
+{
+  gdouble x = *(const gdouble *) a, y = *(const gdouble *) b;
+
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/* Sorts @values */
+static gdouble
+percentile (GArray * values, gdouble p)
+{
+  if (values->len == 0)
+    return 0;
+
+  g_array_sort (values, compare_doubles);
+  return g_array_index (values, gdouble, (guint) (p * (values->len - 1)));
+}
+
+static gchar *
+format_cpu (gdouble cpu, gdouble last_cpu, gdouble elapsed)
+{
+  if (cpu < 0 || last_cpu < 0)
+    return g_strdup (csv ? "" : "n/a");
+
+  return g_strdup_printf ("%.1f", (cpu - last_cpu) / elapsed * 100);
+}
+
+static gchar *
+format_count (gint64 value)
+{
+  if (value < 0)
+    return g_strdup (csv ? "" : "n/a");
+
+  return g_strdup_printf ("%" G_GINT64_FORMAT, value);
+}
+
+static void
+report (void)
+{
+  GArray *joins = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  GArray *ttffs = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  gint64 now = g_get_monotonic_time ();
+  gdouble elapsed = (now - last_report_time) / (gdouble) G_USEC_PER_SEC;
+  gdouble server_cpu, local_cpu = get_cpu_time ();
+  gint64 sockets, rss_kb;
+  gchar *server_usage, *local_usage, *server_sockets, *server_memory;
+  guint64 bytes = 0;
+  guint i, failed = 0, streaming = 0;
+
+  server_cpu = get_server_usage (&sockets, &rss_kb);
+
+  g_mutex_lock (&stats_lock);
+  for (i = 0; i < viewers->len; i++) {
+    Viewer *viewer = g_ptr_array_index (viewers, i);
+    gdouble value;
+
+    if (viewer->failed)
+      failed++;
+    if (viewer->join_time != 0) {
+      value = (viewer->join_time - viewer->start_time) / 1000.0;
+      g_array_append_val (joins, value);
+    }
+    if (viewer->first_frame_time != 0) {
+      value = (viewer->first_frame_time - viewer->start_time) / 1000.0;
+      g_array_append_val (ttffs, value);
+    }
+    if (viewer->bytes > viewer->reported_bytes)
+      streaming++;
+    bytes += viewer->bytes - viewer->reported_bytes;
+    viewer->reported_bytes = viewer->bytes;
+  }
+  g_mutex_unlock (&stats_lock);
+
+  server_usage = format_cpu (server_cpu, last_server_cpu, elapsed);
+  local_usage = format_cpu (local_cpu, last_local_cpu, elapsed);
+  server_sockets = format_count (sockets);
+  server_memory = format_count (rss_kb >= 0 ? rss_kb / 1024 : -1);
+
+  gst_print (csv ? "%u,%u,%u,%u,%.0f,%.0f,%.0f,%.0f,%.2f,%.0f,%s,%s,%s,%s\n" :
+      "%7u %7u %9u %6u %8.0f %8.0f %8.0f %8.0f %9.2f %9.0f %7s %7s %7s %7s\n",
+      viewers->len, joins->len, streaming, failed, percentile (joins, 0.5),
+      percentile (joins, 0.95), percentile (ttffs, 0.5),
+      percentile (ttffs, 0.95), bytes * 8 / elapsed / 1000000,
+      streaming > 0 ? bytes * 8 / elapsed / 1000 / streaming : 0,
+      server_usage, local_usage, server_sockets, server_memory);
+
+  g_free (server_usage);
+  g_free (local_usage);
+  g_free (server_sockets);
+  g_free (server_memory);
+  g_array_unref (joins);
+  g_array_unref (ttffs);
+
+  last_report_time = now;
+  last_server_cpu = server_cpu;
+  last_local_cpu = local_cpu;
+}
+
+static gboolean
+step_timeout_cb (G_GNUC_UNUSED gpointer user_data)
+{
+  report ();
+
+  if ((gint) viewers->len >= max_viewers) {
+    g_main_loop_quit (loop);
+    return G_SOURCE_REMOVE;
+  }
+
+  add_viewers (MIN (step, max_viewers - (gint) viewers->len));
+  return G_SOURCE_CONTINUE;
+}
+
+static GOptionEntry entries[] = {
+  {"server", 0, 0, G_OPTION_ARG_STRING, &server,
+      "Host and port of the server (default: 127.0.0.1:57778)", "HOST:PORT"},
+  {"viewers", 0, 0, G_OPTION_ARG_INT, &max_viewers,
+      "Number of viewers to ramp up to (default: 50)", "N"},
+  {"step", 0, 0, G_OPTION_ARG_INT, &step,
+      "Viewers added at once (default: 10)", "N"},
+  {"step-interval", 0, 0, G_OPTION_ARG_INT, &step_interval,
+      "Seconds between steps, every step is reported (default: 10)", "S"},
+  {"workers", 0, 0, G_OPTION_ARG_INT, &n_workers,
+      "Threads the viewers are spread over (default: 4)", "N"},
+  {"csv", 0, 0, G_OPTION_ARG_NONE, &csv, "Print the report as CSV", NULL},
+  {NULL},
+};
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  gint64 sockets, rss_kb;
+  guint i;
+
+  setlocale (LC_ALL, "");
+
+  context = g_option_context_new ("- synthetic viewers for the sendonly "
+      "server");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("Error initializing: %s\n", error->message);
+    return -1;
+  }
+  g_option_context_free (context);
+
+  if (max_viewers <= 0 || step <= 0 || step_interval <= 0 || n_workers <= 0) {
+    g_printerr ("Counts and intervals must be positive\n");
+    return -1;
+  }
+  if (server == NULL)
+    server = g_strdup ("127.0.0.1:57778");
+
+  loop = g_main_loop_new (NULL, FALSE);
+  viewers = g_ptr_array_new ();
+  stats_session = soup_session_new_with_options (SOUP_SESSION_TIMEOUT, 5,
+      NULL);
+  workers_init ();
+
+  print_server_setup ();
+  if (csv)
+    gst_print ("viewers,joined,streaming,failed,join-p50-ms,join-p95-ms,"
+        "ttff-p50-ms,ttff-p95-ms,total-mbps,viewer-kbps,server-cpu,"
+        "loadgen-cpu,server-sockets,server-rss-mb\n");
+  else
+    gst_print ("%7s %7s %9s %6s %8s %8s %8s %8s %9s %9s %7s %7s %7s %7s\n",
+        "viewers", "joined", "streaming", "failed", "join-p50", "join-p95",
+        "ttff-p50", "ttff-p95", "total-Mbps", "kbps-each", "server%",
+        "loadgen%", "sockets", "rss-MB");
+
+  last_report_time = g_get_monotonic_time ();
+  last_server_cpu = get_server_usage (&sockets, &rss_kb);
+  last_local_cpu = get_cpu_time ();
+  if (last_server_cpu < 0)
+    g_printerr ("No CPU time on http://%s/stats, server load is not "
+        "reported\n", server);
+
+  add_viewers (MIN (step, max_viewers));
+  g_timeout_add_seconds (step_interval, step_timeout_cb, NULL);
+  g_main_loop_run (loop);
+
+  workers_deinit ();
+  for (i = 0; i < viewers->len; i++)
+    g_slice_free (Viewer, g_ptr_array_index (viewers, i));
+  g_ptr_array_unref (viewers);
+  g_object_unref (stats_session);
+  g_main_loop_unref (loop);
+  g_free (server);
+
+  gst_deinit ();
+
+  return 0;
+}
@@ -14,6 +14,10 @@
 #include <json-glib/json-glib.h>
 #include <string.h>
 
+#include "example-assets.h"
+#include "example-log.h"
+#include "example-tracer.h"
+
 /* This example is a standalone app which serves a web page
  * and configures webrtcbin to receive an H.264 video feed, and to
  * send+recv an Opus audio stream */
@@ -425,7 +429,8 @@ on_offer_created_cb (GstPromise * promise, gpointer user_data)
   gst_promise_unref (local_desc_promise);
 
   sdp_string = gst_sdp_message_as_text (offer->sdp);
-  gst_print ("Negotiation offer created:\n%s\n", sdp_string);
+  EXAMPLE_LOG_DEBUG ("offer-created", "Negotiation offer created:\n%s",
+      sdp_string);
 
   sdp_json = json_object_new ();
   json_object_set_string_member (sdp_json, "type", "sdp");
@@ -452,7 +457,7 @@ on_negotiation_needed_cb (GstElement * webrtcbin, gpointer user_data)
   GstPromise *promise;
   ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
 
-  gst_print ("Creating negotiation offer\n");
+  EXAMPLE_LOG_DEBUG ("negotiation-needed", "Creating negotiation offer");
 
   promise = gst_promise_new_with_change_func (on_offer_created_cb,
       (gpointer) receiver_entry, NULL);
@@ -564,7 +569,7 @@ soup_websocket_message_cb (G_GNUC_UNUSED SoupWebsocketConnection * connection,
     }
     sdp_string = json_object_get_string_member (data_json_object, "sdp");
 
-    gst_print ("Received SDP:\n%s\n", sdp_string);
+    EXAMPLE_LOG_DEBUG ("sdp-received", "Received SDP:\n%s", sdp_string);
 
     ret = gst_sdp_message_new (&sdp);
     g_assert_cmphex (ret, ==, GST_SDP_OK);
@@ -605,7 +610,8 @@ soup_websocket_message_cb (G_GNUC_UNUSED SoupWebsocketConnection * connection,
     candidate_string = json_object_get_string_member (data_json_object,
         "candidate");
 
-    gst_print ("Received ICE candidate with mline index %u; candidate: %s\n",
+    EXAMPLE_LOG_DEBUG ("ice-received",
+        "Received ICE candidate with mline index %u; candidate: %s",
         mline_index, candidate_string);
 
     g_signal_emit_by_name (receiver_entry->webrtcbin, "add-ice-candidate",
@@ -631,32 +637,20 @@ soup_websocket_closed_cb (SoupWebsocketConnection * connection,
 {
   GHashTable *receiver_entry_table = (GHashTable *) user_data;
   g_hash_table_remove (receiver_entry_table, connection);
-  gst_print ("Closed websocket connection %p\n", (gpointer) connection);
+  EXAMPLE_LOG_RATELIMITED (50, EXAMPLE_LOG_LEVEL_INFO, "websocket-closed",
+      "Closed websocket connection %p", (gpointer) connection);
 }
 
 
 void
 soup_http_handler (G_GNUC_UNUSED SoupServer * soup_server,
     SoupMessage * message, const char *path, G_GNUC_UNUSED GHashTable * query,
-    G_GNUC_UNUSED SoupClientContext * client_context,
-    G_GNUC_UNUSED gpointer user_data)
+    G_GNUC_UNUSED SoupClientContext * client_context, gpointer user_data)
 {
-  SoupBuffer *soup_buffer;
+  ExampleAssets *assets = (ExampleAssets *) user_data;
 
-  if ((g_strcmp0 (path, "/") != 0) && (g_strcmp0 (path, "/index.html") != 0)) {
+  if (!example_assets_serve (assets, message, path))
     soup_message_set_status (message, SOUP_STATUS_NOT_FOUND);
-    return;
-  }
-
-  soup_buffer =
-      soup_buffer_new (SOUP_MEMORY_STATIC, html_source, strlen (html_source));
-
-  soup_message_headers_set_content_type (message->response_headers, "text/html",
-      NULL);
-  soup_message_body_append_buffer (message->response_body, soup_buffer);
-  soup_buffer_free (soup_buffer);
-
-  soup_message_set_status (message, SOUP_STATUS_OK);
 }
 
 
@@ -668,7 +662,8 @@ soup_websocket_handler (G_GNUC_UNUSED SoupServer * server,
   ReceiverEntry *receiver_entry;
   GHashTable *receiver_entry_table = (GHashTable *) user_data;
 
-  gst_print ("Processing new websocket connection %p", (gpointer) connection);
+  EXAMPLE_LOG_RATELIMITED (50, EXAMPLE_LOG_LEVEL_INFO, "websocket-new",
+      "Processing new websocket connection %p", (gpointer) connection);
 
   g_signal_connect (G_OBJECT (connection), "closed",
       G_CALLBACK (soup_websocket_closed_cb), (gpointer) receiver_entry_table);
@@ -713,10 +708,23 @@ main (int argc, char *argv[])
 {
   GMainLoop *mainloop;
   SoupServer *soup_server;
+  ExampleAssets *assets;
   GHashTable *receiver_entry_table;
+  GOptionContext *context;
+  GError *error = NULL;
 
   setlocale (LC_ALL, "");
-  gst_init (&argc, &argv);
+
+  context = g_option_context_new ("- gstreamer webrtc recvonly demo");
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  g_option_context_add_group (context, example_tracer_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("Error initializing: %s\n", error->message);
+    return -1;
+  }
+
+  example_log_init ();
+  example_tracer_init ();
 
   receiver_entry_table =
       g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
@@ -730,9 +738,13 @@ main (int argc, char *argv[])
   g_unix_signal_add (SIGTERM, exit_sighandler, mainloop);
 #endif
 
+  assets = example_assets_new (NULL);
+  example_assets_add_embedded (assets, "/index.html", "text/html", html_source);
+  example_assets_add_alias (assets, "/", "/index.html");
+
   soup_server =
       soup_server_new (SOUP_SERVER_SERVER_HEADER, "webrtc-soup-server", NULL);
-  soup_server_add_handler (soup_server, "/", soup_http_handler, NULL, NULL);
+  soup_server_add_handler (soup_server, "/", soup_http_handler, assets, NULL);
   soup_server_add_websocket_handler (soup_server, "/ws", NULL, NULL,
       soup_websocket_handler, (gpointer) receiver_entry_table, NULL);
   soup_server_listen_all (soup_server, SOUP_HTTP_PORT,
@@ -743,9 +755,12 @@ main (int argc, char *argv[])
   g_main_loop_run (mainloop);
 
   g_object_unref (G_OBJECT (soup_server));
+  example_assets_free (assets);
   g_hash_table_destroy (receiver_entry_table);
   g_main_loop_unref (mainloop);
 
+  example_tracer_deinit ();
+  example_log_deinit ();
   gst_deinit ();
 
   return 0;
@@ -14,19 +14,33 @@
 #include <json-glib/json-glib.h>
 #include <string.h>
 
+#include "example-assets.h"
+#include "example-datachannel.h"
+#include "example-log.h"
+#include "example-tracer.h"
+
 #define RTP_PAYLOAD_TYPE "96"
 #define RTP_AUDIO_PAYLOAD_TYPE "97"
 #define SOUP_HTTP_PORT 57778
 #define STUN_SERVER "stun.l.google.com:19302"
+#define PAGE_NAME "/webrtc-unidirectional-h264-datachannel.html"
+
+#define TELEMETRY_INTERVAL 10   /* ms */
+#define TELEMETRY_HEADER_SIZE 16        /* sequence number and send time */
+#define CHANNEL_STATS_INTERVAL 5
 
 #ifdef G_OS_WIN32
 #define VIDEO_SRC "mfvideosrc"
 #else
-#define VIDEO_SRC "videotestsrc"
+#define VIDEO_SRC "videotestsrc is-live=true"
 #endif
 
 gchar *video_priority = NULL;
 gchar *audio_priority = NULL;
+gchar *assets_dir = NULL;
+gint telemetry_rate = 0;
+gint telemetry_size = 256;
+gint channel_queue_kb = 4096;
 
 
 typedef struct _ReceiverEntry ReceiverEntry;
@@ -61,12 +75,26 @@ struct _ReceiverEntry
 {
   SoupWebsocketConnection *connection;
 
-  GstElement *pipeline;
+  GstElement *bin;
   GstElement *webrtcbin;
   int making_offer;
   int polite;
+
+  GstPad *video_tee_pad;
+  GstPad *audio_tee_pad;
+  gint pending_unlinks;
+
+  /* Set from a webrtcbin thread once the page opens its channel */
+  GstWebRTCDataChannel *data_channel;
+  ExampleChannelSender *channel_sender;
 };
 
+/* Capture, encoding and payloading happens once in this pipeline, every
+ * viewer only adds a bin with a queue per stream and its own webrtcbin */
+static GstElement *pipeline = NULL;
+static GstElement *video_tee = NULL;
+static GstElement *audio_tee = NULL;
+
 const gchar *html_source = " \n \
 <html> \n \
   <head> \n \
@@ -146,6 +174,8 @@ const gchar *html_source = " \n \
       }\n\
  \n \
       function handleReceiveMessage(event) {\n\
+          if (typeof event.data !== 'string')\n\
+            return; // binary telemetry\n\
           console.log('handleReceiveMessage() :', event.data);\n\
       }\n\
       function handleOnDataChannel(){\n\
@@ -306,27 +336,37 @@ void data_channel_on_error_cb(GstWebRTCDataChannel * self,
     GError * error,
     gpointer user_data) {
 
-  gst_print("data_channel_on_error_cb()\n");
+  EXAMPLE_LOG_DEBUG ("trace", "data_channel_on_error_cb()");
 
 }
 
 void data_channel_on_open_cb(GstWebRTCDataChannel * self,
     gpointer user_data) {
-    gst_print("data_channel_on_open_cb()\n");
+    EXAMPLE_LOG_DEBUG ("trace", "data_channel_on_open_cb()");
 
 }
 
 void data_channel_on_close_cb(GstWebRTCDataChannel * self,
     gpointer user_data) {
-  gst_print("data_channel_on_close_cb()\n");
+  EXAMPLE_LOG_DEBUG ("trace", "data_channel_on_close_cb()");
 
 }
 
 void data_channel_on_message_string_cb (GstWebRTCDataChannel * self,
                             gchar * data,
                             gpointer user_data) {
-  gst_print("data_channel_on_message_string_cb() : %s\n", data);
-  gst_webrtc_data_channel_send_string(self, "YadaYada!");
+  ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
+  ExampleChannelSender *sender;
+
+  EXAMPLE_LOG_DEBUG ("datachannel-message",
+      "data_channel_on_message_string_cb() : %s", data);
+
+  /* Replies share the flow control of the telemetry on the same channel */
+  sender = g_atomic_pointer_get (&receiver_entry->channel_sender);
+  if (sender != NULL && g_atomic_pointer_get (&receiver_entry->data_channel) == self)
+    example_channel_sender_send_string (sender, "YadaYada!");
+  else
+    gst_webrtc_data_channel_send_string (self, "YadaYada!");
 }
 
 
@@ -334,14 +374,16 @@ void data_channel_on_message_string_cb (GstWebRTCDataChannel * self,
 void data_channel_on_message_data_cb (GstWebRTCDataChannel * self,
                           GBytes * data,
                           gpointer user_data) {
-  gst_print("data_channel_on_message_data_cb()\n");
-
+  EXAMPLE_LOG_RATELIMITED (10, EXAMPLE_LOG_LEVEL_DEBUG, "datachannel-data",
+      "Received %" G_GSIZE_FORMAT " bytes on data channel %p",
+      g_bytes_get_size (data), (gpointer) self);
 }
 
 void incomingDataChannelAdded(GstElement * object,
     GstWebRTCDataChannel * candidate, ReceiverEntry* receiver_entry) {
+  ExampleChannelSender *sender;
 
-  gst_print("Data channel added.\n");
+  EXAMPLE_LOG_DEBUG ("trace", "Data channel added.");
 
   g_signal_connect(candidate, "on-error",
       G_CALLBACK (data_channel_on_error_cb), receiver_entry);
@@ -357,6 +399,96 @@ void incomingDataChannelAdded(GstElement * object,
 
   g_signal_connect(candidate, "on-message-data",
       G_CALLBACK (data_channel_on_message_data_cb), receiver_entry);
+
+  /* Telemetry only goes to the first channel of a viewer, batched so the
+   * page has to unpack the length framing */
+  sender = example_channel_sender_new (candidate, NULL,
+      (gsize) channel_queue_kb * 1024, TRUE);
+  if (g_atomic_pointer_compare_and_exchange (&receiver_entry->data_channel,
+          NULL, candidate))
+    g_atomic_pointer_set (&receiver_entry->channel_sender, sender);
+  else
+    example_channel_sender_close (sender);
+}
+
+static GBytes *
+create_telemetry_message (guint64 seqnum)
+{
+  gsize size = MAX (telemetry_size, TELEMETRY_HEADER_SIZE);
+  guint8 *data = g_malloc (size);
+  gsize i;
+
+  GST_WRITE_UINT64_BE (data, seqnum);
+  GST_WRITE_UINT64_BE (data + 8, g_get_monotonic_time ());
+  for (i = TELEMETRY_HEADER_SIZE; i < size; i++)
+    data[i] = (guint8) (seqnum + i);
+
+  return g_bytes_new_take (data, size);
+}
+
+/* Stands in for a sensor feed, every open channel gets the same messages at
+ * --telemetry-rate per second */
+static gboolean
+telemetry_timeout_cb (gpointer user_data)
+{
+  static gint64 last_time = 0;
+  static gdouble credit = 0;
+  static guint64 seqnum = 0;
+  GHashTable *receiver_entry_table = (GHashTable *) user_data;
+  gint64 now = g_get_monotonic_time ();
+  GHashTableIter iter;
+  gpointer value;
+
+  if (last_time != 0)
+    credit += telemetry_rate * (now - last_time) / (gdouble) G_USEC_PER_SEC;
+  last_time = now;
+
+  for (; credit >= 1; credit--) {
+    GBytes *message = create_telemetry_message (seqnum++);
+
+    g_hash_table_iter_init (&iter, receiver_entry_table);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+      ReceiverEntry *receiver_entry = (ReceiverEntry *) value;
+      ExampleChannelSender *sender =
+          g_atomic_pointer_get (&receiver_entry->channel_sender);
+
+      if (sender != NULL)
+        example_channel_sender_send_data (sender, message);
+    }
+    g_bytes_unref (message);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+channel_stats_cb (gpointer user_data)
+{
+  GHashTable *receiver_entry_table = (GHashTable *) user_data;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, receiver_entry_table);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    ReceiverEntry *receiver_entry = (ReceiverEntry *) value;
+    ExampleChannelSender *sender =
+        g_atomic_pointer_get (&receiver_entry->channel_sender);
+    ExampleChannelStats stats;
+
+    if (sender == NULL)
+      continue;
+
+    example_channel_sender_get_stats (sender, &stats);
+    EXAMPLE_LOG_INFO ("channel-stats",
+        "viewer %p: %" G_GUINT64_FORMAT " messages in %" G_GUINT64_FORMAT
+        " batches, %" G_GUINT64_FORMAT " bytes, %" G_GUINT64_FORMAT
+        " dropped, %" G_GUINT64_FORMAT " bytes queued (peak %"
+        G_GUINT64_FORMAT ")", (gpointer) receiver_entry, stats.messages_sent,
+        stats.batches_sent, stats.bytes_sent, stats.dropped,
+        stats.queued_bytes, stats.max_queued_bytes);
+  }
+
+  return G_SOURCE_CONTINUE;
 }
 
 void on_new_transceiver_callback (GstElement * object,
@@ -365,6 +497,89 @@ void on_new_transceiver_callback (GstElement * object,
   GST_WARNING("on_new_transceiver_callback.");
 }
 
+static gboolean
+create_shared_pipeline (void)
+{
+  GError *error = NULL;
+  GstBus *bus;
+
+  pipeline =
+      gst_parse_launch (VIDEO_SRC
+      " ! videorate ! videoscale ! video/x-raw,width=640,height=360,framerate=15/1 ! videoconvert ! queue max-size-buffers=1 ! x264enc bitrate=600 speed-preset=ultrafast tune=zerolatency key-int-max=15 ! video/x-h264,profile=constrained-baseline ! queue max-size-time=100000000 ! h264parse ! "
+      "rtph264pay config-interval=-1 name=payloader aggregate-mode=zero-latency ! "
+      "application/x-rtp,media=video,encoding-name=H264,payload="
+      RTP_PAYLOAD_TYPE " ! tee name=videotee allow-not-linked=true "
+      "audiotestsrc is-live=true ! queue max-size-buffers=1 leaky=downstream ! audioconvert ! audioresample ! opusenc ! rtpopuspay pt="
+      RTP_AUDIO_PAYLOAD_TYPE " ! tee name=audiotee allow-not-linked=true ",
+      &error);
+  if (error != NULL) {
+    g_printerr ("Could not create shared pipeline: %s\n", error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+
+  video_tee = gst_bin_get_by_name (GST_BIN (pipeline), "videotee");
+  audio_tee = gst_bin_get_by_name (GST_BIN (pipeline), "audiotee");
+  g_assert (video_tee != NULL && audio_tee != NULL);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_bus_add_watch (bus, bus_watch_cb, NULL);
+  gst_object_unref (bus);
+
+  if (gst_element_set_state (pipeline, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_FAILURE) {
+    g_printerr ("Could not start shared pipeline\n");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+destroy_shared_pipeline (void)
+{
+  if (pipeline == NULL)
+    return;
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (video_tee);
+  gst_object_unref (audio_tee);
+  gst_object_unref (pipeline);
+  pipeline = video_tee = audio_tee = NULL;
+}
+
+static void
+add_queue_ghost_pad (GstElement * bin, const gchar * queue_name)
+{
+  GstElement *queue;
+  GstPad *queue_pad;
+
+  queue = gst_bin_get_by_name (GST_BIN (bin), queue_name);
+  g_assert (queue != NULL);
+  queue_pad = gst_element_get_static_pad (queue, "sink");
+  gst_element_add_pad (bin, gst_ghost_pad_new (queue_name, queue_pad));
+  gst_object_unref (queue_pad);
+  gst_object_unref (queue);
+}
+
+/* Only link once @bin is running. An inactive pad returns FLUSHING to the
+ * tee, which passes it upstream and stops the stream for every viewer. */
+static GstPad *
+link_tee_to_queue (GstElement * tee, GstElement * bin, const gchar * queue_name)
+{
+  GstPad *tee_pad, *ghost_pad;
+
+  ghost_pad = gst_element_get_static_pad (bin, queue_name);
+  g_assert (ghost_pad != NULL);
+
+  tee_pad = gst_element_request_pad_simple (tee, "src_%u");
+  if (gst_pad_link (tee_pad, ghost_pad) != GST_PAD_LINK_OK)
+    g_error ("Could not link %s to the shared pipeline", queue_name);
+  gst_object_unref (ghost_pad);
+
+  return tee_pad;
+}
+
 ReceiverEntry *
 create_receiver_entry (SoupWebsocketConnection * connection)
 {
@@ -372,9 +587,8 @@ create_receiver_entry (SoupWebsocketConnection * connection)
   ReceiverEntry *receiver_entry;
   GstWebRTCRTPTransceiver *trans;
   GArray *transceivers;
-  GstBus *bus;
 
-  gst_print ("create_receiver_entry()\n");
+  EXAMPLE_LOG_DEBUG ("trace", "create_receiver_entry()");
 
 
   receiver_entry = g_slice_alloc0 (sizeof (ReceiverEntry));
@@ -386,24 +600,21 @@ create_receiver_entry (SoupWebsocketConnection * connection)
       G_CALLBACK (soup_websocket_message_cb), (gpointer) receiver_entry);
 
   error = NULL;
-  receiver_entry->pipeline =
-      gst_parse_launch ("webrtcbin name=webrtcbin stun-server=stun://"
+  receiver_entry->bin =
+      gst_parse_bin_from_description ("webrtcbin name=webrtcbin stun-server=stun://"
       STUN_SERVER " "
-      VIDEO_SRC
-      " ! videorate ! videoscale ! video/x-raw,width=640,height=360,framerate=15/1 ! videoconvert ! queue max-size-buffers=1 ! x264enc bitrate=600 speed-preset=ultrafast tune=zerolatency key-int-max=15 ! video/x-h264,profile=constrained-baseline ! queue max-size-time=100000000 ! h264parse ! "
-      "rtph264pay config-interval=-1 name=payloader aggregate-mode=zero-latency ! "
-      "application/x-rtp,media=video,encoding-name=H264,payload="
-      RTP_PAYLOAD_TYPE " ! webrtcbin. "
-      "audiotestsrc ! queue max-size-buffers=1 leaky=downstream ! audioconvert ! audioresample ! opusenc ! rtpopuspay pt="
-      RTP_AUDIO_PAYLOAD_TYPE " ! webrtcbin. ", &error);
+      "queue name=videoqueue leaky=downstream max-size-buffers=0 max-size-bytes=0 max-size-time=100000000 ! webrtcbin. "
+      "queue name=audioqueue leaky=downstream max-size-buffers=0 max-size-bytes=0 max-size-time=100000000 ! webrtcbin. ",
+      FALSE, &error);
   if (error != NULL) {
-    g_error ("Could not create WebRTC pipeline: %s\n", error->message);
+    g_error ("Could not create WebRTC bin: %s\n", error->message);
     g_error_free (error);
     goto cleanup;
   }
+  gst_object_ref_sink (receiver_entry->bin);
 
   receiver_entry->webrtcbin =
-      gst_bin_get_by_name (GST_BIN (receiver_entry->pipeline), "webrtcbin");
+      gst_bin_get_by_name (GST_BIN (receiver_entry->bin), "webrtcbin");
   g_assert (receiver_entry->webrtcbin != NULL);
 
   receiver_entry->making_offer = 0;
@@ -462,16 +673,19 @@ create_receiver_entry (SoupWebsocketConnection * connection)
   g_signal_connect(receiver_entry->webrtcbin, "notify::signaling-state",
       G_CALLBACK (on_notify_signaling_state_cb), (gpointer) receiver_entry);
 
-  gst_print ("receiver_entry @ 0x%08X\n", receiver_entry);
+  EXAMPLE_LOG_DEBUG ("trace", "receiver_entry @ %p", receiver_entry);
 
 
-  bus = gst_pipeline_get_bus (GST_PIPELINE (receiver_entry->pipeline));
-  gst_bus_add_watch (bus, bus_watch_cb, NULL);
-  gst_object_unref (bus);
+  gst_bin_add (GST_BIN (pipeline), receiver_entry->bin);
+  add_queue_ghost_pad (receiver_entry->bin, "videoqueue");
+  add_queue_ghost_pad (receiver_entry->bin, "audioqueue");
+  if (!gst_element_sync_state_with_parent (receiver_entry->bin))
+    g_error ("Could not start WebRTC bin");
 
-  if (gst_element_set_state (receiver_entry->pipeline, GST_STATE_PLAYING) ==
-      GST_STATE_CHANGE_FAILURE)
-    g_error ("Could not start pipeline");
+  receiver_entry->video_tee_pad =
+      link_tee_to_queue (video_tee, receiver_entry->bin, "videoqueue");
+  receiver_entry->audio_tee_pad =
+      link_tee_to_queue (audio_tee, receiver_entry->bin, "audioqueue");
 
   return receiver_entry;
 
@@ -480,6 +694,56 @@ cleanup:
   return NULL;
 }
 
+static gboolean
+remove_receiver_bin (gpointer user_data)
+{
+  ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
+
+  gst_element_set_state (receiver_entry->bin, GST_STATE_NULL);
+  gst_bin_remove (GST_BIN (pipeline), receiver_entry->bin);
+
+  /* No webrtcbin thread can hand us a channel anymore */
+  if (receiver_entry->channel_sender != NULL)
+    example_channel_sender_close (receiver_entry->channel_sender);
+
+  gst_object_unref (receiver_entry->video_tee_pad);
+  gst_object_unref (receiver_entry->audio_tee_pad);
+  gst_object_unref (GST_OBJECT (receiver_entry->webrtcbin));
+  gst_object_unref (GST_OBJECT (receiver_entry->bin));
+
+  g_slice_free1 (sizeof (ReceiverEntry), receiver_entry);
+
+  return G_SOURCE_REMOVE;
+}
+
+static GstPadProbeReturn
+tee_pad_idle_cb (GstPad * tee_pad, G_GNUC_UNUSED GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
+  GstElement *tee;
+  GstPad *peer;
+
+  peer = gst_pad_get_peer (tee_pad);
+  if (peer != NULL) {
+    gst_pad_unlink (tee_pad, peer);
+    gst_object_unref (peer);
+  }
+
+  tee = gst_pad_get_parent_element (tee_pad);
+  if (tee != NULL) {
+    gst_element_release_request_pad (tee, tee_pad);
+    gst_object_unref (tee);
+  }
+
+  /* Might be called from a streaming thread, the bin itself is shut down
+   * from the main context */
+  if (g_atomic_int_dec_and_test (&receiver_entry->pending_unlinks))
+    g_main_context_invoke (NULL, remove_receiver_bin, receiver_entry);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
 void
 destroy_receiver_entry (gpointer receiver_entry_ptr)
 {
@@ -487,18 +751,27 @@ destroy_receiver_entry (gpointer receiver_entry_ptr)
 
   g_assert (receiver_entry != NULL);
 
-  if (receiver_entry->pipeline != NULL) {
-    gst_element_set_state (GST_ELEMENT (receiver_entry->pipeline),
-        GST_STATE_NULL);
+  if (receiver_entry->connection != NULL) {
+    g_signal_handlers_disconnect_by_data (receiver_entry->connection,
+        receiver_entry);
+    g_object_unref (G_OBJECT (receiver_entry->connection));
+    receiver_entry->connection = NULL;
+  }
 
-    gst_object_unref (GST_OBJECT (receiver_entry->webrtcbin));
-    gst_object_unref (GST_OBJECT (receiver_entry->pipeline));
+  if (receiver_entry->bin == NULL) {
+    g_slice_free1 (sizeof (ReceiverEntry), receiver_entry);
+    return;
   }
 
-  if (receiver_entry->connection != NULL)
-    g_object_unref (G_OBJECT (receiver_entry->connection));
+  g_signal_handlers_disconnect_by_data (receiver_entry->webrtcbin,
+      receiver_entry);
 
-  g_slice_free1 (sizeof (ReceiverEntry), receiver_entry);
+  /* Detach from the tees once no buffer is being pushed to us */
+  receiver_entry->pending_unlinks = 2;
+  gst_pad_add_probe (receiver_entry->video_tee_pad, GST_PAD_PROBE_TYPE_IDLE,
+      tee_pad_idle_cb, receiver_entry, NULL);
+  gst_pad_add_probe (receiver_entry->audio_tee_pad, GST_PAD_PROBE_TYPE_IDLE,
+      tee_pad_idle_cb, receiver_entry, NULL);
 }
 
 
@@ -513,8 +786,8 @@ on_offer_created_cb (GstPromise * promise, gpointer user_data)
   GstPromise *local_desc_promise;
   GstWebRTCSessionDescription *offer = NULL;
   ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
-  gst_print ("on_offer_created_cb()\n");
-  gst_print ("receiver_entry @ 0x%08X\n", receiver_entry);
+  EXAMPLE_LOG_DEBUG ("trace", "on_offer_created_cb()");
+  EXAMPLE_LOG_DEBUG ("trace", "receiver_entry @ %p", receiver_entry);
 
   reply = gst_promise_get_reply (promise);
   gst_structure_get (reply, "offer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION,
@@ -528,7 +801,8 @@ on_offer_created_cb (GstPromise * promise, gpointer user_data)
   gst_promise_unref (local_desc_promise);
 
   sdp_string = gst_sdp_message_as_text (offer->sdp);
-  gst_print ("Negotiation offer created:\n%s\n", sdp_string);
+  EXAMPLE_LOG_DEBUG ("offer-created", "Negotiation offer created:\n%s",
+      sdp_string);
 
   sdp_json = json_object_new ();
   json_object_set_string_member (sdp_json, "type", "sdp");
@@ -556,8 +830,8 @@ on_negotiation_needed_cb (GstElement * webrtcbin, gpointer user_data)
 {
   GstPromise *promise;
   ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
-  gst_print ("on_negotiation_needed_cb\n");
-  gst_print ("receiver_entry @ 0x%08X\n", receiver_entry);
+  EXAMPLE_LOG_DEBUG ("trace", "on_negotiation_needed_cb");
+  EXAMPLE_LOG_DEBUG ("trace", "receiver_entry @ %p", receiver_entry);
 
   receiver_entry->making_offer = 1;
   promise = gst_promise_new_with_change_func (on_offer_created_cb,
@@ -575,8 +849,8 @@ on_ice_candidate_cb (G_GNUC_UNUSED GstElement * webrtcbin, guint mline_index,
   JsonObject *ice_data_json;
   gchar *json_string;
   ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
-  gst_print ("on_ice_candidate_cb\n");
-  gst_print ("receiver_entry @ 0x%08X\n", receiver_entry);
+  EXAMPLE_LOG_DEBUG ("trace", "on_ice_candidate_cb");
+  EXAMPLE_LOG_DEBUG ("trace", "receiver_entry @ %p", receiver_entry);
   ice_json = json_object_new ();
   json_object_set_string_member (ice_json, "type", "ice");
 
@@ -594,16 +868,16 @@ on_ice_candidate_cb (G_GNUC_UNUSED GstElement * webrtcbin, guint mline_index,
 
 void on_notify_connection_state_cb (GstElement * webrtcbin, GParamSpec *arg1, gpointer user_data) {
 
-  gst_print ("on_notify_connection_state_cb()\n");
-  gst_print ("user_data @ 0x%08X\n", user_data);
+  EXAMPLE_LOG_DEBUG ("trace", "on_notify_connection_state_cb()");
+  EXAMPLE_LOG_DEBUG ("trace", "user_data @ %p", user_data);
 
 }
 void on_local_description_set_cb (GstPromise * promise, gpointer user_data) {
-  gst_print ("on_local_description_set_cb()\n");
+  EXAMPLE_LOG_DEBUG ("trace", "on_local_description_set_cb()");
 
 }
 void set_local_description(GstWebRTCSessionDescription *description, GstElement * webrtcbin, gpointer user_data) {
-  gst_print ("set_local_description()\n");
+  EXAMPLE_LOG_DEBUG ("trace", "set_local_description()");
 
   GstPromise *promise = gst_promise_new_with_change_func(
       on_local_description_set_cb, user_data, NULL);
@@ -612,15 +886,15 @@ void set_local_description(GstWebRTCSessionDescription *description, GstElement
 }
 
 void on_answer_created_cb (GstPromise * promise, gpointer user_data) {
-  gst_print ("on_answer_created_cb()\n");
-  gst_print ("user_data @ 0x%08X\n", user_data);
+  EXAMPLE_LOG_DEBUG ("trace", "on_answer_created_cb()");
+  EXAMPLE_LOG_DEBUG ("trace", "user_data @ %p", user_data);
 
   gchar *json_string;
   JsonObject *sdp_json;
   JsonObject *sdp_data_json;
 
   ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
-  gst_print ("receiver_entry @ 0x%08X\n", receiver_entry);
+  EXAMPLE_LOG_DEBUG ("trace", "receiver_entry @ %p", receiver_entry);
 
   GstStructure *reply = gst_promise_get_reply(promise);
   GstWebRTCSessionDescription* answer = NULL;
@@ -631,7 +905,7 @@ void on_answer_created_cb (GstPromise * promise, gpointer user_data) {
   set_local_description(answer, receiver_entry->webrtcbin, user_data);
 
   gchar* sdp_string = gst_sdp_message_as_text(answer->sdp);
-  gst_print ("sending answer : \n%s\n", sdp_string);
+  EXAMPLE_LOG_DEBUG ("answer-created", "sending answer : \n%s", sdp_string);
 
   sdp_json = json_object_new ();
   json_object_set_string_member (sdp_json, "type", "sdp");
@@ -653,7 +927,7 @@ void on_answer_created_cb (GstPromise * promise, gpointer user_data) {
 }
 
 void create_answer(GstElement * webrtcbin, gpointer user_data) {
-  gst_print ("create_answer()\n");
+  EXAMPLE_LOG_DEBUG ("trace", "create_answer()");
   ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
 
   GstPromise *promise = gst_promise_new_with_change_func(
@@ -662,24 +936,24 @@ void create_answer(GstElement * webrtcbin, gpointer user_data) {
 }
 
 void on_local_negotiation_requested() {
-  gst_print ("on_local_negotiation_requested() ToDO\n");
+  EXAMPLE_LOG_DEBUG ("trace", "on_local_negotiation_requested() ToDO");
 }
 
 void mark_connected() {
-  gst_print ("mark_connected()\n");
+  EXAMPLE_LOG_DEBUG ("trace", "mark_connected()");
 }
 
 void signalling_state_stable(gpointer user_data) {
-  gst_print ("signalling_state_stable() ToDO\n");
+  EXAMPLE_LOG_DEBUG ("trace", "signalling_state_stable() ToDO");
 }
 
 void on_notify_signaling_state_cb (GstElement * webrtcbin,  GParamSpec *arg1, gpointer user_data) {
-  gst_print ("on_notify_signaling_state_cb()\n");
-  gst_print ("user_data @ 0x%08X\n", user_data);
+  EXAMPLE_LOG_DEBUG ("trace", "on_notify_signaling_state_cb()");
+  EXAMPLE_LOG_DEBUG ("trace", "user_data @ %p", user_data);
 
   GstWebRTCSignalingState state;
   g_object_get (webrtcbin, "signaling-state", &state, NULL);
-  gst_print ("State : %u\n", state);
+  EXAMPLE_LOG_DEBUG ("signaling-state", "State : %u", state);
 
 
   switch (state) {
@@ -761,7 +1035,8 @@ soup_websocket_message_cb (G_GNUC_UNUSED SoupWebsocketConnection * connection,
 
     GstWebRTCSignalingState signaling_state;
     g_object_get (receiver_entry->webrtcbin, "signaling-state", &signaling_state, NULL);
-    gst_print ("signaling-state : %u\n", signaling_state);
+    EXAMPLE_LOG_DEBUG ("signaling-state", "signaling-state : %u",
+        signaling_state);
 
 
     if (!json_object_has_member (data_json_object, "type")) {
@@ -776,7 +1051,8 @@ soup_websocket_message_cb (G_GNUC_UNUSED SoupWebsocketConnection * connection,
     }
     sdp_string = json_object_get_string_member (data_json_object, "sdp");
 
-    gst_print ("Received SDP %s:\n%s\n", sdp_type_string, sdp_string);
+    EXAMPLE_LOG_DEBUG ("sdp-received", "Received SDP %s:\n%s",
+        sdp_type_string, sdp_string);
 
     ret = gst_sdp_message_new (&sdp);
     g_assert_cmphex (ret, ==, GST_SDP_OK);
@@ -796,7 +1072,7 @@ soup_websocket_message_cb (G_GNUC_UNUSED SoupWebsocketConnection * connection,
       int offer_collision = (signaling_state != GST_WEBRTC_SIGNALING_STATE_STABLE) || receiver_entry->making_offer;
       int ignore_offer =  (!receiver_entry->polite) && offer_collision;
       if(ignore_offer) {
-        gst_print ("Ignoring Offer\n");
+        EXAMPLE_LOG_INFO ("offer-ignored", "Ignoring Offer");
         goto cleanup;
       }
       answer_or_offer = gst_webrtc_session_description_new (GST_WEBRTC_SDP_TYPE_OFFER,
@@ -835,7 +1111,8 @@ soup_websocket_message_cb (G_GNUC_UNUSED SoupWebsocketConnection * connection,
     candidate_string = json_object_get_string_member (data_json_object,
         "candidate");
 
-    gst_print ("Received ICE candidate with mline index %u; candidate: %s\n",
+    EXAMPLE_LOG_DEBUG ("ice-received",
+        "Received ICE candidate with mline index %u; candidate: %s",
         mline_index, candidate_string);
 
     g_signal_emit_by_name (receiver_entry->webrtcbin, "add-ice-candidate",
@@ -860,53 +1137,21 @@ soup_websocket_closed_cb (SoupWebsocketConnection * connection,
     gpointer user_data)
 {
   GHashTable *receiver_entry_table = (GHashTable *) user_data;
-  ReceiverEntry *receiver_entry = (ReceiverEntry *) g_hash_table_lookup(receiver_entry_table, connection);
   g_hash_table_remove (receiver_entry_table, connection);
-  gst_print ("Closed websocket connection %p\n", (gpointer) connection);
-
-
-  gst_element_set_state(receiver_entry->webrtcbin, GST_STATE_NULL);
+  EXAMPLE_LOG_RATELIMITED (50, EXAMPLE_LOG_LEVEL_INFO, "websocket-closed",
+      "Closed websocket connection %p", (gpointer) connection);
 }
 
 
 void
 soup_http_handler (G_GNUC_UNUSED SoupServer * soup_server,
     SoupMessage * message, const char *path, G_GNUC_UNUSED GHashTable * query,
-    G_GNUC_UNUSED SoupClientContext * client_context,
-    G_GNUC_UNUSED gpointer user_data)
+    G_GNUC_UNUSED SoupClientContext * client_context, gpointer user_data)
 {
-  SoupBuffer *soup_buffer;
+  ExampleAssets *assets = (ExampleAssets *) user_data;
 
-  if ((g_strcmp0 (path, "/") != 0) && (g_strcmp0 (path, "/index.html") != 0)) {
+  if (!example_assets_serve (assets, message, path))
     soup_message_set_status (message, SOUP_STATUS_NOT_FOUND);
-    return;
-  }
-
-//  soup_buffer =
-//      soup_buffer_new (SOUP_MEMORY_STATIC, html_source, strlen (html_source));
-//
-//  soup_message_headers_set_content_type (message->response_headers, "text/html",
-//      NULL);
-//  soup_message_body_append_buffer (message->response_body, soup_buffer);
-//  soup_buffer_free (soup_buffer);
-
-
-  GMappedFile *mapping;
-  SoupBuffer *buffer;
-
-  mapping = g_mapped_file_new ("./mnt/build/workspace/sources/gst-examples/webrtc/sendonly/webrtc-unidirectional-h264-datachannel.html", FALSE, NULL);
-  if (!mapping) {
-    soup_message_set_status (message, SOUP_STATUS_INTERNAL_SERVER_ERROR);
-    return;
-  }
-
-  buffer = soup_buffer_new_with_owner (g_mapped_file_get_contents (mapping),
-               g_mapped_file_get_length (mapping),
-               mapping, (GDestroyNotify)g_mapped_file_unref);
-  soup_message_body_append_buffer (message->response_body, buffer);
-  soup_buffer_free (buffer);
-
-  soup_message_set_status (message, SOUP_STATUS_OK);
 }
 
 
@@ -918,7 +1163,8 @@ soup_websocket_handler (G_GNUC_UNUSED SoupServer * server,
   ReceiverEntry *receiver_entry;
   GHashTable *receiver_entry_table = (GHashTable *) user_data;
 
-  gst_print ("Processing new websocket connection %p\n", (gpointer) connection);
+  EXAMPLE_LOG_RATELIMITED (50, EXAMPLE_LOG_LEVEL_INFO, "websocket-new",
+      "Processing new websocket connection %p", (gpointer) connection);
 
   g_signal_connect (G_OBJECT (connection), "closed",
       G_CALLBACK (soup_websocket_closed_cb), (gpointer) receiver_entry_table);
@@ -966,6 +1212,17 @@ static GOptionEntry entries[] = {
   {"audio-priority", 0, 0, G_OPTION_ARG_STRING, &audio_priority,
         "Priority of the audio stream (very-low, low, medium or high)",
       "PRIORITY"},
+  {"telemetry-rate", 0, 0, G_OPTION_ARG_INT, &telemetry_rate,
+        "Binary messages per second sent to every viewer's data channel "
+        "(default: 0)", "N"},
+  {"telemetry-size", 0, 0, G_OPTION_ARG_INT, &telemetry_size,
+        "Size of each telemetry message in bytes (default: 256)", "BYTES"},
+  {"channel-queue-kb", 0, 0, G_OPTION_ARG_INT, &channel_queue_kb,
+        "Data queued per channel before messages are dropped "
+        "(default: 4096)", "KB"},
+  {"assets-dir", 0, 0, G_OPTION_ARG_FILENAME, &assets_dir,
+        "Serve the page and its assets from this directory instead of the "
+        "embedded page", "DIR"},
   {NULL},
 };
 
@@ -974,6 +1231,7 @@ main (int argc, char *argv[])
 {
   GMainLoop *mainloop;
   SoupServer *soup_server;
+  ExampleAssets *assets;
   GHashTable *receiver_entry_table;
   GOptionContext *context;
   GError *error = NULL;
@@ -983,15 +1241,29 @@ main (int argc, char *argv[])
   context = g_option_context_new ("- gstreamer webrtc sendonly demo");
   g_option_context_add_main_entries (context, entries, NULL);
   g_option_context_add_group (context, gst_init_get_option_group ());
+  g_option_context_add_group (context, example_tracer_get_option_group ());
   if (!g_option_context_parse (context, &argc, &argv, &error)) {
     g_printerr ("Error initializing: %s\n", error->message);
     return -1;
   }
 
+  example_log_init ();
+  example_tracer_init ();
+
   receiver_entry_table =
       g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
       destroy_receiver_entry);
 
+  if (!create_shared_pipeline ())
+    return -1;
+
+  if (telemetry_rate > 0) {
+    g_timeout_add (TELEMETRY_INTERVAL, telemetry_timeout_cb,
+        receiver_entry_table);
+    g_timeout_add_seconds (CHANNEL_STATS_INTERVAL, channel_stats_cb,
+        receiver_entry_table);
+  }
+
   mainloop = g_main_loop_new (NULL, FALSE);
   g_assert (mainloop != NULL);
 
@@ -1000,9 +1272,15 @@ main (int argc, char *argv[])
   g_unix_signal_add (SIGTERM, exit_sighandler, mainloop);
 #endif
 
+  /* The embedded page is only used if the directory does not have one */
+  assets = example_assets_new (assets_dir);
+  example_assets_add_embedded (assets, PAGE_NAME, "text/html", html_source);
+  example_assets_add_alias (assets, "/", PAGE_NAME);
+  example_assets_add_alias (assets, "/index.html", PAGE_NAME);
+
   soup_server =
       soup_server_new (SOUP_SERVER_SERVER_HEADER, "webrtc-soup-server", NULL);
-  soup_server_add_handler (soup_server, "/", soup_http_handler, NULL, NULL);
+  soup_server_add_handler (soup_server, "/", soup_http_handler, assets, NULL);
   soup_server_add_websocket_handler (soup_server, "/ws", NULL, NULL,
       soup_websocket_handler, (gpointer) receiver_entry_table, NULL);
   soup_server_listen_all (soup_server, SOUP_HTTP_PORT,
@@ -1013,9 +1291,15 @@ main (int argc, char *argv[])
   g_main_loop_run (mainloop);
 
   g_object_unref (G_OBJECT (soup_server));
+  example_assets_free (assets);
+  /* Stop streaming first so the viewers detach from the tees right away */
+  gst_element_set_state (pipeline, GST_STATE_NULL);
   g_hash_table_destroy (receiver_entry_table);
+  destroy_shared_pipeline ();
   g_main_loop_unref (mainloop);
 
+  example_tracer_deinit ();
+  example_log_deinit ();
   gst_deinit ();
 
   return 0;
@@ -2,9 +2,12 @@
 #include <glib.h>
 #include <gst/gst.h>
 #include <gst/sdp/sdp.h>
+#include <gst/rtp/rtp.h>
 
 #ifdef G_OS_UNIX
 #include <glib-unix.h>
+#include <sys/resource.h>
+#include <unistd.h>
 #endif
 
 #define GST_USE_UNSTABLE_API
@@ -12,8 +15,17 @@
 
 #include <libsoup/soup.h>
 #include <json-glib/json-glib.h>
+#include <stdio.h>
 #include <string.h>
 
+#include "example-assets.h"
+#include "example-dtls.h"
+#include "example-encoder-control.h"
+#include "example-encoders.h"
+#include "example-log.h"
+#include "example-pacer.h"
+#include "example-tracer.h"
+
 #define RTP_PAYLOAD_TYPE "96"
 #define RTP_AUDIO_PAYLOAD_TYPE "97"
 #define SOUP_HTTP_PORT 57778
@@ -25,11 +37,88 @@
 #define VIDEO_SRC "v4l2src"
 #endif
 
+/* Seconds of joins at the recent rate the session pool should absorb */
+#define SESSION_POOL_HORIZON 2
+#define JOIN_RATE_WINDOW 10
+
+/* Viewer bins are stopped by a reaper thread, once this many are waiting
+ * the closing context stops them itself */
+#define REAPER_QUEUE_MAX 64
+
+#define RTP_TWCC_URI "http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01"
+
+#define MAX_LAYERS 3
+
+/* Per-viewer bandwidth estimation, bitrates in kbit/s. Transport-wide
+ * congestion control feedback is preferred, RTCP receiver report loss is
+ * the fallback for viewers that don't send it */
+#define BWE_INTERVAL 1
+#define BWE_MIN_BITRATE 50
+#define BWE_RAMP_UP 1.08
+#define BWE_OVERUSE_BACKOFF 0.85
+#define BWE_OVERUSE_DELTA (2 * GST_MSECOND)
+#define BWE_LOSS_HIGH 0.10
+#define BWE_LOSS_LOW 0.02
+#define BWE_UP_HEADROOM 1.1
+
+/* Video loss protection. NACK/RTX is negotiated with every viewer, ULPFEC
+ * is added on top when the loss is more than retransmissions can repair
+ * in time, FEC percentages in 5% steps */
+#define PROTECTION_LOSS_LOW 0.01
+#define PROTECTION_RTX_MAX_LOSS 0.05
+#define PROTECTION_RTX_MAX_RTT 0.150    /* s */
+#define PROTECTION_FEC_MAX 50
+#define PROTECTION_HOLD 5       /* BWE intervals before lowering FEC */
+
+/* Keyframe requests from all viewers of a layer are merged, times in us */
+#define KEYFRAME_COALESCE_WINDOW (200 * G_TIME_SPAN_MILLISECOND)
+#define KEYFRAME_MIN_INTERVAL (1 * G_TIME_SPAN_SECOND)
+#define KEYFRAME_CACHE_MAX_PACKETS 1024
+#define KEYFRAME_STATS_INTERVAL 10
+
+/* Every viewer's get-stats is polled once per STATS_INTERVAL seconds, spread
+ * over slices of STATS_SLICE milliseconds */
+#define STATS_INTERVAL 5
+#define STATS_SLICE 250
+
+/* L1T3: temporal layer ids 0,2,1,2 repeating, each layer doubles the rate */
+#define TEMPORAL_LAYERS 3
+
+#define KEYFRAME_INTERVAL 15    /* frames */
+#define VIDEO_FRAMERATE 15
+
+#define ENCODER_CONTROL_INTERVAL 2      /* seconds */
+
+#define DTLS_POOL_DEFAULT_SIZE 4
+
 gchar *video_priority = NULL;
 gchar *audio_priority = NULL;
+gint session_pool_min = 2;
+gint session_pool_max = 32;
+gboolean simulcast = FALSE;
+gboolean temporal_layers = FALSE;
+gint n_workers = 0;
+gint ice_batch_ms = 0;
+gboolean per_viewer_audio = FALSE;
+gboolean protection = TRUE;
+gdouble pacing = 0;
+gint pacing_max_delay = 100;
+gint dtls_pool_size = 0;
+gchar *dtls_cert_dir = NULL;
+gint dtls_rotate = 86400;
+gboolean host_only = FALSE;
+gchar **ice_addresses = NULL;
+gchar *ice_ports = NULL;
+gchar *vod_location = NULL;
+gchar *encoder_name = NULL;
+gchar *encoder_preset = NULL;
+gboolean cpu_adapt = FALSE;
+gchar *degradation = NULL;
+gchar *assets_dir = NULL;
 
 
 typedef struct _ReceiverEntry ReceiverEntry;
+typedef struct _Worker Worker;
 
 ReceiverEntry *create_receiver_entry (SoupWebsocketConnection * connection);
 void destroy_receiver_entry (gpointer receiver_entry_ptr);
@@ -38,6 +127,8 @@ void on_offer_created_cb (GstPromise * promise, gpointer user_data);
 void on_negotiation_needed_cb (GstElement * webrtcbin, gpointer user_data);
 void on_ice_candidate_cb (GstElement * webrtcbin, guint mline_index,
     gchar * candidate, gpointer user_data);
+static void on_ice_gathering_state_notify (GstElement * webrtcbin,
+    GParamSpec * pspec, gpointer user_data);
 
 void soup_websocket_message_cb (SoupWebsocketConnection * connection,
     SoupWebsocketDataType data_type, GBytes * message, gpointer user_data);
@@ -47,20 +138,219 @@ void soup_websocket_closed_cb (SoupWebsocketConnection * connection,
 void soup_http_handler (SoupServer * soup_server, SoupMessage * message,
     const char *path, GHashTable * query, SoupClientContext * client_context,
     gpointer user_data);
+void soup_stats_handler (SoupServer * soup_server, SoupMessage * message,
+    const char *path, GHashTable * query, SoupClientContext * client_context,
+    gpointer user_data);
 void soup_websocket_handler (G_GNUC_UNUSED SoupServer * server,
     SoupWebsocketConnection * connection, const char *path,
     SoupClientContext * client_context, gpointer user_data);
 
 static gchar *get_string_from_json_object (JsonObject * object);
 
+typedef struct
+{
+  const gchar *rid;
+  gint width;
+  gint height;
+  gint bitrate;                 /* kbit/s */
+} SimulcastLayer;
+
+typedef struct
+{
+  ReceiverEntry *receiver_entry;
+  gint layer;
+  gboolean after_marker;
+} LayerProbe;
+
+/* One per encoded layer, sits on the sink pad of its tee */
+typedef struct
+{
+  GMutex lock;
+  const gchar *rid;
+  GstPad *pad;
+  gint64 last_keyframe;
+  gint64 last_forced;
+  guint deferred_id;
+
+  /* Streaming thread only */
+  gboolean after_marker;
+  GstBufferList *gop;
+
+  guint64 requests;
+  guint64 forced;
+  guint64 coalesced;
+  guint64 deferred;
+  guint64 cached_joins;
+} KeyframeArbiter;
+
+/* Times in us, from the websocket closing to the bin reaching NULL */
+typedef struct
+{
+  GMutex lock;
+  guint64 count;
+  guint64 synchronous;
+  GstClockTimeDiff latency_sum;
+  GstClockTimeDiff latency_max;
+  GstClockTimeDiff stop_sum;
+  GstClockTimeDiff stop_max;
+} TeardownStats;
+
+typedef struct
+{
+  GstElement *bin;
+  guint id;
+  gint64 closed_time;
+} ReaperItem;
+
+/* Runs the signalling and negotiation of the viewers pinned to it */
+struct _Worker
+{
+  GThread *thread;
+  GMainContext *context;
+  GMainLoop *loop;
+  gint n_receivers;
+};
+
+typedef void (*ReceiverCallFunc) (ReceiverEntry * receiver_entry,
+    gpointer data);
+
+/* Last get-stats result of a viewer, as served by /stats */
+typedef struct
+{
+  gint64 timestamp;
+  guint64 bytes_sent;
+  gdouble bitrate;              /* kbit/s */
+  gint64 packets_lost;
+  gdouble round_trip_time;      /* s */
+  guint64 nack_count;
+  guint64 pli_count;
+  guint64 fir_count;
+  gchar *local_candidate;
+  gchar *remote_candidate;
+} ViewerStats;
+
+typedef struct
+{
+  ReceiverEntry *receiver_entry;
+  ReceiverCallFunc func;
+  gpointer data;
+  GDestroyNotify data_free;
+} ReceiverCall;
+
 struct _ReceiverEntry
 {
+  guint id;
+  gint refcount;
+  gint closed;
+  gint64 closed_time;
+  Worker *worker;
   SoupWebsocketConnection *connection;
 
-  GstElement *pipeline;
+  GstElement *bin;
   GstElement *webrtcbin;
+  GstElement *video_selector;
+
+  GstPad *video_tee_pads[MAX_LAYERS];
+  GstPad *video_selector_pads[MAX_LAYERS];
+  GstPad *audio_tee_pad;
+  gint pending_unlinks;
+
+  /* Layer selection, index 0 is the highest quality */
+  LayerProbe layer_probes[MAX_LAYERS];
+  gint current_layer;
+  gint target_layer;
+  gint best_layer;
+  gint max_temporal_layer;
+  gboolean frame_start;
+  gboolean dropping_frame;
+  gboolean keyframe_seen;
+
+  /* Bandwidth estimation, only touched from the main context except for
+   * the receiver report loss in per mille, -1 if unknown */
+  GObject *rtp_session;
+  gdouble estimate;
+  gint rr_loss;
+
+  /* Loss protection, main context only. Loss is a smoothed fraction, -1
+   * until the first report */
+  gdouble protection_loss;
+  gint fec_percentage;
+  gint fec_hold;
+
+  GMutex stats_lock;
+  ViewerStats stats;
+
+  /* Local candidates waiting to be sent in one message */
+  GMutex ice_lock;
+  JsonArray *ice_batch;
+  gboolean ice_batch_scheduled;
+  guint16 next_seqnum;
+  GstCaps *video_caps;
+
+  /* The shared Opus stream goes out with the viewer's own SSRC and
+   * sequence numbers, rewritten after its queue */
+  guint32 audio_ssrc;
+  guint16 audio_next_seqnum;
 };
 
+static const SimulcastLayer simulcast_layers[MAX_LAYERS] = {
+  {"h", 1280, 720, 1500},
+  {"m", 640, 360, 600},
+  {"l", 320, 180, 150},
+};
+
+/* Without --simulcast only the middle layer is encoded */
+static const SimulcastLayer *layers = &simulcast_layers[1];
+static gint n_layers = 1;
+
+/* Cumulative share of the layer bitrate up to each temporal layer */
+static const gdouble temporal_layer_share[TEMPORAL_LAYERS] = { 0.4, 0.6, 1.0 };
+
+/* Capture, encoding and payloading happens once in this pipeline, every
+ * viewer only adds a bin with a queue per stream and its own webrtcbin */
+static GstElement *pipeline = NULL;
+static GstElement *video_tees[MAX_LAYERS];
+static KeyframeArbiter keyframe_arbiters[MAX_LAYERS];
+static GstElement *audio_tee = NULL;
+
+/* Without per-viewer layers the encoder follows the weakest viewer */
+static GstElement *shared_encoder = NULL;
+static const ExampleEncoder *video_encoder = NULL;
+static ExampleEncoderPreset video_encoder_preset =
+    EXAMPLE_ENCODER_PRESET_REALTIME;
+static gint shared_bitrate = 0;
+
+/* With --cpu-adapt, moves every layer's preset, size and frame rate */
+static ExampleEncoderControl *encoder_control = NULL;
+static ExampleDegradation degradation_preference =
+    EXAMPLE_DEGRADATION_MAINTAIN_FRAMERATE;
+
+/* With --pacing, on the queue between each layer's payloader and tee */
+static ExamplePacer *pacers[MAX_LAYERS];
+
+/* With --vod the file is demuxed and paced once for everybody */
+static GstElement *vod_demux = NULL;
+static GQueue receivers = G_QUEUE_INIT;
+
+static Worker *workers = NULL;
+static guint next_receiver_id = 0;
+
+/* READY webrtcbin sessions waiting for a viewer, filled by a worker thread */
+static GMutex session_pool_lock;
+static GQueue session_pool = G_QUEUE_INIT;
+static guint session_pool_pending = 0;
+static GThreadPool *session_pool_workers = NULL;
+static GArray *join_times = NULL;
+
+static GThreadPool *reaper = NULL;
+static TeardownStats teardown_stats;
+
+static ExampleDtlsPool *dtls_pool = NULL;
+
+/* From --ice-ports, 0 leaves the choice to the ICE agent */
+static guint ice_min_port = 0;
+static guint ice_max_port = 0;
+
 const gchar *html_source = " \n \
 <html> \n \
   <head> \n \
@@ -71,6 +361,9 @@ const gchar *html_source = " \n \
       var webrtcPeerConnection; \n \
       var webrtcConfiguration; \n \
       var reportError; \n \
+      var iceBatchMs = 0; \n \
+      var iceBatch = null; \n \
+      var iceBatchTimer = null; \n \
  \n \
  \n \
       function onLocalDescription(desc) { \n \
@@ -94,6 +387,27 @@ const gchar *html_source = " \n \
         webrtcPeerConnection.addIceCandidate(candidate).catch(reportError); \n \
       } \n \
  \n \
+ \n \
+      function onIncomingICEBatch(batch) { \n \
+        batch.candidates.forEach(onIncomingICE); \n \
+        if (batch[\"end-of-candidates\"]) \n \
+          webrtcPeerConnection.addIceCandidate(null).catch(reportError); \n \
+      } \n \
+ \n \
+ \n \
+      function flushICEBatch(end) { \n \
+        if (iceBatchTimer) { \n \
+          clearTimeout(iceBatchTimer); \n \
+          iceBatchTimer = null; \n \
+        } \n \
+        if (!iceBatch && !end) \n \
+          return; \n \
+ \n \
+        console.log(\"Sending ICE candidate batch out: \" + JSON.stringify(iceBatch)); \n \
+        websocketConnection.send(JSON.stringify({ \"type\": \"ice-batch\", \"data\": { \"candidates\": iceBatch || [], \"end-of-candidates\": end } })); \n \
+        iceBatch = null; \n \
+      } \n \
+ \n \
  \n \
       function onAddRemoteStream(event) { \n \
         html5VideoElement.srcObject = event.streams[0]; \n \
@@ -101,6 +415,19 @@ const gchar *html_source = " \n \
  \n \
  \n \
       function onIceCandidate(event) { \n \
+        if (iceBatchMs > 0) { \n \
+          if (event.candidate == null) { \n \
+            flushICEBatch(true); \n \
+            return; \n \
+          } \n \
+          if (!iceBatch) \n \
+            iceBatch = []; \n \
+          iceBatch.push(event.candidate); \n \
+          if (!iceBatchTimer) \n \
+            iceBatchTimer = setTimeout(function() { flushICEBatch(false); }, iceBatchMs); \n \
+          return; \n \
+        } \n \
+ \n \
         if (event.candidate == null) \n \
           return; \n \
  \n \
@@ -108,6 +435,23 @@ const gchar *html_source = " \n \
         websocketConnection.send(JSON.stringify({ \"type\": \"ice\", \"data\": event.candidate })); \n \
       } \n \
  \n \
+ \n \
+      function onIncomingLayers(layers) { \n \
+        var select = document.getElementById(\"layer\"); \n \
+ \n \
+        select.innerHTML = \"\"; \n \
+        layers.forEach(function(layer) { \n \
+          var option = document.createElement(\"option\"); \n \
+          option.value = layer.rid; \n \
+          option.text = layer.width + \"x\" + layer.height + \" (\" + layer.bitrate + \" kbit/s)\"; \n \
+          select.appendChild(option); \n \
+        }); \n \
+        select.onchange = function() { \n \
+          websocketConnection.send(JSON.stringify({ \"type\": \"layer\", \"data\": { \"rid\": select.value } })); \n \
+        }; \n \
+        select.hidden = false; \n \
+      } \n \
+ \n \
  \n \
       function onServerMessage(event) { \n \
         var msg; \n \
@@ -119,14 +463,22 @@ const gchar *html_source = " \n \
         } \n \
  \n \
         if (!webrtcPeerConnection) { \n \
+          if (msg[\"host-only\"]) \n \
+            webrtcConfiguration = {}; \n \
           webrtcPeerConnection = new RTCPeerConnection(webrtcConfiguration); \n \
           webrtcPeerConnection.ontrack = onAddRemoteStream; \n \
           webrtcPeerConnection.onicecandidate = onIceCandidate; \n \
         } \n \
  \n \
         switch (msg.type) { \n \
-          case \"sdp\": onIncomingSDP(msg.data); break; \n \
+          case \"sdp\": \n \
+            if (msg[\"ice-batch-ms\"]) \n \
+              iceBatchMs = msg[\"ice-batch-ms\"]; \n \
+            onIncomingSDP(msg.data); \n \
+            break; \n \
           case \"ice\": onIncomingICE(msg.data); break; \n \
+          case \"ice-batch\": onIncomingICEBatch(msg.data); break; \n \
+          case \"layers\": onIncomingLayers(msg.data); break; \n \
           default: break; \n \
         } \n \
       } \n \
@@ -161,6 +513,7 @@ const gchar *html_source = " \n \
   <body> \n \
     <div> \n \
       <video id=\"stream\" autoplay playsinline>Your browser does not support video</video> \n \
+      <select id=\"layer\" hidden></select> \n \
     </div> \n \
   </body> \n \
 </html> \n \
@@ -214,95 +567,2366 @@ _priority_from_string (const gchar * s)
   if (en)
     return en->value;
 
-  return 0;
+  return 0;
+}
+
+/* Parses the VP8 payload descriptor (RFC 7741), returns the offset of the
+ * VP8 payload header or 0 if the descriptor is truncated */
+static guint
+parse_vp8_descriptor (const guint8 * payload, guint len, gint * tid)
+{
+  guint offset = 1;
+  guint8 extension;
+
+  *tid = -1;
+  if (len < 1)
+    return 0;
+
+  if (payload[0] & 0x80) {
+    if (len < 2)
+      return 0;
+    extension = payload[1];
+    offset = 2;
+
+    /* I: PictureID, 15 bit if the M bit is set */
+    if (extension & 0x80) {
+      if (offset >= len)
+        return 0;
+      offset += (payload[offset] & 0x80) ? 2 : 1;
+    }
+    /* L: TL0PICIDX */
+    if (extension & 0x40)
+      offset++;
+    /* T or K: TID/Y/KEYIDX */
+    if (extension & 0x30) {
+      if (offset >= len)
+        return 0;
+      if (extension & 0x20)
+        *tid = payload[offset] >> 6;
+      offset++;
+    }
+  }
+
+  return offset < len ? offset : 0;
+}
+
+/* Whether the payload starts a keyframe in the selected codec's RTP
+ * payload format */
+static gboolean
+is_keyframe_start (const guint8 * payload, guint len)
+{
+  guint offset, nal_type;
+  gint tid;
+
+  if (len == 0)
+    return FALSE;
+
+  switch (video_encoder->codec) {
+    case EXAMPLE_CODEC_VP8:
+      /* Start of partition 0 with the P bit of the frame header cleared */
+      offset = parse_vp8_descriptor (payload, len, &tid);
+      return offset > 0 && (payload[0] & 0x17) == 0x10
+          && !(payload[offset] & 0x01);
+    case EXAMPLE_CODEC_VP9:
+      /* B (start of frame) set, P (inter-picture predicted) cleared */
+      return (payload[0] & 0x48) == 0x08;
+    case EXAMPLE_CODEC_AV1:
+      /* N (new coded video sequence) set, Z (continuation) cleared */
+      return (payload[0] & 0x88) == 0x08;
+    case EXAMPLE_CODEC_H264:
+    default:
+      nal_type = payload[0] & 0x1f;
+      /* STAP-A: first aggregated NAL, FU-A: only the first fragment */
+      if (nal_type == 24 && len > 3)
+        nal_type = payload[3] & 0x1f;
+      else if (nal_type == 28 && len > 1 && (payload[1] & 0x80))
+        nal_type = payload[1] & 0x1f;
+
+      /* With config-interval=-1 every IDR is preceded by SPS/PPS */
+      return nal_type == 5 || nal_type == 7;
+  }
+}
+
+static void
+parse_rtp_packet (GstBuffer * buffer, gboolean * keyframe_start,
+    gboolean * marker)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+  *marker = FALSE;
+  if (keyframe_start)
+    *keyframe_start = FALSE;
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp))
+    return;
+
+  *marker = gst_rtp_buffer_get_marker (&rtp);
+  if (keyframe_start)
+    *keyframe_start = is_keyframe_start (gst_rtp_buffer_get_payload (&rtp),
+        gst_rtp_buffer_get_payload_len (&rtp));
+
+  gst_rtp_buffer_unmap (&rtp);
+}
+
+static GstEvent *
+new_force_key_unit_event (gboolean arbitrated)
+{
+  return gst_event_new_custom (GST_EVENT_CUSTOM_UPSTREAM,
+      gst_structure_new ("GstForceKeyUnit", "all-headers", G_TYPE_BOOLEAN,
+          TRUE, "keyframe-arbiter", G_TYPE_BOOLEAN, arbitrated, NULL));
+}
+
+static void
+request_keyframe (GstPad * pad)
+{
+  gst_pad_push_event (pad, new_force_key_unit_event (FALSE));
+}
+
+static gboolean
+keyframe_arbiter_deferred_cb (gpointer user_data)
+{
+  KeyframeArbiter *arbiter = (KeyframeArbiter *) user_data;
+
+  g_mutex_lock (&arbiter->lock);
+  arbiter->deferred_id = 0;
+  arbiter->last_forced = g_get_monotonic_time ();
+  arbiter->forced++;
+  g_mutex_unlock (&arbiter->lock);
+
+  gst_pad_push_event (arbiter->pad, new_force_key_unit_event (TRUE));
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Merges requests with a forced keyframe that hasn't gone out yet or is
+ * scheduled, and spaces forced keyframes at least KEYFRAME_MIN_INTERVAL
+ * apart. A request after a keyframe usually comes from a viewer that lost
+ * part of it, so that still gets one, deferred if needed. */
+static void
+keyframe_arbiter_request (KeyframeArbiter * arbiter)
+{
+  gint64 now = g_get_monotonic_time ();
+  gboolean force = FALSE;
+  gint64 wait;
+
+  g_mutex_lock (&arbiter->lock);
+  arbiter->requests++;
+
+  if (arbiter->deferred_id != 0
+      || (arbiter->last_forced > arbiter->last_keyframe
+          && now - arbiter->last_forced < KEYFRAME_COALESCE_WINDOW)) {
+    arbiter->coalesced++;
+  } else if (now - arbiter->last_forced < KEYFRAME_MIN_INTERVAL) {
+    wait = arbiter->last_forced + KEYFRAME_MIN_INTERVAL - now;
+    arbiter->deferred++;
+    arbiter->deferred_id = g_timeout_add ((guint) (wait / 1000) + 1,
+        keyframe_arbiter_deferred_cb, arbiter);
+  } else {
+    arbiter->last_forced = now;
+    arbiter->forced++;
+    force = TRUE;
+  }
+
+  g_mutex_unlock (&arbiter->lock);
+
+  if (force)
+    gst_pad_push_event (arbiter->pad, new_force_key_unit_event (TRUE));
+}
+
+static GstPadProbeReturn
+keyframe_arbiter_event_cb (G_GNUC_UNUSED GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  const GstStructure *structure;
+  gboolean arbitrated = FALSE;
+
+  if (GST_EVENT_TYPE (event) != GST_EVENT_CUSTOM_UPSTREAM)
+    return GST_PAD_PROBE_OK;
+
+  structure = gst_event_get_structure (event);
+  if (!gst_structure_has_name (structure, "GstForceKeyUnit"))
+    return GST_PAD_PROBE_OK;
+
+  gst_structure_get_boolean (structure, "keyframe-arbiter", &arbitrated);
+  if (arbitrated)
+    return GST_PAD_PROBE_OK;
+
+  keyframe_arbiter_request ((KeyframeArbiter *) user_data);
+
+  return GST_PAD_PROBE_DROP;
+}
+
+static void
+keyframe_arbiter_cache (KeyframeArbiter * arbiter, GstBuffer * buffer)
+{
+  gboolean au_start, keyframe_start, marker;
+
+  au_start = arbiter->after_marker;
+  parse_rtp_packet (buffer, &keyframe_start, &marker);
+  arbiter->after_marker = marker;
+
+  if (au_start && keyframe_start) {
+    g_mutex_lock (&arbiter->lock);
+    arbiter->last_keyframe = g_get_monotonic_time ();
+    g_mutex_unlock (&arbiter->lock);
+
+    gst_buffer_list_unref (arbiter->gop);
+    arbiter->gop = gst_buffer_list_new ();
+  }
+
+  if (arbiter->gop == NULL)
+    return;
+
+  if (gst_buffer_list_length (arbiter->gop) >= KEYFRAME_CACHE_MAX_PACKETS) {
+    gst_buffer_list_unref (arbiter->gop);
+    arbiter->gop = NULL;
+    return;
+  }
+
+  gst_buffer_list_add (arbiter->gop, gst_buffer_ref (buffer));
+}
+
+/* Keeps every packet since the last keyframe, which is all a joining
+ * viewer needs to start decoding right away */
+static GstPadProbeReturn
+keyframe_arbiter_buffer_cb (G_GNUC_UNUSED GstPad * pad,
+    GstPadProbeInfo * info, gpointer user_data)
+{
+  KeyframeArbiter *arbiter = (KeyframeArbiter *) user_data;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+    guint i, len = gst_buffer_list_length (list);
+
+    for (i = 0; i < len; i++)
+      keyframe_arbiter_cache (arbiter, gst_buffer_list_get (list, i));
+  } else {
+    keyframe_arbiter_cache (arbiter, GST_PAD_PROBE_INFO_BUFFER (info));
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Only valid from the tee streaming thread. Returns the cached packets
+ * except for the last @skip ones, or NULL if there is no usable cache */
+static GstBufferList *
+keyframe_arbiter_get_gop (KeyframeArbiter * arbiter, guint skip)
+{
+  GstBufferList *gop;
+  guint i, len;
+
+  if (arbiter->gop == NULL)
+    return NULL;
+
+  len = gst_buffer_list_length (arbiter->gop);
+  if (len <= skip)
+    return NULL;
+
+  gop = gst_buffer_list_new_sized (len - skip);
+  for (i = 0; i < len - skip; i++)
+    gst_buffer_list_add (gop,
+        gst_buffer_ref (gst_buffer_list_get (arbiter->gop, i)));
+
+  return gop;
+}
+
+static void
+keyframe_arbiter_init (KeyframeArbiter * arbiter, GstElement * tee,
+    const gchar * rid)
+{
+  g_mutex_init (&arbiter->lock);
+  arbiter->rid = rid;
+  arbiter->pad = gst_element_get_static_pad (tee, "sink");
+  arbiter->after_marker = TRUE;
+
+  gst_pad_add_probe (arbiter->pad, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM,
+      keyframe_arbiter_event_cb, arbiter, NULL);
+  gst_pad_add_probe (arbiter->pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      keyframe_arbiter_buffer_cb, arbiter, NULL);
+}
+
+static void
+keyframe_arbiter_clear (KeyframeArbiter * arbiter)
+{
+  if (arbiter->deferred_id != 0)
+    g_source_remove (arbiter->deferred_id);
+  if (arbiter->gop != NULL)
+    gst_buffer_list_unref (arbiter->gop);
+  gst_clear_object (&arbiter->pad);
+  g_mutex_clear (&arbiter->lock);
+  memset (arbiter, 0, sizeof (KeyframeArbiter));
+}
+
+static gboolean
+keyframe_stats_cb (G_GNUC_UNUSED gpointer user_data)
+{
+  gint i;
+
+  for (i = 0; i < n_layers; i++) {
+    KeyframeArbiter *arbiter = &keyframe_arbiters[i];
+
+    g_mutex_lock (&arbiter->lock);
+    if (arbiter->requests > 0 || arbiter->cached_joins > 0)
+      EXAMPLE_LOG_INFO ("keyframes", "Layer %s: %" G_GUINT64_FORMAT
+        " requests, %" G_GUINT64_FORMAT " forced, %" G_GUINT64_FORMAT
+        " coalesced, %" G_GUINT64_FORMAT " deferred, %" G_GUINT64_FORMAT
+        " joins served from cache", arbiter->rid, arbiter->requests,
+        arbiter->forced, arbiter->coalesced, arbiter->deferred,
+        arbiter->cached_joins);
+    g_mutex_unlock (&arbiter->lock);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+layer_adaptation_enabled (void)
+{
+  return n_layers > 1 || temporal_layers;
+}
+
+/* The shared payloaders only add the extension, every viewer's RTP session
+ * writes its own transport-wide sequence numbers */
+static void
+add_twcc_extension (GstElement * bin, const gchar * payloader_name)
+{
+  GstElement *payloader;
+  GstRTPHeaderExtension *twcc;
+
+  payloader = gst_bin_get_by_name (GST_BIN (bin), payloader_name);
+  g_assert (payloader != NULL);
+  twcc = gst_rtp_header_extension_create_from_uri (RTP_TWCC_URI);
+  g_assert (twcc != NULL);
+  gst_rtp_header_extension_set_id (twcc, 1);
+  g_signal_emit_by_name (payloader, "add-extension", twcc);
+  g_clear_object (&twcc);
+  gst_object_unref (payloader);
+}
+
+static gboolean
+parse_ice_ports (void)
+{
+  if (ice_ports == NULL)
+    return TRUE;
+
+  if (sscanf (ice_ports, "%u-%u", &ice_min_port, &ice_max_port) != 2
+      || ice_min_port == 0 || ice_min_port > ice_max_port
+      || ice_max_port > 65535) {
+    g_printerr ("--ice-ports takes a range like 50000-50999\n");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Every session still has its own socket, libnice has no way to share one
+ * between agents, but all of them stay within the range */
+static void
+restrict_ice_ports (GstElement * webrtcbin)
+{
+  static gboolean warned = FALSE;
+  GObject *ice;
+
+  if (ice_min_port == 0)
+    return;
+
+  if (!g_object_class_find_property (G_OBJECT_GET_CLASS (webrtcbin),
+          "ice-agent")) {
+    if (!warned)
+      g_warning ("This webrtcbin has no ice-agent property, --ice-ports "
+          "needs GStreamer 1.22");
+    warned = TRUE;
+    return;
+  }
+
+  g_object_get (webrtcbin, "ice-agent", &ice, NULL);
+  g_object_set (ice, "min-rtp-port", ice_min_port, "max-rtp-port",
+      ice_max_port, NULL);
+  g_object_unref (ice);
+}
+
+static gboolean
+select_video_encoder (void)
+{
+  const ExampleEncoder *const *encoders;
+  const gchar *name;
+
+  if (vod_location != NULL) {
+    if (simulcast || temporal_layers || per_viewer_audio || cpu_adapt) {
+      g_printerr ("--vod sends the file as it is, without --simulcast, "
+          "--temporal-layers, --per-viewer-audio or --cpu-adapt\n");
+      return FALSE;
+    }
+    /* Only for the codec, nothing is encoded */
+    video_encoder = example_encoder_find ("x264");
+    EXAMPLE_LOG_INFO ("encoder", "Sending H.264 from %s", vod_location);
+    return TRUE;
+  }
+
+  /* The temporal layer mode relies on vp8enc's GstVP8Meta */
+  if (temporal_layers && encoder_name != NULL
+      && g_strcmp0 (encoder_name, "vp8") != 0) {
+    g_printerr ("--temporal-layers requires the vp8 encoder\n");
+    return FALSE;
+  }
+
+  name = encoder_name ? encoder_name : temporal_layers ? "vp8" : "x264";
+  video_encoder = example_encoder_find (name);
+  if (encoder_preset != NULL
+      && !example_encoder_preset_from_string (encoder_preset,
+          &video_encoder_preset)) {
+    g_printerr ("Unknown encoder preset \"%s\"\n", encoder_preset);
+    return FALSE;
+  }
+  if (cpu_adapt && temporal_layers) {
+    g_printerr ("--cpu-adapt can't change the frame rate of --temporal-layers"
+        "\n");
+    return FALSE;
+  }
+  if (degradation != NULL
+      && !example_degradation_from_string (degradation,
+          &degradation_preference)) {
+    g_printerr ("Unknown degradation preference \"%s\"\n", degradation);
+    return FALSE;
+  }
+
+  if (video_encoder != NULL && example_encoder_available (video_encoder)) {
+    EXAMPLE_LOG_INFO ("encoder", "Encoding video with %s (%s)",
+        video_encoder->factory,
+        example_encoder_preset_to_string (video_encoder_preset));
+    return TRUE;
+  }
+
+  g_printerr ("Encoder \"%s\" is not available, installed encoders:",
+      name);
+  for (encoders = example_encoder_list (); *encoders != NULL; encoders++)
+    if (example_encoder_available (*encoders))
+      g_printerr (" %s", (*encoders)->name);
+  g_printerr ("\n");
+
+  return FALSE;
+}
+
+static gboolean
+vod_loop_cb (G_GNUC_UNUSED gpointer user_data)
+{
+  EXAMPLE_LOG_INFO ("vod-loop", "Restarting %s", vod_location);
+
+  /* Not flushing, so the running time and RTP timestamps carry on */
+  if (!gst_element_send_event (vod_demux, gst_event_new_seek (1.0,
+              GST_FORMAT_TIME, GST_SEEK_FLAG_KEY_UNIT, GST_SEEK_TYPE_SET, 0,
+              GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE)))
+    g_warning ("Could not restart %s", vod_location);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* The file loops without the viewers noticing, EOS never gets past the
+ * queues after the demuxer */
+static GstPadProbeReturn
+vod_eos_probe_cb (G_GNUC_UNUSED GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) != GST_EVENT_EOS)
+    return GST_PAD_PROBE_OK;
+
+  if (GPOINTER_TO_INT (user_data))
+    g_idle_add (vod_loop_cb, NULL);
+
+  return GST_PAD_PROBE_DROP;
+}
+
+static void
+vod_add_eos_probe (const gchar * queue_name, gboolean loop)
+{
+  GstElement *queue = gst_bin_get_by_name (GST_BIN (pipeline), queue_name);
+  GstPad *pad;
+
+  g_assert (queue != NULL);
+  pad = gst_element_get_static_pad (queue, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      vod_eos_probe_cb, GINT_TO_POINTER (loop), NULL);
+  gst_object_unref (pad);
+  gst_object_unref (queue);
+}
+
+/* The access units go to the payloader as they are, clocksync releases
+ * them in real time. Silence is mixed in so there is an audio track even
+ * if the file has none, that is encoded once like the live audio. */
+static void
+vod_describe (GString * description, guint32 ssrc, guint32 timestamp_offset)
+{
+  gchar *lower = g_ascii_strdown (vod_location, -1);
+  gboolean matroska = g_str_has_suffix (lower, ".mkv")
+      || g_str_has_suffix (lower, ".webm");
+
+  g_free (lower);
+  g_string_append_printf (description,
+      "filesrc name=vodsrc ! %s name=vod "
+      "vod.video_0 ! queue name=vodvideoqueue ! h264parse config-interval=-1 ! "
+      "video/x-h264,stream-format=byte-stream,alignment=au ! clocksync ! "
+      "rtph264pay name=payloader_%s config-interval=-1 aggregate-mode=zero-latency ssrc=%u timestamp-offset=%u ! "
+      "application/x-rtp,media=video,encoding-name=H264,payload="
+      RTP_PAYLOAD_TYPE " ! tee name=videotee_%s allow-not-linked=true "
+      "audiotestsrc wave=silence ! audiomixer name=vodmix ! "
+      "audio/x-raw,rate=48000,channels=2 ! audioconvert ! opusenc ! clocksync ! "
+      "rtpopuspay name=audiopayloader pt=" RTP_AUDIO_PAYLOAD_TYPE
+      " ! tee name=audiotee allow-not-linked=true "
+      "vod.audio_0 ! queue name=vodaudioqueue ! decodebin ! audioconvert ! "
+      "audioresample ! vodmix. ", matroska ? "matroskademux" : "qtdemux",
+      layers[0].rid, ssrc, timestamp_offset, layers[0].rid);
+}
+
+/* Captures and encodes once, in every layer */
+static void
+live_describe (GString * description, guint32 ssrc, guint32 timestamp_offset)
+{
+  gint i;
+
+  g_string_append_printf (description, VIDEO_SRC
+      " ! videorate ! video/x-raw,framerate=%d/1 ! videoconvert ! tee name=rawtee ",
+      VIDEO_FRAMERATE);
+  for (i = 0; i < n_layers; i++) {
+    if (cpu_adapt)
+      g_string_append_printf (description,
+          "rawtee. ! queue name=scalequeue_%s max-size-buffers=1 leaky=downstream ! videoscale ! "
+          "videorate drop-only=true ! capsfilter name=scalecaps_%s caps=video/x-raw,width=%d,height=%d ! ",
+          layers[i].rid, layers[i].rid, layers[i].width, layers[i].height);
+    else
+      g_string_append_printf (description,
+          "rawtee. ! queue max-size-buffers=1 leaky=downstream ! videoscale ! video/x-raw,width=%d,height=%d ! ",
+          layers[i].width, layers[i].height);
+    if (temporal_layers) {
+      gint bitrate = layers[i].bitrate * 1000;
+
+      /* vp8enc attaches the temporal layer id of every frame as GstVP8Meta,
+       * rtpvp8pay turns it into the TID field of the payload descriptor */
+      g_string_append_printf (description,
+          "vp8enc name=encoder_%s target-bitrate=%d deadline=1 cpu-used=8 keyframe-max-dist=15 error-resilient=partitions "
+          "temporal-scalability-number-layers=%d temporal-scalability-periodicity=4 "
+          "temporal-scalability-layer-id=\"<0,2,1,2>\" temporal-scalability-rate-decimator=\"<4,2,1>\" "
+          "temporal-scalability-target-bitrate=\"<%d,%d,%d>\" ! queue name=encoderqueue_%s max-size-time=100000000 ! "
+          "rtpvp8pay name=payloader_%s picture-id-mode=15-bit ssrc=%u timestamp-offset=%u ! "
+          "application/x-rtp,media=video,encoding-name=VP8,payload="
+          RTP_PAYLOAD_TYPE " ! ", layers[i].rid, bitrate, TEMPORAL_LAYERS,
+          (gint) (bitrate * temporal_layer_share[0]),
+          (gint) (bitrate * temporal_layer_share[1]),
+          (gint) (bitrate * temporal_layer_share[2]), layers[i].rid,
+          layers[i].rid, ssrc, timestamp_offset);
+    } else {
+      gchar *name = g_strdup_printf ("encoder_%s", layers[i].rid);
+      gchar *encoder = example_encoder_describe (video_encoder,
+          video_encoder_preset, name, layers[i].bitrate, KEYFRAME_INTERVAL);
+
+      g_string_append_printf (description,
+          "%s ! queue name=encoderqueue_%s max-size-time=100000000 ! "
+          "%s name=payloader_%s ssrc=%u timestamp-offset=%u ! "
+          "application/x-rtp,media=video,encoding-name=%s,payload="
+          RTP_PAYLOAD_TYPE " ! ", encoder, layers[i].rid,
+          video_encoder->payloader, layers[i].rid, ssrc, timestamp_offset,
+          video_encoder->encoding_name);
+      g_free (encoder);
+      g_free (name);
+    }
+    if (pacing > 0)
+      g_string_append_printf (description,
+          "queue name=pacerqueue_%s ! ", layers[i].rid);
+    g_string_append_printf (description,
+        "tee name=videotee_%s allow-not-linked=true ", layers[i].rid);
+  }
+  if (per_viewer_audio)
+    g_string_append (description,
+        "autoaudiosrc is-live=1 ! queue max-size-buffers=1 leaky=downstream ! tee name=audiotee allow-not-linked=true ");
+  else
+    g_string_append (description,
+        "autoaudiosrc is-live=1 ! queue max-size-buffers=1 leaky=downstream ! audioconvert ! audioresample ! opusenc ! rtpopuspay name=audiopayloader pt="
+        RTP_AUDIO_PAYLOAD_TYPE " ! tee name=audiotee allow-not-linked=true ");
+
+}
+
+static void
+add_encoder_control_layer (gint i)
+{
+  GstElement *queue, *capsfilter, *encoder;
+  gchar *name;
+
+  name = g_strdup_printf ("scalequeue_%s", layers[i].rid);
+  queue = gst_bin_get_by_name (GST_BIN (pipeline), name);
+  g_free (name);
+  name = g_strdup_printf ("scalecaps_%s", layers[i].rid);
+  capsfilter = gst_bin_get_by_name (GST_BIN (pipeline), name);
+  g_free (name);
+  name = g_strdup_printf ("encoder_%s", layers[i].rid);
+  encoder = gst_bin_get_by_name (GST_BIN (pipeline), name);
+  g_free (name);
+
+  g_assert (queue != NULL && capsfilter != NULL && encoder != NULL);
+  example_encoder_control_add (encoder_control, queue, capsfilter, encoder,
+      layers[i].width, layers[i].height);
+  gst_object_unref (queue);
+  gst_object_unref (capsfilter);
+  gst_object_unref (encoder);
+}
+
+static gboolean
+create_shared_pipeline (void)
+{
+  GError *error = NULL;
+  GString *description;
+  GstBus *bus;
+  guint32 ssrc, timestamp_offset;
+  gint i;
+
+  if (simulcast) {
+    layers = simulcast_layers;
+    n_layers = G_N_ELEMENTS (simulcast_layers);
+  }
+
+  /* All layers share SSRC and RTP timestamps, so a viewer can be moved
+   * between them by only rewriting sequence numbers */
+  ssrc = g_random_int ();
+  timestamp_offset = g_random_int ();
+
+  description = g_string_new (NULL);
+  if (vod_location != NULL)
+    vod_describe (description, ssrc, timestamp_offset);
+  else
+    live_describe (description, ssrc, timestamp_offset);
+
+  pipeline = gst_parse_launch (description->str, &error);
+  g_string_free (description, TRUE);
+  if (error != NULL) {
+    g_printerr ("Could not create shared pipeline: %s\n", error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+
+  for (i = 0; i < n_layers; i++) {
+    gchar *name = g_strdup_printf ("videotee_%s", layers[i].rid);
+
+    video_tees[i] = gst_bin_get_by_name (GST_BIN (pipeline), name);
+    g_assert (video_tees[i] != NULL);
+    keyframe_arbiter_init (&keyframe_arbiters[i], video_tees[i],
+        layers[i].rid);
+    g_free (name);
+
+    name = g_strdup_printf ("payloader_%s", layers[i].rid);
+    add_twcc_extension (pipeline, name);
+    g_free (name);
+  }
+  audio_tee = gst_bin_get_by_name (GST_BIN (pipeline), "audiotee");
+  g_assert (audio_tee != NULL);
+  if (!per_viewer_audio)
+    add_twcc_extension (pipeline, "audiopayloader");
+
+  if (vod_location != NULL) {
+    GstElement *src = gst_bin_get_by_name (GST_BIN (pipeline), "vodsrc");
+
+    g_object_set (src, "location", vod_location, NULL);
+    gst_object_unref (src);
+    vod_demux = gst_bin_get_by_name (GST_BIN (pipeline), "vod");
+    vod_add_eos_probe ("vodvideoqueue", TRUE);
+    vod_add_eos_probe ("vodaudioqueue", FALSE);
+    if (pacing > 0)
+      g_printerr ("The file's bitrate is unknown, not pacing it\n");
+  } else if (!layer_adaptation_enabled ()) {
+    gchar *name = g_strdup_printf ("encoder_%s", layers[0].rid);
+
+    shared_encoder = gst_bin_get_by_name (GST_BIN (pipeline), name);
+    g_assert (shared_encoder != NULL);
+    shared_bitrate = layers[0].bitrate;
+    g_free (name);
+  }
+
+  if (cpu_adapt) {
+    encoder_control = example_encoder_control_new (video_encoder,
+        video_encoder_preset, degradation_preference, VIDEO_FRAMERATE);
+    for (i = 0; i < n_layers; i++)
+      add_encoder_control_layer (i);
+  }
+
+  for (i = 0; vod_location == NULL && pacing > 0 && i < n_layers; i++) {
+    gchar *name = g_strdup_printf ("pacerqueue_%s", layers[i].rid);
+    GstElement *queue = gst_bin_get_by_name (GST_BIN (pipeline), name);
+
+    g_assert (queue != NULL);
+    pacers[i] = example_pacer_new (queue, pacing, MAX (pacing_max_delay, 0));
+    example_pacer_set_bitrate (pacers[i], layers[i].bitrate);
+    gst_object_unref (queue);
+    g_free (name);
+  }
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_bus_add_watch (bus, bus_watch_cb, NULL);
+  gst_object_unref (bus);
+
+  if (gst_element_set_state (pipeline, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_FAILURE) {
+    g_printerr ("Could not start shared pipeline\n");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+destroy_shared_pipeline (void)
+{
+  gint i;
+
+  if (pipeline == NULL)
+    return;
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  g_clear_pointer (&encoder_control, example_encoder_control_free);
+  for (i = 0; i < n_layers; i++) {
+    keyframe_arbiter_clear (&keyframe_arbiters[i]);
+    gst_clear_object (&video_tees[i]);
+    g_clear_pointer (&pacers[i], example_pacer_free);
+  }
+  gst_clear_object (&audio_tee);
+  gst_clear_object (&shared_encoder);
+  gst_clear_object (&vod_demux);
+  gst_clear_object (&pipeline);
+}
+
+/* Only link once @bin is running. An inactive pad returns FLUSHING to the
+ * tee, which passes it upstream and stops the stream for every viewer. */
+static GstPad *
+link_tee_to_bin (GstElement * tee, GstElement * bin, const gchar * name)
+{
+  GstPad *tee_pad, *ghost_pad;
+
+  ghost_pad = gst_element_get_static_pad (bin, name);
+  g_assert (ghost_pad != NULL);
+
+  tee_pad = gst_element_request_pad_simple (tee, "src_%u");
+  if (gst_pad_link (tee_pad, ghost_pad) != GST_PAD_LINK_OK)
+    g_error ("Could not link %s to the shared pipeline", name);
+  gst_object_unref (ghost_pad);
+
+  return tee_pad;
+}
+
+static ReceiverEntry *
+receiver_entry_ref (ReceiverEntry * receiver_entry)
+{
+  g_atomic_int_inc (&receiver_entry->refcount);
+
+  return receiver_entry;
+}
+
+static void
+receiver_entry_unref (gpointer receiver_entry_ptr)
+{
+  ReceiverEntry *receiver_entry = (ReceiverEntry *) receiver_entry_ptr;
+  gint i;
+
+  if (!g_atomic_int_dec_and_test (&receiver_entry->refcount))
+    return;
+
+  for (i = 0; i < n_layers; i++) {
+    gst_clear_object (&receiver_entry->video_tee_pads[i]);
+    gst_clear_object (&receiver_entry->video_selector_pads[i]);
+  }
+  gst_clear_object (&receiver_entry->audio_tee_pad);
+  gst_clear_object (&receiver_entry->video_selector);
+  gst_clear_object (&receiver_entry->webrtcbin);
+  gst_clear_object (&receiver_entry->bin);
+  gst_clear_caps (&receiver_entry->video_caps);
+  g_clear_object (&receiver_entry->rtp_session);
+  g_clear_object (&receiver_entry->connection);
+  if (receiver_entry->worker != NULL)
+    g_atomic_int_add (&receiver_entry->worker->n_receivers, -1);
+  g_free (receiver_entry->stats.local_candidate);
+  g_free (receiver_entry->stats.remote_candidate);
+  g_mutex_clear (&receiver_entry->stats_lock);
+  if (receiver_entry->ice_batch != NULL)
+    json_array_unref (receiver_entry->ice_batch);
+  g_mutex_clear (&receiver_entry->ice_lock);
+
+  g_slice_free1 (sizeof (ReceiverEntry), receiver_entry);
+}
+
+/* NULL is the default main context, which owns the websocket connections */
+static GMainContext *
+receiver_entry_context (ReceiverEntry * receiver_entry)
+{
+  return receiver_entry->worker != NULL ? receiver_entry->worker->context :
+      NULL;
+}
+
+static gboolean
+receiver_call_dispatch (gpointer user_data)
+{
+  ReceiverCall *call = (ReceiverCall *) user_data;
+
+  call->func (call->receiver_entry, call->data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+receiver_call_free (gpointer user_data)
+{
+  ReceiverCall *call = (ReceiverCall *) user_data;
+
+  if (call->data_free != NULL && call->data != NULL)
+    call->data_free (call->data);
+  receiver_entry_unref (call->receiver_entry);
+  g_slice_free (ReceiverCall, call);
+}
+
+/* Runs @func on @context, right away if the calling thread owns it */
+static void
+receiver_entry_call (ReceiverEntry * receiver_entry, GMainContext * context,
+    ReceiverCallFunc func, gpointer data, GDestroyNotify data_free)
+{
+  ReceiverCall *call = g_slice_new (ReceiverCall);
+
+  call->receiver_entry = receiver_entry_ref (receiver_entry);
+  call->func = func;
+  call->data = data;
+  call->data_free = data_free;
+
+  g_main_context_invoke_full (context, G_PRIORITY_DEFAULT,
+      receiver_call_dispatch, call, receiver_call_free);
+}
+
+static void
+send_text_cb (ReceiverEntry * receiver_entry, gpointer data)
+{
+  if (receiver_entry->connection != NULL
+      && soup_websocket_connection_get_state (receiver_entry->connection) ==
+      SOUP_WEBSOCKET_STATE_OPEN)
+    soup_websocket_connection_send_text (receiver_entry->connection,
+        (const gchar *) data);
+}
+
+/* Takes ownership of @json_string, libsoup is not thread-safe so this is
+ * always sent from the default main context */
+static void
+send_to_viewer (ReceiverEntry * receiver_entry, gchar * json_string)
+{
+  receiver_entry_call (receiver_entry, NULL, send_text_cb, json_string,
+      g_free);
+}
+
+static gpointer
+worker_thread (gpointer user_data)
+{
+  Worker *worker = (Worker *) user_data;
+
+  g_main_context_push_thread_default (worker->context);
+  g_main_loop_run (worker->loop);
+  g_main_context_pop_thread_default (worker->context);
+
+  return NULL;
+}
+
+static void
+workers_init (void)
+{
+  gint i;
+
+  if (n_workers <= 0)
+    return;
+
+  workers = g_new0 (Worker, n_workers);
+  for (i = 0; i < n_workers; i++) {
+    Worker *worker = &workers[i];
+    gchar *name = g_strdup_printf ("viewer-worker-%d", i);
+
+    worker->context = g_main_context_new ();
+    worker->loop = g_main_loop_new (worker->context, FALSE);
+    worker->thread = g_thread_new (name, worker_thread, worker);
+    g_free (name);
+  }
+}
+
+static gboolean
+worker_quit_cb (gpointer user_data)
+{
+  g_main_loop_quit ((GMainLoop *) user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Anything already queued on the workers, like removing viewer bins, is
+ * still run before they stop */
+static void
+workers_deinit (void)
+{
+  gint i;
+
+  if (workers == NULL)
+    return;
+
+  for (i = 0; i < n_workers; i++) {
+    Worker *worker = &workers[i];
+
+    g_main_context_invoke (worker->context, worker_quit_cb, worker->loop);
+    g_thread_join (worker->thread);
+    g_main_loop_unref (worker->loop);
+    g_main_context_unref (worker->context);
+  }
+  g_clear_pointer (&workers, g_free);
+}
+
+static Worker *
+workers_pick (void)
+{
+  Worker *worker = NULL;
+  gint i;
+
+  if (workers == NULL)
+    return NULL;
+
+  for (i = 0; i < n_workers; i++) {
+    if (worker == NULL || g_atomic_int_get (&workers[i].n_receivers) <
+        g_atomic_int_get (&worker->n_receivers))
+      worker = &workers[i];
+  }
+  g_atomic_int_inc (&worker->n_receivers);
+
+  return worker;
+}
+
+static GstPadProbeReturn
+layer_probe_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  LayerProbe *probe = (LayerProbe *) user_data;
+  ReceiverEntry *receiver_entry = probe->receiver_entry;
+  GstBuffer *first, *last;
+  gboolean au_start, keyframe_start, marker;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+    guint len = gst_buffer_list_length (list);
+
+    if (len == 0)
+      return GST_PAD_PROBE_OK;
+    first = gst_buffer_list_get (list, 0);
+    last = gst_buffer_list_get (list, len - 1);
+  } else {
+    first = last = GST_PAD_PROBE_INFO_BUFFER (info);
+  }
+
+  au_start = probe->after_marker;
+  parse_rtp_packet (first, &keyframe_start, &marker);
+  if (last != first)
+    parse_rtp_packet (last, NULL, &marker);
+  probe->after_marker = marker;
+
+  /* Layers are only switched at the start of a keyframe of the new one */
+  if (au_start && keyframe_start
+      && probe->layer == g_atomic_int_get (&receiver_entry->target_layer)
+      && probe->layer != g_atomic_int_get (&receiver_entry->current_layer)) {
+    g_object_set (receiver_entry->video_selector, "active-pad", pad, NULL);
+    g_atomic_int_set (&receiver_entry->current_layer, probe->layer);
+    EXAMPLE_LOG_INFO ("layer-switched", "Viewer %p switched to layer %s",
+        (gpointer) receiver_entry, layers[probe->layer].rid);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Sends a joining viewer everything since the last keyframe before its
+ * first live packet, instead of asking the shared encoder for a new one */
+static GstPadProbeReturn
+prime_viewer_cb (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  LayerProbe *probe = (LayerProbe *) user_data;
+  KeyframeArbiter *arbiter = &keyframe_arbiters[probe->layer];
+  GstBufferList *gop;
+  GstBuffer *first;
+  GstPad *target;
+  gboolean keyframe_start, marker;
+  guint len = 1;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+
+    len = gst_buffer_list_length (list);
+    if (len == 0)
+      return GST_PAD_PROBE_OK;
+    first = gst_buffer_list_get (list, 0);
+  } else {
+    first = GST_PAD_PROBE_INFO_BUFFER (info);
+  }
+
+  parse_rtp_packet (first, &keyframe_start, &marker);
+  if (keyframe_start)
+    return GST_PAD_PROBE_REMOVE;
+
+  gop = keyframe_arbiter_get_gop (arbiter, len);
+  if (gop == NULL)
+    return GST_PAD_PROBE_REMOVE;
+
+  target = gst_ghost_pad_get_target (GST_GHOST_PAD (pad));
+  gst_pad_chain_list (target, gop);
+  gst_object_unref (target);
+
+  g_mutex_lock (&arbiter->lock);
+  arbiter->cached_joins++;
+  g_mutex_unlock (&arbiter->lock);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+static void
+rewrite_seqnum (ReceiverEntry * receiver_entry, GstBuffer * buffer)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp))
+    return;
+
+  gst_rtp_buffer_set_seq (&rtp, receiver_entry->next_seqnum++);
+  gst_rtp_buffer_unmap (&rtp);
+}
+
+/* Frames of a temporal layer above what the viewer can take are dropped
+ * whole, the decision is only taken at the first packet of a frame. The
+ * lower layers never reference them and stay decodable */
+static gboolean
+drop_temporal_layer (ReceiverEntry * receiver_entry, GstBuffer * buffer)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  gint tid = -1;
+
+  if (!temporal_layers)
+    return FALSE;
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp))
+    return FALSE;
+  if (receiver_entry->frame_start) {
+    parse_vp8_descriptor (gst_rtp_buffer_get_payload (&rtp),
+        gst_rtp_buffer_get_payload_len (&rtp), &tid);
+    receiver_entry->dropping_frame =
+        tid > g_atomic_int_get (&receiver_entry->max_temporal_layer);
+  }
+  receiver_entry->frame_start = gst_rtp_buffer_get_marker (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  return receiver_entry->dropping_frame;
+}
+
+/* A file only has keyframes where it was encoded with them, a new viewer
+ * starts at the next one instead of with undecodable frames */
+static gboolean
+drop_until_keyframe (ReceiverEntry * receiver_entry, GstBuffer * buffer)
+{
+  gboolean keyframe_start, marker;
+
+  if (vod_location == NULL || receiver_entry->keyframe_seen)
+    return FALSE;
+
+  parse_rtp_packet (buffer, &keyframe_start, &marker);
+  receiver_entry->keyframe_seen = keyframe_start;
+
+  return !keyframe_start;
+}
+
+static void
+rewrite_audio_header (ReceiverEntry * receiver_entry, GstBuffer * buffer)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp))
+    return;
+
+  gst_rtp_buffer_set_ssrc (&rtp, receiver_entry->audio_ssrc);
+  gst_rtp_buffer_set_seq (&rtp, receiver_entry->audio_next_seqnum++);
+  gst_rtp_buffer_unmap (&rtp);
+}
+
+/* Seen after the leaky queue, so packets it drops don't leave gaps. Only
+ * the header is copied for every viewer, the Opus payload stays shared */
+static GstPadProbeReturn
+audio_queue_src_probe_cb (G_GNUC_UNUSED GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+    GstCaps *caps;
+
+    if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS)
+      return GST_PAD_PROBE_OK;
+
+    /* webrtcbin announces the SSRC from the caps in the SDP */
+    gst_event_parse_caps (event, &caps);
+    caps = gst_caps_copy (caps);
+    gst_caps_set_simple (caps, "ssrc", G_TYPE_UINT,
+        receiver_entry->audio_ssrc, NULL);
+    gst_structure_remove_field (gst_caps_get_structure (caps, 0),
+        "seqnum-offset");
+    GST_PAD_PROBE_INFO_DATA (info) = gst_event_new_caps (caps);
+    gst_caps_unref (caps);
+    gst_event_unref (event);
+
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list;
+    guint i, len;
+
+    list = gst_buffer_list_make_writable (GST_PAD_PROBE_INFO_BUFFER_LIST (info));
+    len = gst_buffer_list_length (list);
+    for (i = 0; i < len; i++)
+      rewrite_audio_header (receiver_entry,
+          gst_buffer_list_get_writable (list, i));
+    GST_PAD_PROBE_INFO_DATA (info) = list;
+  } else {
+    GstBuffer *buffer;
+
+    buffer = gst_buffer_make_writable (GST_PAD_PROBE_INFO_BUFFER (info));
+    rewrite_audio_header (receiver_entry, buffer);
+    GST_PAD_PROBE_INFO_DATA (info) = buffer;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+selector_src_probe_cb (G_GNUC_UNUSED GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+    GstCaps *caps;
+
+    if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS)
+      return GST_PAD_PROBE_OK;
+
+    /* Layers only differ in what is sent in-band (SPS/PPS, VP8 frame
+     * headers). Keep webrtcbin on the caps it was negotiated with */
+    if (receiver_entry->video_caps == NULL) {
+      gst_event_parse_caps (event, &caps);
+      receiver_entry->video_caps = gst_caps_ref (caps);
+    } else {
+      GST_PAD_PROBE_INFO_DATA (info) =
+          gst_event_new_caps (receiver_entry->video_caps);
+      gst_event_unref (event);
+    }
+
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list;
+    guint i, len;
+
+    list = gst_buffer_list_make_writable (GST_PAD_PROBE_INFO_BUFFER_LIST (info));
+    len = gst_buffer_list_length (list);
+    for (i = 0; i < len;) {
+      if (drop_until_keyframe (receiver_entry, gst_buffer_list_get (list, i))
+          || drop_temporal_layer (receiver_entry, gst_buffer_list_get (list,
+                  i))) {
+        gst_buffer_list_remove (list, i, 1);
+        len--;
+        continue;
+      }
+      rewrite_seqnum (receiver_entry, gst_buffer_list_get_writable (list, i));
+      i++;
+    }
+    GST_PAD_PROBE_INFO_DATA (info) = list;
+    if (len == 0)
+      return GST_PAD_PROBE_DROP;
+  } else {
+    GstBuffer *buffer;
+
+    if (drop_until_keyframe (receiver_entry, GST_PAD_PROBE_INFO_BUFFER (info))
+        || drop_temporal_layer (receiver_entry,
+            GST_PAD_PROBE_INFO_BUFFER (info)))
+      return GST_PAD_PROBE_DROP;
+
+    buffer = gst_buffer_make_writable (GST_PAD_PROBE_INFO_BUFFER (info));
+    rewrite_seqnum (receiver_entry, buffer);
+    GST_PAD_PROBE_INFO_DATA (info) = buffer;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static gboolean
+set_target_layer (ReceiverEntry * receiver_entry, gint layer)
+{
+  layer = CLAMP (layer, g_atomic_int_get (&receiver_entry->best_layer),
+      n_layers - 1);
+  if (g_atomic_int_get (&receiver_entry->target_layer) == layer)
+    return FALSE;
+
+  g_atomic_int_set (&receiver_entry->target_layer, layer);
+  EXAMPLE_LOG_INFO ("layer-target", "Viewer %p moving to layer %s",
+      (gpointer) receiver_entry, layers[layer].rid);
+
+  /* Don't wait for the next regular keyframe of that layer */
+  if (layer != g_atomic_int_get (&receiver_entry->current_layer))
+    request_keyframe (receiver_entry->video_selector_pads[layer]);
+
+  return TRUE;
+}
+
+static void
+set_max_temporal_layer (ReceiverEntry * receiver_entry, gint tid)
+{
+  g_atomic_int_set (&receiver_entry->max_temporal_layer, tid);
+  EXAMPLE_LOG_INFO ("temporal-layer", "Viewer %p limited to temporal layer %d",
+      (gpointer) receiver_entry, tid);
+}
+
+static gdouble
+layer_cost (gint layer, gint tid)
+{
+  if (!temporal_layers)
+    return layers[layer].bitrate;
+
+  return layers[layer].bitrate * temporal_layer_share[tid];
+}
+
+/* Picks the highest rung of the quality ladder that fits the estimate. The
+ * ladder drops temporal layers first and only then moves to a lower
+ * resolution, rungs that don't add bitrate are skipped. Moving up needs
+ * some headroom so the estimate doesn't flap between two rungs */
+static void
+apply_estimate (ReceiverEntry * receiver_entry)
+{
+  gint n_tids = temporal_layers ? TEMPORAL_LAYERS : 1;
+  gint best = g_atomic_int_get (&receiver_entry->best_layer);
+  gint current_layer = g_atomic_int_get (&receiver_entry->target_layer);
+  gint current_tid =
+      temporal_layers ? g_atomic_int_get (&receiver_entry->max_temporal_layer)
+      : 0;
+  gint layer, tid, chosen_layer = n_layers - 1, chosen_tid = 0;
+  gdouble last_cost = 0.0;
+
+  for (layer = n_layers - 1; layer >= best; layer--) {
+    for (tid = 0; tid < n_tids; tid++) {
+      gdouble cost = layer_cost (layer, tid);
+      gboolean up = layer < current_layer || (layer == current_layer
+          && tid > current_tid);
+
+      if (cost <= last_cost)
+        continue;
+      last_cost = cost;
+
+      if (cost * (up ? BWE_UP_HEADROOM : 1.0) <= receiver_entry->estimate) {
+        chosen_layer = layer;
+        chosen_tid = tid;
+      }
+    }
+  }
+
+  set_target_layer (receiver_entry, chosen_layer);
+  if (temporal_layers && chosen_tid != current_tid)
+    set_max_temporal_layer (receiver_entry, chosen_tid);
+}
+
+/* Delay based backoff to what actually got through, loss based backoff
+ * proportional to the loss and a smooth multiplicative ramp up otherwise,
+ * which is capped by what the viewer received */
+static void
+update_estimate (ReceiverEntry * receiver_entry, gdouble loss,
+    GstClockTimeDiff delay_gradient, gdouble received)
+{
+  gdouble estimate = receiver_entry->estimate;
+  gdouble max_bitrate = layer_cost (0, temporal_layers ? TEMPORAL_LAYERS - 1 :
+      0);
+
+  if (delay_gradient > BWE_OVERUSE_DELTA) {
+    estimate = received > 0.0 ? MIN (estimate,
+        received * BWE_OVERUSE_BACKOFF) : estimate * BWE_OVERUSE_BACKOFF;
+  } else if (loss > BWE_LOSS_HIGH) {
+    estimate *= 1.0 - loss / 2.0;
+  } else if (loss < BWE_LOSS_LOW) {
+    estimate *= BWE_RAMP_UP;
+    if (received > 0.0)
+      estimate = MAX (receiver_entry->estimate, MIN (estimate, received * 2.0));
+  }
+
+  estimate = CLAMP (estimate, BWE_MIN_BITRATE, max_bitrate * 1.2);
+  if ((gint) estimate != (gint) receiver_entry->estimate)
+    EXAMPLE_LOG_DEBUG ("bwe", "Viewer %p estimate %d kbit/s (loss %.3f, "
+        "delay gradient %" G_GINT64_FORMAT " us, received %d kbit/s)",
+        (gpointer) receiver_entry, (gint) estimate, loss,
+        (gint64) (delay_gradient / GST_USECOND), (gint) received);
+  receiver_entry->estimate = estimate;
+}
+
+static void
+set_fec_percentage (ReceiverEntry * receiver_entry, gint percentage)
+{
+  GstWebRTCRTPTransceiver *trans = NULL;
+
+  /* webrtcbin hands the transceiver setting on to its FEC encoder */
+  g_signal_emit_by_name (receiver_entry->webrtcbin, "get-transceiver", 0,
+      &trans);
+  if (trans == NULL)
+    return;
+  g_object_set (trans, "fec-percentage", percentage, NULL);
+  gst_object_unref (trans);
+
+  EXAMPLE_LOG_INFO ("protection", "Viewer %p FEC %d%% (loss %.3f)",
+      (gpointer) receiver_entry, percentage, receiver_entry->protection_loss);
+  receiver_entry->fec_percentage = percentage;
+}
+
+/* Clean links send no FEC at all. Moderate loss on a short round trip is
+ * left to NACK/RTX, the retransmission arrives before the frame is due.
+ * Otherwise FEC is sized at twice the loss, raised at once and lowered only
+ * after PROTECTION_HOLD intervals that would all allow it */
+static void
+update_protection (ReceiverEntry * receiver_entry, gdouble loss)
+{
+  gdouble rtt;
+  gint target;
+
+  if (!protection)
+    return;
+
+  if (receiver_entry->protection_loss < 0)
+    receiver_entry->protection_loss = loss;
+  else
+    receiver_entry->protection_loss =
+        0.7 * receiver_entry->protection_loss + 0.3 * loss;
+  loss = receiver_entry->protection_loss;
+
+  g_mutex_lock (&receiver_entry->stats_lock);
+  rtt = receiver_entry->stats.round_trip_time;
+  g_mutex_unlock (&receiver_entry->stats_lock);
+
+  if (loss < PROTECTION_LOSS_LOW)
+    target = 0;
+  else if (loss < PROTECTION_RTX_MAX_LOSS && rtt < PROTECTION_RTX_MAX_RTT)
+    target = 0;
+  else
+    target = CLAMP ((gint) (loss * 40 + 0.99) * 5, 5, PROTECTION_FEC_MAX);
+
+  if (target > receiver_entry->fec_percentage) {
+    receiver_entry->fec_hold = 0;
+    set_fec_percentage (receiver_entry, target);
+  } else if (target < receiver_entry->fec_percentage) {
+    if (++receiver_entry->fec_hold >= PROTECTION_HOLD) {
+      receiver_entry->fec_hold = 0;
+      set_fec_percentage (receiver_entry, target);
+    }
+  } else {
+    receiver_entry->fec_hold = 0;
+  }
+}
+
+static gboolean
+find_remote_inbound_loss (G_GNUC_UNUSED GQuark field_id, const GValue * value,
+    gpointer user_data)
+{
+  gdouble *fraction_lost = (gdouble *) user_data;
+  const GstStructure *stat;
+  GstWebRTCStatsType type;
+
+  if (!GST_VALUE_HOLDS_STRUCTURE (value))
+    return TRUE;
+
+  stat = gst_value_get_structure (value);
+  if (gst_structure_get (stat, "type", GST_TYPE_WEBRTC_STATS_TYPE, &type, NULL)
+      && type == GST_WEBRTC_STATS_REMOTE_INBOUND_RTP)
+    gst_structure_get_double (stat, "fraction-lost", fraction_lost);
+
+  return TRUE;
+}
+
+static void
+on_video_stats_cb (GstPromise * promise, gpointer user_data)
+{
+  ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
+  gdouble fraction_lost = -1.0;
+
+  if (gst_promise_wait (promise) != GST_PROMISE_RESULT_REPLIED)
+    return;
+
+  gst_structure_foreach (gst_promise_get_reply (promise),
+      find_remote_inbound_loss, &fraction_lost);
+  if (fraction_lost >= 0.0)
+    g_atomic_int_set (&receiver_entry->rr_loss, (gint) (fraction_lost * 1000));
+}
+
+static void
+request_video_stats (ReceiverEntry * receiver_entry)
+{
+  GstPromise *promise;
+  GstPad *pad;
+
+  pad = gst_element_get_static_pad (receiver_entry->webrtcbin, "sink_0");
+  if (pad == NULL)
+    return;
+
+  promise = gst_promise_new_with_change_func (on_video_stats_cb,
+      receiver_entry_ref (receiver_entry), receiver_entry_unref);
+  g_signal_emit_by_name (receiver_entry->webrtcbin, "get-stats", pad, promise);
+  gst_promise_unref (promise);
+  gst_object_unref (pad);
+}
+
+static void
+poll_estimate (ReceiverEntry * receiver_entry)
+{
+  GstStructure *twcc_stats = NULL;
+  guint bitrate_recv;
+  gdouble loss_pct = 0.0;
+  gint64 delay_gradient = 0;
+  gint rr_loss;
+
+  /* Sessions only exist once negotiation is done, video is session 0 */
+  if (receiver_entry->rtp_session == NULL) {
+    GstElement *rtpbin;
+
+    rtpbin = gst_bin_get_by_name (GST_BIN (receiver_entry->webrtcbin),
+        "rtpbin");
+    if (rtpbin != NULL) {
+      g_signal_emit_by_name (rtpbin, "get-internal-session", 0,
+          &receiver_entry->rtp_session);
+      gst_object_unref (rtpbin);
+    }
+  }
+  if (receiver_entry->rtp_session != NULL)
+    g_object_get (receiver_entry->rtp_session, "twcc-stats", &twcc_stats,
+        NULL);
+
+  if (twcc_stats != NULL
+      && gst_structure_get_uint (twcc_stats, "bitrate-recv", &bitrate_recv)) {
+    gst_structure_get_double (twcc_stats, "packet-loss-pct", &loss_pct);
+    gst_structure_get_int64 (twcc_stats, "avg-delta-of-delta",
+        &delay_gradient);
+    update_estimate (receiver_entry, loss_pct / 100.0, delay_gradient,
+        bitrate_recv / 1000.0);
+    update_protection (receiver_entry, loss_pct / 100.0);
+  } else {
+    rr_loss = g_atomic_int_get (&receiver_entry->rr_loss);
+    if (rr_loss >= 0) {
+      update_estimate (receiver_entry, rr_loss / 1000.0, 0, 0.0);
+      update_protection (receiver_entry, rr_loss / 1000.0);
+    }
+    request_video_stats (receiver_entry);
+  }
+
+  if (twcc_stats != NULL)
+    gst_structure_free (twcc_stats);
+}
+
+static void
+set_shared_bitrate (gdouble estimate)
+{
+  gint bitrate = CLAMP ((gint) estimate, layers[0].bitrate / 4,
+      layers[0].bitrate);
+
+  /* Reconfiguring the encoder isn't free, ignore small changes */
+  if (ABS (bitrate - shared_bitrate) < shared_bitrate / 20)
+    return;
+
+  shared_bitrate = bitrate;
+  example_encoder_set_bitrate (video_encoder, shared_encoder, bitrate);
+  if (pacers[0] != NULL)
+    example_pacer_set_bitrate (pacers[0], bitrate);
+  EXAMPLE_LOG_INFO ("shared-bitrate", "Shared encoder at %d kbit/s", bitrate);
+}
+
+static gboolean
+encoder_control_timeout_cb (G_GNUC_UNUSED gpointer user_data)
+{
+  example_encoder_control_update (encoder_control);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+bwe_timeout_cb (G_GNUC_UNUSED gpointer user_data)
+{
+  gdouble lowest = G_MAXDOUBLE;
+  GList *l;
+
+  for (l = receivers.head; l != NULL; l = l->next) {
+    ReceiverEntry *receiver_entry = (ReceiverEntry *) l->data;
+
+    poll_estimate (receiver_entry);
+    if (layer_adaptation_enabled ())
+      apply_estimate (receiver_entry);
+    lowest = MIN (lowest, receiver_entry->estimate);
+  }
+
+  if (shared_encoder != NULL && receivers.length > 0)
+    set_shared_bitrate (lowest);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static guint64
+get_counter (const GstStructure * structure, const gchar * fieldname)
+{
+  const GValue *value = gst_structure_get_value (structure, fieldname);
+  GValue counter = G_VALUE_INIT;
+  guint64 result = 0;
+
+  g_value_init (&counter, G_TYPE_UINT64);
+  if (value != NULL && g_value_transform (value, &counter))
+    result = g_value_get_uint64 (&counter);
+  g_value_unset (&counter);
+
+  return result;
+}
+
+static gchar *
+describe_candidate (const GstStructure * reply, const gchar * id)
+{
+  const GValue *value;
+  const GstStructure *candidate;
+
+  if (id == NULL || (value = gst_structure_get_value (reply, id)) == NULL
+      || !GST_VALUE_HOLDS_STRUCTURE (value))
+    return NULL;
+
+  candidate = gst_value_get_structure (value);
+  return g_strdup_printf ("%s %s:%" G_GUINT64_FORMAT,
+      gst_structure_get_string (candidate, "candidate-type"),
+      gst_structure_get_string (candidate, "address"),
+      get_counter (candidate, "port"));
+}
+
+typedef struct
+{
+  ViewerStats stats;
+  const gchar *local_candidate_id;
+  const gchar *remote_candidate_id;
+} StatsCollector;
+
+static gboolean
+collect_viewer_stats (G_GNUC_UNUSED GQuark field_id, const GValue * value,
+    gpointer user_data)
+{
+  StatsCollector *collector = (StatsCollector *) user_data;
+  const GstStructure *stat;
+  GstWebRTCStatsType type;
+  gdouble round_trip_time;
+
+  if (!GST_VALUE_HOLDS_STRUCTURE (value))
+    return TRUE;
+
+  stat = gst_value_get_structure (value);
+  if (!gst_structure_get (stat, "type", GST_TYPE_WEBRTC_STATS_TYPE, &type,
+          NULL))
+    return TRUE;
+
+  switch (type) {
+    case GST_WEBRTC_STATS_OUTBOUND_RTP:
+      collector->stats.bytes_sent += get_counter (stat, "bytes-sent");
+      collector->stats.nack_count += get_counter (stat, "nack-count");
+      collector->stats.pli_count += get_counter (stat, "pli-count");
+      collector->stats.fir_count += get_counter (stat, "fir-count");
+      break;
+    case GST_WEBRTC_STATS_REMOTE_INBOUND_RTP:
+      collector->stats.packets_lost += get_counter (stat, "packets-lost");
+      if (gst_structure_get_double (stat, "round-trip-time", &round_trip_time))
+        collector->stats.round_trip_time =
+            MAX (collector->stats.round_trip_time, round_trip_time);
+      break;
+    case GST_WEBRTC_STATS_CANDIDATE_PAIR:
+      collector->local_candidate_id =
+          gst_structure_get_string (stat, "local-candidate-id");
+      collector->remote_candidate_id =
+          gst_structure_get_string (stat, "remote-candidate-id");
+      break;
+    default:
+      break;
+  }
+
+  return TRUE;
+}
+
+static void
+on_viewer_stats_cb (GstPromise * promise, gpointer user_data)
+{
+  ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
+  StatsCollector collector = { {0,}, };
+  const GstStructure *reply;
+  ViewerStats *stats = &receiver_entry->stats;
+  gint64 elapsed;
+
+  if (gst_promise_wait (promise) != GST_PROMISE_RESULT_REPLIED)
+    return;
+
+  reply = gst_promise_get_reply (promise);
+  gst_structure_foreach (reply, collect_viewer_stats, &collector);
+  collector.stats.timestamp = g_get_monotonic_time ();
+  collector.stats.local_candidate =
+      describe_candidate (reply, collector.local_candidate_id);
+  collector.stats.remote_candidate =
+      describe_candidate (reply, collector.remote_candidate_id);
+
+  g_mutex_lock (&receiver_entry->stats_lock);
+  elapsed = collector.stats.timestamp - stats->timestamp;
+  if (stats->timestamp > 0 && elapsed > 0
+      && collector.stats.bytes_sent >= stats->bytes_sent)
+    collector.stats.bitrate =
+        (collector.stats.bytes_sent - stats->bytes_sent) * 8.0 * 1000.0 /
+        elapsed;
+  g_free (stats->local_candidate);
+  g_free (stats->remote_candidate);
+  *stats = collector.stats;
+  g_mutex_unlock (&receiver_entry->stats_lock);
+}
+
+/* Polls a slice of the viewers on every call so that each one is polled
+ * once per STATS_INTERVAL, however often /stats is read */
+static gboolean
+stats_timeout_cb (G_GNUC_UNUSED gpointer user_data)
+{
+  guint slices = STATS_INTERVAL * 1000 / STATS_SLICE;
+  guint i, count = (receivers.length + slices - 1) / slices;
+
+  for (i = 0; i < count; i++) {
+    ReceiverEntry *receiver_entry = g_queue_pop_head (&receivers);
+    GstPromise *promise;
+
+    g_queue_push_tail (&receivers, receiver_entry);
+
+    promise = gst_promise_new_with_change_func (on_viewer_stats_cb,
+        receiver_entry_ref (receiver_entry), receiver_entry_unref);
+    g_signal_emit_by_name (receiver_entry->webrtcbin, "get-stats", NULL,
+        promise);
+    gst_promise_unref (promise);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+set_queue_level (JsonObject * object, GstElement * bin, const gchar * name)
+{
+  GstElement *queue = gst_bin_get_by_name (GST_BIN (bin), name);
+  guint64 level_time = 0;
+  guint level_buffers = 0;
+
+  if (queue == NULL)
+    return;
+
+  g_object_get (queue, "current-level-time", &level_time,
+      "current-level-buffers", &level_buffers, NULL);
+  gst_object_unref (queue);
+
+  json_object_set_double_member (object, "level-ms",
+      (gdouble) level_time / GST_MSECOND);
+  json_object_set_int_member (object, "level-buffers", level_buffers);
+}
+
+static JsonObject *
+get_viewer_stats_json (ReceiverEntry * receiver_entry, ViewerStats * totals)
+{
+  JsonObject *viewer_json, *queue_json;
+  ViewerStats *stats = &receiver_entry->stats;
+
+  viewer_json = json_object_new ();
+  json_object_set_int_member (viewer_json, "id", receiver_entry->id);
+  if (receiver_entry->worker != NULL)
+    json_object_set_int_member (viewer_json, "worker",
+        receiver_entry->worker - workers);
+  json_object_set_string_member (viewer_json, "layer",
+      layers[g_atomic_int_get (&receiver_entry->current_layer)].rid);
+  if (temporal_layers)
+    json_object_set_int_member (viewer_json, "temporal-layer",
+        g_atomic_int_get (&receiver_entry->max_temporal_layer));
+  json_object_set_int_member (viewer_json, "estimate-kbps",
+      (gint64) receiver_entry->estimate);
+  if (protection)
+    json_object_set_int_member (viewer_json, "fec-percentage",
+        receiver_entry->fec_percentage);
+
+  g_mutex_lock (&receiver_entry->stats_lock);
+  json_object_set_int_member (viewer_json, "bitrate-kbps",
+      (gint64) stats->bitrate);
+  json_object_set_int_member (viewer_json, "packets-lost", stats->packets_lost);
+  json_object_set_double_member (viewer_json, "round-trip-time-ms",
+      stats->round_trip_time * 1000.0);
+  json_object_set_int_member (viewer_json, "nack-count", stats->nack_count);
+  json_object_set_int_member (viewer_json, "pli-count", stats->pli_count);
+  json_object_set_int_member (viewer_json, "fir-count", stats->fir_count);
+  if (stats->local_candidate != NULL)
+    json_object_set_string_member (viewer_json, "local-candidate",
+        stats->local_candidate);
+  if (stats->remote_candidate != NULL)
+    json_object_set_string_member (viewer_json, "remote-candidate",
+        stats->remote_candidate);
+  if (stats->timestamp > 0)
+    json_object_set_double_member (viewer_json, "age-s",
+        (gdouble) (g_get_monotonic_time () - stats->timestamp) /
+        G_USEC_PER_SEC);
+
+  totals->bitrate += stats->bitrate;
+  totals->packets_lost += stats->packets_lost;
+  totals->nack_count += stats->nack_count;
+  totals->pli_count += stats->pli_count;
+  totals->fir_count += stats->fir_count;
+  g_mutex_unlock (&receiver_entry->stats_lock);
+
+  queue_json = json_object_new ();
+  set_queue_level (queue_json, receiver_entry->bin, "videoqueue");
+  json_object_set_object_member (viewer_json, "video-queue", queue_json);
+  queue_json = json_object_new ();
+  set_queue_level (queue_json, receiver_entry->bin, "audioqueue");
+  json_object_set_object_member (viewer_json, "audio-queue", queue_json);
+
+  return viewer_json;
+}
+
+static JsonObject *
+get_teardown_stats_json (void)
+{
+  TeardownStats *stats = &teardown_stats;
+  JsonObject *teardown_json = json_object_new ();
+
+  g_mutex_lock (&stats->lock);
+  json_object_set_int_member (teardown_json, "count", stats->count);
+  json_object_set_int_member (teardown_json, "synchronous",
+      stats->synchronous);
+  json_object_set_int_member (teardown_json, "queued",
+      reaper != NULL ? g_thread_pool_unprocessed (reaper) : 0);
+  json_object_set_double_member (teardown_json, "latency-avg-ms",
+      stats->count > 0 ? stats->latency_sum / 1000.0 / stats->count : 0);
+  json_object_set_double_member (teardown_json, "latency-max-ms",
+      stats->latency_max / 1000.0);
+  json_object_set_double_member (teardown_json, "stop-avg-ms",
+      stats->count > 0 ? stats->stop_sum / 1000.0 / stats->count : 0);
+  json_object_set_double_member (teardown_json, "stop-max-ms",
+      stats->stop_max / 1000.0);
+  g_mutex_unlock (&stats->lock);
+
+  return teardown_json;
+}
+
+#ifdef G_OS_UNIX
+/* Open sockets and resident memory, what each session costs besides CPU.
+ * Needs /proc, left out where there is none */
+static void
+add_process_usage (JsonObject * totals_json)
+{
+  GDir *dir;
+  const gchar *name;
+  gchar *path, *target, *statm;
+  gint64 sockets = 0, resident;
+
+  if ((dir = g_dir_open ("/proc/self/fd", 0, NULL))) {
+    while ((name = g_dir_read_name (dir))) {
+      path = g_build_filename ("/proc/self/fd", name, NULL);
+      target = g_file_read_link (path, NULL);
+      if (target != NULL && g_str_has_prefix (target, "socket:"))
+        sockets++;
+      g_free (target);
+      g_free (path);
+    }
+    g_dir_close (dir);
+    json_object_set_int_member (totals_json, "sockets", sockets);
+  }
+
+  if (g_file_get_contents ("/proc/self/statm", &statm, NULL, NULL)) {
+    if (sscanf (statm, "%*d %" G_GINT64_FORMAT, &resident) == 1)
+      json_object_set_int_member (totals_json, "rss-kb",
+          resident * sysconf (_SC_PAGESIZE) / 1024);
+    g_free (statm);
+  }
+}
+#endif
+
+static JsonObject *
+get_encoder_control_json (void)
+{
+  JsonObject *control_json = json_object_new ();
+  ExampleEncoderControlStats stats;
+
+  example_encoder_control_get_stats (encoder_control, &stats);
+  json_object_set_string_member (control_json, "degradation-preference",
+      example_degradation_to_string (degradation_preference));
+  json_object_set_string_member (control_json, "preset",
+      example_encoder_preset_to_string (stats.preset));
+  json_object_set_double_member (control_json, "scale", stats.scale);
+  json_object_set_double_member (control_json, "framerate", stats.framerate);
+  json_object_set_double_member (control_json, "load", stats.load);
+  json_object_set_double_member (control_json, "drop-ratio",
+      stats.drop_ratio);
+  json_object_set_int_member (control_json, "frames-dropped", stats.dropped);
+  json_object_set_int_member (control_json, "frames-late", stats.late);
+  json_object_set_int_member (control_json, "changes", stats.changes);
+
+  return control_json;
+}
+
+static JsonObject *
+get_server_stats_json (void)
+{
+  JsonObject *stats_json, *totals_json, *layers_json;
+  JsonArray *viewers_json;
+  ViewerStats totals = { 0, };
+  GList *l;
+  gint i;
+
+  stats_json = json_object_new ();
+
+  viewers_json = json_array_new ();
+  for (l = receivers.head; l != NULL; l = l->next)
+    json_array_add_object_element (viewers_json,
+        get_viewer_stats_json ((ReceiverEntry *) l->data, &totals));
+
+  totals_json = json_object_new ();
+  json_object_set_int_member (totals_json, "viewers", receivers.length);
+  json_object_set_string_member (totals_json, "encoder",
+      vod_location != NULL ? "none" : video_encoder->name);
+  json_object_set_string_member (totals_json, "audio",
+      per_viewer_audio ? "per-viewer" : "shared");
+  json_object_set_int_member (totals_json, "bitrate-kbps",
+      (gint64) totals.bitrate);
+  json_object_set_int_member (totals_json, "packets-lost", totals.packets_lost);
+  json_object_set_int_member (totals_json, "nack-count", totals.nack_count);
+  json_object_set_int_member (totals_json, "pli-count", totals.pli_count);
+  json_object_set_int_member (totals_json, "fir-count", totals.fir_count);
+  if (shared_encoder != NULL)
+    json_object_set_int_member (totals_json, "shared-bitrate-kbps",
+        shared_bitrate);
+  if (encoder_control != NULL)
+    json_object_set_object_member (totals_json, "encoder-control",
+        get_encoder_control_json ());
+  json_object_set_object_member (totals_json, "teardown",
+      get_teardown_stats_json ());
+  if (dtls_pool != NULL) {
+    JsonObject *dtls_json = json_object_new ();
+    guint size, rotations;
+    guint64 assigned;
+
+    example_dtls_pool_get_stats (dtls_pool, &size, &rotations, &assigned);
+    json_object_set_int_member (dtls_json, "certificates", size);
+    json_object_set_int_member (dtls_json, "rotations", rotations);
+    json_object_set_int_member (dtls_json, "assigned", assigned);
+    json_object_set_object_member (totals_json, "dtls", dtls_json);
+  }
+#ifdef G_OS_UNIX
+  {
+    struct rusage usage;
+
+    /* Lets load generators on the same machine report server load */
+    if (getrusage (RUSAGE_SELF, &usage) == 0)
+      json_object_set_double_member (totals_json, "cpu-seconds",
+          usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+          usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6);
+  }
+  add_process_usage (totals_json);
+#endif
+  json_object_set_object_member (stats_json, "totals", totals_json);
+
+  layers_json = json_object_new ();
+  for (i = 0; i < n_layers; i++) {
+    KeyframeArbiter *arbiter = &keyframe_arbiters[i];
+    JsonObject *layer_json = json_object_new ();
+    gchar *name = g_strdup_printf ("encoderqueue_%s", layers[i].rid);
+
+    set_queue_level (layer_json, pipeline, name);
+    g_free (name);
+
+    g_mutex_lock (&arbiter->lock);
+    json_object_set_int_member (layer_json, "keyframe-requests",
+        arbiter->requests);
+    json_object_set_int_member (layer_json, "keyframes-forced",
+        arbiter->forced);
+    json_object_set_int_member (layer_json, "keyframe-requests-coalesced",
+        arbiter->coalesced);
+    json_object_set_int_member (layer_json, "keyframe-requests-deferred",
+        arbiter->deferred);
+    json_object_set_int_member (layer_json, "joins-from-cache",
+        arbiter->cached_joins);
+    g_mutex_unlock (&arbiter->lock);
+
+    if (pacers[i] != NULL) {
+      JsonObject *pacing_json = json_object_new ();
+      ExamplePacerStats pacer_stats;
+
+      example_pacer_get_stats (pacers[i], &pacer_stats);
+      json_object_set_int_member (pacing_json, "packets", pacer_stats.packets);
+      json_object_set_int_member (pacing_json, "delayed", pacer_stats.delayed);
+      json_object_set_int_member (pacing_json, "overflows",
+          pacer_stats.overflows);
+      json_object_set_double_member (pacing_json, "delay-avg-ms",
+          pacer_stats.delay_avg_ms);
+      json_object_set_double_member (pacing_json, "delay-max-ms",
+          pacer_stats.delay_max_ms);
+      json_object_set_object_member (layer_json, "pacing", pacing_json);
+    }
+
+    json_object_set_object_member (layers_json, layers[i].rid, layer_json);
+  }
+  json_object_set_object_member (stats_json, "layers", layers_json);
+  json_object_set_array_member (stats_json, "viewers", viewers_json);
+
+  return stats_json;
+}
+
+static void
+send_layers (ReceiverEntry * receiver_entry)
+{
+  JsonObject *layers_json;
+  JsonArray *layers_data_json;
+  gchar *json_string;
+  gint i;
+
+  layers_json = json_object_new ();
+  json_object_set_string_member (layers_json, "type", "layers");
+
+  layers_data_json = json_array_new ();
+  for (i = 0; i < n_layers; i++) {
+    JsonObject *layer_json = json_object_new ();
+
+    json_object_set_string_member (layer_json, "rid", layers[i].rid);
+    json_object_set_int_member (layer_json, "width", layers[i].width);
+    json_object_set_int_member (layer_json, "height", layers[i].height);
+    json_object_set_int_member (layer_json, "bitrate", layers[i].bitrate);
+    json_array_add_object_element (layers_data_json, layer_json);
+  }
+  json_object_set_array_member (layers_json, "data", layers_data_json);
+
+  json_string = get_string_from_json_object (layers_json);
+  json_object_unref (layers_json);
+
+  send_to_viewer (receiver_entry, json_string);
+}
+
+/* Exposes the layer and audio inputs of the bin, the tees are linked to
+ * them by link_receiver_entry() once it runs */
+static void
+prepare_receiver_entry (ReceiverEntry * receiver_entry)
+{
+  GstPadProbeType probe_type;
+  GstElement *queue;
+  GstPad *pad;
+  gint i;
+
+  receiver_entry->video_selector =
+      gst_bin_get_by_name (GST_BIN (receiver_entry->bin), "videoselector");
+  g_assert (receiver_entry->video_selector != NULL);
+
+  for (i = 0; i < n_layers; i++) {
+    LayerProbe *probe = &receiver_entry->layer_probes[i];
+    gchar *name = g_strdup_printf ("video_%s", layers[i].rid);
+
+    pad = gst_element_request_pad_simple (receiver_entry->video_selector,
+        "sink_%u");
+    probe->receiver_entry = receiver_entry;
+    probe->layer = i;
+    probe->after_marker = TRUE;
+    if (n_layers > 1) {
+      gst_pad_add_probe (pad,
+          GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+          layer_probe_cb, probe, NULL);
+    }
+    receiver_entry->video_selector_pads[i] = pad;
+    gst_element_add_pad (receiver_entry->bin, gst_ghost_pad_new (name, pad));
+    g_free (name);
+  }
+  g_object_set (receiver_entry->video_selector, "active-pad",
+      receiver_entry->video_selector_pads[receiver_entry->current_layer], NULL);
+
+  /* Packets dropped before the first keyframe of a file are taken out
+   * before the seqnums are rewritten, so the viewer sees no gap */
+  probe_type = GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM;
+  if (layer_adaptation_enabled () || vod_location != NULL)
+    probe_type |= GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST;
+  pad = gst_element_get_static_pad (receiver_entry->video_selector, "src");
+  gst_pad_add_probe (pad, probe_type, selector_src_probe_cb, receiver_entry,
+      NULL);
+  gst_object_unref (pad);
+
+  queue = gst_bin_get_by_name (GST_BIN (receiver_entry->bin), "audioqueue");
+  g_assert (queue != NULL);
+  if (!per_viewer_audio) {
+    pad = gst_element_get_static_pad (queue, "src");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM |
+        GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+        audio_queue_src_probe_cb, receiver_entry, NULL);
+    gst_object_unref (pad);
+    pad = gst_element_get_static_pad (queue, "sink");
+  } else {
+    GstElement *convert = gst_bin_get_by_name (GST_BIN (receiver_entry->bin),
+        "audioconvert");
+
+    pad = gst_element_get_static_pad (convert, "sink");
+    gst_object_unref (convert);
+  }
+  gst_element_add_pad (receiver_entry->bin, gst_ghost_pad_new ("audio", pad));
+  gst_object_unref (pad);
+  gst_object_unref (queue);
+}
+
+static void
+link_receiver_entry (ReceiverEntry * receiver_entry)
+{
+  gint i;
+
+  for (i = 0; i < n_layers; i++) {
+    gchar *name = g_strdup_printf ("video_%s", layers[i].rid);
+
+    if (i == receiver_entry->current_layer) {
+      GstPad *ghost_pad = gst_element_get_static_pad (receiver_entry->bin,
+          name);
+
+      gst_pad_add_probe (ghost_pad,
+          GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+          prime_viewer_cb, &receiver_entry->layer_probes[i], NULL);
+      gst_object_unref (ghost_pad);
+    }
+    receiver_entry->video_tee_pads[i] =
+        link_tee_to_bin (video_tees[i], receiver_entry->bin, name);
+    g_free (name);
+  }
+  receiver_entry->audio_tee_pad =
+      link_tee_to_bin (audio_tee, receiver_entry->bin, "audio");
+}
+
+static GstElement *
+create_webrtc_bin (void)
+{
+  GError *error = NULL;
+  GstElement *bin, *webrtcbin;
+  GstWebRTCRTPTransceiver *trans;
+  gchar *description;
+  GArray *transceivers;
+
+  /* --per-viewer-audio keeps the old layout of one Opus encoder per viewer,
+   * only to measure what sharing it saves */
+  description = g_strdup_printf ("webrtcbin name=webrtcbin %s%s "
+      "input-selector name=videoselector sync-streams=false ! "
+      "queue name=videoqueue leaky=downstream max-size-buffers=0 max-size-bytes=0 max-size-time=100000000 ! webrtcbin. "
+      "%s queue name=audioqueue leaky=downstream max-size-buffers=0 max-size-bytes=0 max-size-time=100000000 ! webrtcbin. ",
+      host_only ? "" : "stun-server=stun://" STUN_SERVER,
+      ice_min_port > 0 ? " bundle-policy=max-bundle" : "",
+      per_viewer_audio ? "audioconvert name=audioconvert ! audioresample ! "
+      "opusenc ! rtpopuspay name=audiopayloader pt=" RTP_AUDIO_PAYLOAD_TYPE
+      " ! " : "");
+  bin = gst_parse_bin_from_description (description, FALSE, &error);
+  g_free (description);
+  if (error != NULL) {
+    g_warning ("Could not create WebRTC bin: %s", error->message);
+    g_error_free (error);
+    return NULL;
+  }
+  gst_object_ref_sink (bin);
+  if (per_viewer_audio)
+    add_twcc_extension (bin, "audiopayloader");
+
+  webrtcbin = gst_bin_get_by_name (GST_BIN (bin), "webrtcbin");
+  g_assert (webrtcbin != NULL);
+  if (dtls_pool != NULL)
+    example_dtls_pool_attach (dtls_pool, webrtcbin);
+  restrict_ice_ports (webrtcbin);
+
+  g_signal_emit_by_name (webrtcbin, "get-transceivers", &transceivers);
+  g_assert (transceivers != NULL && transceivers->len > 1);
+  trans = g_array_index (transceivers, GstWebRTCRTPTransceiver *, 0);
+  g_object_set (trans, "direction",
+      GST_WEBRTC_RTP_TRANSCEIVER_DIRECTION_SENDONLY, NULL);
+  /* Both have to be in the offer, the FEC percentage then follows the
+   * viewer's loss */
+  if (protection)
+    g_object_set (trans, "do-nack", TRUE, "fec-type",
+        GST_WEBRTC_FEC_TYPE_ULP_RED, "fec-percentage", 0, NULL);
+  if (video_priority) {
+    GstWebRTCPriorityType priority;
+
+    priority = _priority_from_string (video_priority);
+    if (priority) {
+      GstWebRTCRTPSender *sender;
+
+      g_object_get (trans, "sender", &sender, NULL);
+      gst_webrtc_rtp_sender_set_priority (sender, priority);
+      g_object_unref (sender);
+    }
+  }
+  trans = g_array_index (transceivers, GstWebRTCRTPTransceiver *, 1);
+  g_object_set (trans, "direction",
+      GST_WEBRTC_RTP_TRANSCEIVER_DIRECTION_SENDONLY, NULL);
+  if (audio_priority) {
+    GstWebRTCPriorityType priority;
+
+    priority = _priority_from_string (audio_priority);
+    if (priority) {
+      GstWebRTCRTPSender *sender;
+
+      g_object_get (trans, "sender", &sender, NULL);
+      gst_webrtc_rtp_sender_set_priority (sender, priority);
+      g_object_unref (sender);
+    }
+  }
+  g_array_unref (transceivers);
+  gst_object_unref (webrtcbin);
+
+  /* Brings up the DTLS and ICE agents, all that is left for PLAYING is
+   * negotiation */
+  if (gst_element_set_state (bin, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE) {
+    g_warning ("Could not bring WebRTC bin to READY");
+    gst_object_unref (bin);
+    return NULL;
+  }
+
+  return bin;
+}
+
+static void
+destroy_webrtc_bin (gpointer bin)
+{
+  gst_element_set_state (GST_ELEMENT (bin), GST_STATE_NULL);
+  gst_object_unref (bin);
+}
+
+static void
+session_pool_worker (G_GNUC_UNUSED gpointer data,
+    G_GNUC_UNUSED gpointer user_data)
+{
+  GstElement *bin = create_webrtc_bin ();
+
+  g_mutex_lock (&session_pool_lock);
+  session_pool_pending--;
+  if (bin != NULL)
+    g_queue_push_tail (&session_pool, bin);
+  g_mutex_unlock (&session_pool_lock);
+}
+
+/* Keeps enough sessions around to absorb SESSION_POOL_HORIZON seconds of
+ * joins at the rate seen over the last JOIN_RATE_WINDOW seconds */
+static guint
+session_pool_target (void)
+{
+  gint64 now = g_get_monotonic_time ();
+  guint expired = 0, target;
+
+  while (expired < join_times->len
+      && now - g_array_index (join_times, gint64,
+          expired) > JOIN_RATE_WINDOW * G_USEC_PER_SEC)
+    expired++;
+  if (expired > 0)
+    g_array_remove_range (join_times, 0, expired);
+
+  target = (join_times->len * SESSION_POOL_HORIZON + JOIN_RATE_WINDOW - 1) /
+      JOIN_RATE_WINDOW;
+
+  return CLAMP (target, (guint) session_pool_min, (guint) session_pool_max);
+}
+
+static void
+session_pool_refill (void)
+{
+  GQueue surplus = G_QUEUE_INIT;
+  guint target;
+
+  if (session_pool_workers == NULL)
+    return;
+
+  target = session_pool_target ();
+
+  g_mutex_lock (&session_pool_lock);
+  while (session_pool.length + session_pool_pending < target) {
+    session_pool_pending++;
+    g_thread_pool_push (session_pool_workers, GINT_TO_POINTER (1), NULL);
+  }
+  while (session_pool.length > target)
+    g_queue_push_tail (&surplus, g_queue_pop_tail (&session_pool));
+  g_mutex_unlock (&session_pool_lock);
+
+  g_queue_clear_full (&surplus, destroy_webrtc_bin);
+}
+
+static gboolean
+session_pool_refill_cb (G_GNUC_UNUSED gpointer user_data)
+{
+  session_pool_refill ();
+
+  return G_SOURCE_CONTINUE;
+}
+
+static GstElement *
+session_pool_take (void)
+{
+  GstElement *bin;
+  gint64 now = g_get_monotonic_time ();
+
+  g_array_append_val (join_times, now);
+
+  g_mutex_lock (&session_pool_lock);
+  bin = g_queue_pop_head (&session_pool);
+  g_mutex_unlock (&session_pool_lock);
+
+  if (bin == NULL) {
+    EXAMPLE_LOG_DEBUG ("session-pool-empty",
+        "Session pool empty, creating session on demand");
+    bin = create_webrtc_bin ();
+  }
+
+  session_pool_refill ();
+
+  return bin;
+}
+
+static void
+session_pool_init (void)
+{
+  join_times = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  if (session_pool_max <= 0)
+    return;
+
+  session_pool_min = CLAMP (session_pool_min, 0, session_pool_max);
+  session_pool_workers =
+      g_thread_pool_new (session_pool_worker, NULL, 1, FALSE, NULL);
+  session_pool_refill ();
+  g_timeout_add_seconds (1, session_pool_refill_cb, NULL);
+}
+
+static void
+session_pool_deinit (void)
+{
+  if (session_pool_workers != NULL) {
+    g_thread_pool_free (session_pool_workers, TRUE, TRUE);
+    session_pool_workers = NULL;
+  }
+
+  g_mutex_lock (&session_pool_lock);
+  g_queue_clear_full (&session_pool, destroy_webrtc_bin);
+  g_mutex_unlock (&session_pool_lock);
+
+  g_array_unref (join_times);
+  join_times = NULL;
+}
+
+static void
+reap_bin (ReaperItem * item, gboolean synchronous)
+{
+  TeardownStats *stats = &teardown_stats;
+  gint64 start = g_get_monotonic_time (), end;
+
+  gst_element_set_state (item->bin, GST_STATE_NULL);
+  gst_object_unref (item->bin);
+  end = g_get_monotonic_time ();
+
+  g_mutex_lock (&stats->lock);
+  stats->count++;
+  if (synchronous)
+    stats->synchronous++;
+  stats->latency_sum += end - item->closed_time;
+  stats->latency_max = MAX (stats->latency_max, end - item->closed_time);
+  stats->stop_sum += end - start;
+  stats->stop_max = MAX (stats->stop_max, end - start);
+  g_mutex_unlock (&stats->lock);
+
+  EXAMPLE_LOG_DEBUG ("teardown", "Viewer %u torn down %.1f ms after closing, "
+      "stopping took %.1f ms%s", item->id,
+      (end - item->closed_time) / 1000.0, (end - start) / 1000.0,
+      synchronous ? " (reaper full)" : "");
+  g_slice_free (ReaperItem, item);
+}
+
+static void
+reaper_worker (gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+  reap_bin ((ReaperItem *) data, FALSE);
+}
+
+/* Takes over the reference to @bin, which must not be in the pipeline
+ * anymore */
+static void
+reaper_push (GstElement * bin, guint id, gint64 closed_time)
+{
+  ReaperItem *item = g_slice_new (ReaperItem);
+
+  item->bin = bin;
+  item->id = id;
+  item->closed_time = closed_time;
+
+  if (reaper == NULL || g_thread_pool_unprocessed (reaper) >= REAPER_QUEUE_MAX)
+    reap_bin (item, TRUE);
+  else
+    g_thread_pool_push (reaper, item, NULL);
+}
+
+static void
+reaper_init (void)
+{
+  g_mutex_init (&teardown_stats.lock);
+  reaper = g_thread_pool_new (reaper_worker, NULL, 1, FALSE, NULL);
+}
+
+/* Waits for every queued bin to be stopped */
+static void
+reaper_deinit (void)
+{
+  if (reaper != NULL) {
+    g_thread_pool_free (reaper, FALSE, TRUE);
+    reaper = NULL;
+  }
 }
 
 ReceiverEntry *
 create_receiver_entry (SoupWebsocketConnection * connection)
 {
-  GError *error;
   ReceiverEntry *receiver_entry;
-  GstWebRTCRTPTransceiver *trans;
-  GArray *transceivers;
-  GstBus *bus;
 
   receiver_entry = g_slice_alloc0 (sizeof (ReceiverEntry));
+  receiver_entry->id = ++next_receiver_id;
+  receiver_entry->refcount = 1;
+  g_mutex_init (&receiver_entry->stats_lock);
+  g_mutex_init (&receiver_entry->ice_lock);
+  receiver_entry->worker = workers_pick ();
   receiver_entry->connection = connection;
+  receiver_entry->current_layer = receiver_entry->target_layer = n_layers / 2;
+  receiver_entry->max_temporal_layer = TEMPORAL_LAYERS - 1;
+  receiver_entry->frame_start = TRUE;
+  receiver_entry->estimate = layer_cost (receiver_entry->current_layer,
+      receiver_entry->max_temporal_layer);
+  receiver_entry->rr_loss = -1;
+  receiver_entry->protection_loss = -1;
+  receiver_entry->next_seqnum = g_random_int_range (0, G_MAXUINT16 + 1);
+  receiver_entry->audio_ssrc = g_random_int ();
+  receiver_entry->audio_next_seqnum = g_random_int_range (0, G_MAXUINT16 + 1);
 
   g_object_ref (G_OBJECT (connection));
 
   g_signal_connect (G_OBJECT (connection), "message",
       G_CALLBACK (soup_websocket_message_cb), (gpointer) receiver_entry);
 
-  error = NULL;
-  receiver_entry->pipeline =
-      gst_parse_launch ("webrtcbin name=webrtcbin stun-server=stun://"
-      STUN_SERVER " "
-      VIDEO_SRC
-      " ! videorate ! videoscale ! video/x-raw,width=640,height=360,framerate=15/1 ! videoconvert ! queue max-size-buffers=1 ! x264enc bitrate=600 speed-preset=ultrafast tune=zerolatency key-int-max=15 ! video/x-h264,profile=constrained-baseline ! queue max-size-time=100000000 ! h264parse ! "
-      "rtph264pay config-interval=-1 name=payloader aggregate-mode=zero-latency ! "
-      "application/x-rtp,media=video,encoding-name=H264,payload="
-      RTP_PAYLOAD_TYPE " ! webrtcbin. "
-      "autoaudiosrc is-live=1 ! queue max-size-buffers=1 leaky=downstream ! audioconvert ! audioresample ! opusenc ! rtpopuspay pt="
-      RTP_AUDIO_PAYLOAD_TYPE " ! webrtcbin. ", &error);
-  if (error != NULL) {
-    g_error ("Could not create WebRTC pipeline: %s\n", error->message);
-    g_error_free (error);
+  receiver_entry->bin = session_pool_take ();
+  if (receiver_entry->bin == NULL)
     goto cleanup;
-  }
 
   receiver_entry->webrtcbin =
-      gst_bin_get_by_name (GST_BIN (receiver_entry->pipeline), "webrtcbin");
+      gst_bin_get_by_name (GST_BIN (receiver_entry->bin), "webrtcbin");
   g_assert (receiver_entry->webrtcbin != NULL);
 
-  g_signal_emit_by_name (receiver_entry->webrtcbin, "get-transceivers",
-      &transceivers);
-  g_assert (transceivers != NULL && transceivers->len > 1);
-  trans = g_array_index (transceivers, GstWebRTCRTPTransceiver *, 0);
-  g_object_set (trans, "direction",
-      GST_WEBRTC_RTP_TRANSCEIVER_DIRECTION_SENDONLY, NULL);
-  if (video_priority) {
-    GstWebRTCPriorityType priority;
-
-    priority = _priority_from_string (video_priority);
-    if (priority) {
-      GstWebRTCRTPSender *sender;
-
-      g_object_get (trans, "sender", &sender, NULL);
-      gst_webrtc_rtp_sender_set_priority (sender, priority);
-      g_object_unref (sender);
-    }
-  }
-  trans = g_array_index (transceivers, GstWebRTCRTPTransceiver *, 1);
-  g_object_set (trans, "direction",
-      GST_WEBRTC_RTP_TRANSCEIVER_DIRECTION_SENDONLY, NULL);
-  if (audio_priority) {
-    GstWebRTCPriorityType priority;
-
-    priority = _priority_from_string (audio_priority);
-    if (priority) {
-      GstWebRTCRTPSender *sender;
-
-      g_object_get (trans, "sender", &sender, NULL);
-      gst_webrtc_rtp_sender_set_priority (sender, priority);
-      g_object_unref (sender);
-    }
-  }
-  g_array_unref (transceivers);
-
   g_signal_connect (receiver_entry->webrtcbin, "on-negotiation-needed",
       G_CALLBACK (on_negotiation_needed_cb), (gpointer) receiver_entry);
 
   g_signal_connect (receiver_entry->webrtcbin, "on-ice-candidate",
       G_CALLBACK (on_ice_candidate_cb), (gpointer) receiver_entry);
 
-  bus = gst_pipeline_get_bus (GST_PIPELINE (receiver_entry->pipeline));
-  gst_bus_add_watch (bus, bus_watch_cb, NULL);
-  gst_object_unref (bus);
+  if (ice_batch_ms > 0 || host_only)
+    g_signal_connect (receiver_entry->webrtcbin, "notify::ice-gathering-state",
+        G_CALLBACK (on_ice_gathering_state_notify), (gpointer) receiver_entry);
 
-  if (gst_element_set_state (receiver_entry->pipeline, GST_STATE_PLAYING) ==
-      GST_STATE_CHANGE_FAILURE)
-    g_error ("Could not start pipeline");
+  gst_bin_add (GST_BIN (pipeline), receiver_entry->bin);
+  prepare_receiver_entry (receiver_entry);
+  if (!gst_element_sync_state_with_parent (receiver_entry->bin))
+    g_error ("Could not start WebRTC bin");
+  link_receiver_entry (receiver_entry);
+
+  if (n_layers > 1)
+    send_layers (receiver_entry);
+  g_queue_push_tail (&receivers, receiver_entry);
 
   return receiver_entry;
 
@@ -311,44 +2935,191 @@ cleanup:
   return NULL;
 }
 
+/* Stopping webrtcbin shuts down DTLS, SCTP and the ICE agent and can take
+ * tens of milliseconds, which would stall the signalling of every other
+ * viewer on this context. The unlinked bin is handed to the reaper
+ * instead. */
+static gboolean
+remove_receiver_bin (gpointer user_data)
+{
+  ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
+  GstElement *bin = gst_object_ref (receiver_entry->bin);
+
+  gst_bin_remove (GST_BIN (pipeline), bin);
+  reaper_push (bin, receiver_entry->id, receiver_entry->closed_time);
+  receiver_entry_unref (receiver_entry);
+
+  return G_SOURCE_REMOVE;
+}
+
+static GstPadProbeReturn
+tee_pad_idle_cb (GstPad * tee_pad, G_GNUC_UNUSED GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
+  GstElement *tee;
+  GstPad *peer;
+
+  peer = gst_pad_get_peer (tee_pad);
+  if (peer != NULL) {
+    gst_pad_unlink (tee_pad, peer);
+    gst_object_unref (peer);
+  }
+
+  tee = gst_pad_get_parent_element (tee_pad);
+  if (tee != NULL) {
+    gst_element_release_request_pad (tee, tee_pad);
+    gst_object_unref (tee);
+  }
+
+  /* Might be called from a streaming thread, the bin itself is shut down
+   * from the main context */
+  if (g_atomic_int_dec_and_test (&receiver_entry->pending_unlinks))
+    g_main_context_invoke (receiver_entry_context (receiver_entry),
+        remove_receiver_bin, receiver_entry);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
 void
 destroy_receiver_entry (gpointer receiver_entry_ptr)
 {
   ReceiverEntry *receiver_entry = (ReceiverEntry *) receiver_entry_ptr;
+  gint i;
 
   g_assert (receiver_entry != NULL);
 
-  if (receiver_entry->pipeline != NULL) {
-    gst_element_set_state (GST_ELEMENT (receiver_entry->pipeline),
-        GST_STATE_NULL);
+  g_atomic_int_set (&receiver_entry->closed, 1);
+  receiver_entry->closed_time = g_get_monotonic_time ();
 
-    gst_object_unref (GST_OBJECT (receiver_entry->webrtcbin));
-    gst_object_unref (GST_OBJECT (receiver_entry->pipeline));
+  if (receiver_entry->connection != NULL) {
+    g_signal_handlers_disconnect_by_data (receiver_entry->connection,
+        receiver_entry);
+    g_clear_object (&receiver_entry->connection);
   }
 
-  if (receiver_entry->connection != NULL)
-    g_object_unref (G_OBJECT (receiver_entry->connection));
+  g_queue_remove (&receivers, receiver_entry);
 
-  g_slice_free1 (sizeof (ReceiverEntry), receiver_entry);
+  if (receiver_entry->bin == NULL) {
+    receiver_entry_unref (receiver_entry);
+    return;
+  }
+
+  g_signal_handlers_disconnect_by_data (receiver_entry->webrtcbin,
+      receiver_entry);
+
+  /* Detach from the tees once no buffer is being pushed to us */
+  receiver_entry->pending_unlinks = n_layers + 1;
+  for (i = 0; i < n_layers; i++)
+    gst_pad_add_probe (receiver_entry->video_tee_pads[i],
+        GST_PAD_PROBE_TYPE_IDLE, tee_pad_idle_cb, receiver_entry, NULL);
+  gst_pad_add_probe (receiver_entry->audio_tee_pad, GST_PAD_PROBE_TYPE_IDLE,
+      tee_pad_idle_cb, receiver_entry, NULL);
 }
 
 
-void
-on_offer_created_cb (GstPromise * promise, gpointer user_data)
+/* Whether @candidate is on one of the --ice-address addresses */
+static gboolean
+is_allowed_candidate (const gchar * candidate)
+{
+  gchar **fields, **address;
+  gboolean allowed = FALSE;
+
+  if (ice_addresses == NULL)
+    return TRUE;
+
+  /* foundation component transport priority address port typ type ... */
+  fields = g_strsplit (candidate, " ", 6);
+  for (address = ice_addresses; g_strv_length (fields) > 4 && *address;
+      address++)
+    allowed |= g_strcmp0 (*address, fields[4]) == 0;
+  g_strfreev (fields);
+
+  return allowed;
+}
+
+static void
+send_offer (ReceiverEntry * receiver_entry, GstSDPMessage * sdp)
 {
   gchar *sdp_string;
   gchar *json_string;
   JsonObject *sdp_json;
   JsonObject *sdp_data_json;
+
+  sdp_string = gst_sdp_message_as_text (sdp);
+  EXAMPLE_LOG_DEBUG ("offer-created", "Negotiation offer created:\n%s",
+      sdp_string);
+
+  sdp_json = json_object_new ();
+  json_object_set_string_member (sdp_json, "type", "sdp");
+
+  sdp_data_json = json_object_new ();
+  json_object_set_string_member (sdp_data_json, "type", "offer");
+  json_object_set_string_member (sdp_data_json, "sdp", sdp_string);
+  json_object_set_object_member (sdp_json, "data", sdp_data_json);
+  /* Tells the page to batch its candidates the same way */
+  if (ice_batch_ms > 0)
+    json_object_set_int_member (sdp_json, "ice-batch-ms", ice_batch_ms);
+  /* and to skip STUN as well */
+  if (host_only)
+    json_object_set_boolean_member (sdp_json, "host-only", TRUE);
+
+  json_string = get_string_from_json_object (sdp_json);
+  json_object_unref (sdp_json);
+
+  send_to_viewer (receiver_entry, json_string);
+  g_free (sdp_string);
+}
+
+/* With --host-only gathering finishes within milliseconds, the offer goes
+ * out once it has, with every candidate in it */
+static void
+send_local_description (ReceiverEntry * receiver_entry,
+    G_GNUC_UNUSED gpointer data)
+{
+  GstWebRTCSessionDescription *description = NULL;
+  guint i, j;
+
+  if (g_atomic_int_get (&receiver_entry->closed))
+    return;
+
+  g_object_get (receiver_entry->webrtcbin, "local-description", &description,
+      NULL);
+  if (description == NULL)
+    return;
+
+  for (i = 0; i < gst_sdp_message_medias_len (description->sdp); i++) {
+    GstSDPMedia *media =
+        (GstSDPMedia *) gst_sdp_message_get_media (description->sdp, i);
+
+    for (j = gst_sdp_media_attributes_len (media); j > 0; j--) {
+      const GstSDPAttribute *attribute =
+          gst_sdp_media_get_attribute (media, j - 1);
+
+      if (g_strcmp0 (attribute->key, "candidate") == 0
+          && !is_allowed_candidate (attribute->value))
+        gst_sdp_media_remove_attribute (media, j - 1);
+    }
+  }
+
+  send_offer (receiver_entry, description->sdp);
+  gst_webrtc_session_description_free (description);
+}
+
+static void
+handle_offer (ReceiverEntry * receiver_entry, gpointer data)
+{
   GstStructure const *reply;
   GstPromise *local_desc_promise;
+  GstPromise *promise = (GstPromise *) data;
   GstWebRTCSessionDescription *offer = NULL;
-  ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
+
+  if (g_atomic_int_get (&receiver_entry->closed))
+    return;
 
   reply = gst_promise_get_reply (promise);
   gst_structure_get (reply, "offer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION,
       &offer, NULL);
-  gst_promise_unref (promise);
 
   local_desc_promise = gst_promise_new ();
   g_signal_emit_by_name (receiver_entry->webrtcbin, "set-local-description",
@@ -356,39 +3127,155 @@ on_offer_created_cb (GstPromise * promise, gpointer user_data)
   gst_promise_interrupt (local_desc_promise);
   gst_promise_unref (local_desc_promise);
 
-  sdp_string = gst_sdp_message_as_text (offer->sdp);
-  gst_print ("Negotiation offer created:\n%s\n", sdp_string);
+  if (!host_only)
+    send_offer (receiver_entry, offer->sdp);
 
-  sdp_json = json_object_new ();
-  json_object_set_string_member (sdp_json, "type", "sdp");
+  gst_webrtc_session_description_free (offer);
+}
 
-  sdp_data_json = json_object_new ();
-  json_object_set_string_member (sdp_data_json, "type", "offer");
-  json_object_set_string_member (sdp_data_json, "sdp", sdp_string);
-  json_object_set_object_member (sdp_json, "data", sdp_data_json);
 
-  json_string = get_string_from_json_object (sdp_json);
-  json_object_unref (sdp_json);
+/* Called from a webrtcbin thread, the offer is handled on the worker */
+void
+on_offer_created_cb (GstPromise * promise, gpointer user_data)
+{
+  ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
 
-  soup_websocket_connection_send_text (receiver_entry->connection, json_string);
-  g_free (json_string);
-  g_free (sdp_string);
+  receiver_entry_call (receiver_entry, receiver_entry_context (receiver_entry),
+      handle_offer, gst_promise_ref (promise),
+      (GDestroyNotify) gst_promise_unref);
+}
 
-  gst_webrtc_session_description_free (offer);
+
+static void
+create_offer (ReceiverEntry * receiver_entry, G_GNUC_UNUSED gpointer data)
+{
+  GstPromise *promise;
+
+  if (g_atomic_int_get (&receiver_entry->closed))
+    return;
+
+  EXAMPLE_LOG_DEBUG ("negotiation-needed", "Creating negotiation offer");
+
+  promise = gst_promise_new_with_change_func (on_offer_created_cb,
+      receiver_entry_ref (receiver_entry), receiver_entry_unref);
+  g_signal_emit_by_name (receiver_entry->webrtcbin, "create-offer", NULL,
+      promise);
+  gst_promise_unref (promise);
 }
 
 
 void
-on_negotiation_needed_cb (GstElement * webrtcbin, gpointer user_data)
+on_negotiation_needed_cb (G_GNUC_UNUSED GstElement * webrtcbin,
+    gpointer user_data)
 {
-  GstPromise *promise;
   ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
 
-  gst_print ("Creating negotiation offer\n");
+  receiver_entry_call (receiver_entry, receiver_entry_context (receiver_entry),
+      create_offer, NULL, NULL);
+}
 
-  promise = gst_promise_new_with_change_func (on_offer_created_cb,
-      (gpointer) receiver_entry, NULL);
-  g_signal_emit_by_name (G_OBJECT (webrtcbin), "create-offer", NULL, promise);
+
+static void
+flush_ice_batch (ReceiverEntry * receiver_entry, gboolean end_of_candidates)
+{
+  JsonObject *batch_json;
+  JsonObject *batch_data_json;
+  JsonArray *candidates;
+  gchar *json_string;
+
+  g_mutex_lock (&receiver_entry->ice_lock);
+  candidates = receiver_entry->ice_batch;
+  receiver_entry->ice_batch = NULL;
+  receiver_entry->ice_batch_scheduled = FALSE;
+  g_mutex_unlock (&receiver_entry->ice_lock);
+
+  if (candidates == NULL && !end_of_candidates)
+    return;
+
+  batch_json = json_object_new ();
+  json_object_set_string_member (batch_json, "type", "ice-batch");
+
+  batch_data_json = json_object_new ();
+  json_object_set_array_member (batch_data_json, "candidates",
+      candidates != NULL ? candidates : json_array_new ());
+  json_object_set_boolean_member (batch_data_json, "end-of-candidates",
+      end_of_candidates);
+  json_object_set_object_member (batch_json, "data", batch_data_json);
+
+  json_string = get_string_from_json_object (batch_json);
+  json_object_unref (batch_json);
+
+  send_to_viewer (receiver_entry, json_string);
+}
+
+static gboolean
+flush_ice_batch_cb (gpointer user_data)
+{
+  flush_ice_batch ((ReceiverEntry *) user_data, FALSE);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+flush_ice_batch_end (ReceiverEntry * receiver_entry,
+    G_GNUC_UNUSED gpointer data)
+{
+  flush_ice_batch (receiver_entry, TRUE);
+}
+
+/* Candidates gathered within ice_batch_ms of the first one go out in a
+ * single message */
+static void
+queue_ice_candidate (ReceiverEntry * receiver_entry, guint mline_index,
+    const gchar * candidate)
+{
+  JsonObject *ice_data_json;
+  gboolean schedule;
+  GSource *source;
+
+  ice_data_json = json_object_new ();
+  json_object_set_int_member (ice_data_json, "sdpMLineIndex", mline_index);
+  json_object_set_string_member (ice_data_json, "candidate", candidate);
+
+  g_mutex_lock (&receiver_entry->ice_lock);
+  if (receiver_entry->ice_batch == NULL)
+    receiver_entry->ice_batch = json_array_new ();
+  json_array_add_object_element (receiver_entry->ice_batch, ice_data_json);
+  schedule = !receiver_entry->ice_batch_scheduled;
+  receiver_entry->ice_batch_scheduled = TRUE;
+  g_mutex_unlock (&receiver_entry->ice_lock);
+
+  if (!schedule)
+    return;
+
+  source = g_timeout_source_new (ice_batch_ms);
+  g_source_set_callback (source, flush_ice_batch_cb,
+      receiver_entry_ref (receiver_entry), receiver_entry_unref);
+  g_source_attach (source, receiver_entry_context (receiver_entry));
+  g_source_unref (source);
+}
+
+static void
+on_ice_gathering_state_notify (GstElement * webrtcbin,
+    G_GNUC_UNUSED GParamSpec * pspec, gpointer user_data)
+{
+  ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
+  GstWebRTCICEGatheringState ice_gather_state;
+
+  g_object_get (webrtcbin, "ice-gathering-state", &ice_gather_state, NULL);
+  if (ice_gather_state != GST_WEBRTC_ICE_GATHERING_STATE_COMPLETE)
+    return;
+
+  if (host_only) {
+    receiver_entry_call (receiver_entry,
+        receiver_entry_context (receiver_entry), send_local_description, NULL,
+        NULL);
+    return;
+  }
+
+  /* Sends whatever is still queued along with end-of-candidates */
+  receiver_entry_call (receiver_entry, receiver_entry_context (receiver_entry),
+      flush_ice_batch_end, NULL, NULL);
 }
 
 
@@ -401,6 +3288,15 @@ on_ice_candidate_cb (G_GNUC_UNUSED GstElement * webrtcbin, guint mline_index,
   gchar *json_string;
   ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
 
+  /* They are all in the offer */
+  if (host_only)
+    return;
+
+  if (ice_batch_ms > 0) {
+    queue_ice_candidate (receiver_entry, mline_index, candidate);
+    return;
+  }
+
   ice_json = json_object_new ();
   json_object_set_string_member (ice_json, "type", "ice");
 
@@ -412,41 +3308,28 @@ on_ice_candidate_cb (G_GNUC_UNUSED GstElement * webrtcbin, guint mline_index,
   json_string = get_string_from_json_object (ice_json);
   json_object_unref (ice_json);
 
-  soup_websocket_connection_send_text (receiver_entry->connection, json_string);
-  g_free (json_string);
+  send_to_viewer (receiver_entry, json_string);
 }
 
 
-void
-soup_websocket_message_cb (G_GNUC_UNUSED SoupWebsocketConnection * connection,
-    SoupWebsocketDataType data_type, GBytes * message, gpointer user_data)
+static void
+handle_message (ReceiverEntry * receiver_entry, gpointer data)
 {
   gsize size;
-  gchar *data;
+  gconstpointer message_data;
   gchar *data_string;
   const gchar *type_string;
   JsonNode *root_json;
   JsonObject *root_json_object;
   JsonObject *data_json_object;
   JsonParser *json_parser = NULL;
-  ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
-
-  switch (data_type) {
-    case SOUP_WEBSOCKET_DATA_BINARY:
-      g_error ("Received unknown binary message, ignoring\n");
-      g_bytes_unref (message);
-      return;
 
-    case SOUP_WEBSOCKET_DATA_TEXT:
-      data = g_bytes_unref_to_data (message, &size);
-      /* Convert to NULL-terminated string */
-      data_string = g_strndup (data, size);
-      g_free (data);
-      break;
+  if (g_atomic_int_get (&receiver_entry->closed))
+    return;
 
-    default:
-      g_assert_not_reached ();
-  }
+  message_data = g_bytes_get_data ((GBytes *) data, &size);
+  /* Convert to NULL-terminated string */
+  data_string = g_strndup (message_data, size);
 
   json_parser = json_parser_new ();
   if (!json_parser_load_from_data (json_parser, data_string, -1, NULL))
@@ -496,7 +3379,7 @@ soup_websocket_message_cb (G_GNUC_UNUSED SoupWebsocketConnection * connection,
     }
     sdp_string = json_object_get_string_member (data_json_object, "sdp");
 
-    gst_print ("Received SDP:\n%s\n", sdp_string);
+    EXAMPLE_LOG_DEBUG ("sdp-received", "Received SDP:\n%s", sdp_string);
 
     ret = gst_sdp_message_new (&sdp);
     g_assert_cmphex (ret, ==, GST_SDP_OK);
@@ -537,11 +3420,74 @@ soup_websocket_message_cb (G_GNUC_UNUSED SoupWebsocketConnection * connection,
     candidate_string = json_object_get_string_member (data_json_object,
         "candidate");
 
-    gst_print ("Received ICE candidate with mline index %u; candidate: %s\n",
+    EXAMPLE_LOG_DEBUG ("ice-received",
+        "Received ICE candidate with mline index %u; candidate: %s",
         mline_index, candidate_string);
 
     g_signal_emit_by_name (receiver_entry->webrtcbin, "add-ice-candidate",
         mline_index, candidate_string);
+  } else if (g_strcmp0 (type_string, "ice-batch") == 0) {
+    JsonArray *candidates;
+    guint i, len;
+
+    if (!json_object_has_member (data_json_object, "candidates")) {
+      g_error ("Received ICE batch message without candidates\n");
+      goto cleanup;
+    }
+    candidates = json_object_get_array_member (data_json_object,
+        "candidates");
+
+    len = json_array_get_length (candidates);
+    EXAMPLE_LOG_DEBUG ("ice-batch-received",
+        "Received batch of %u ICE candidates", len);
+
+    for (i = 0; i < len; i++) {
+      JsonObject *candidate_json = json_array_get_object_element (candidates,
+          i);
+
+      if (candidate_json == NULL
+          || !json_object_has_member (candidate_json, "sdpMLineIndex")
+          || !json_object_has_member (candidate_json, "candidate"))
+        continue;
+
+      g_signal_emit_by_name (receiver_entry->webrtcbin, "add-ice-candidate",
+          (guint) json_object_get_int_member (candidate_json,
+              "sdpMLineIndex"), json_object_get_string_member (candidate_json,
+              "candidate"));
+    }
+
+    /* An empty candidate signals end-of-candidates, for every m-line */
+    if (json_object_has_member (data_json_object, "end-of-candidates")
+        && json_object_get_boolean_member (data_json_object,
+            "end-of-candidates")) {
+      GArray *transceivers;
+
+      g_signal_emit_by_name (receiver_entry->webrtcbin, "get-transceivers",
+          &transceivers);
+      for (i = 0; i < transceivers->len; i++)
+        g_signal_emit_by_name (receiver_entry->webrtcbin, "add-ice-candidate",
+            i, "");
+      g_array_unref (transceivers);
+    }
+  } else if (g_strcmp0 (type_string, "layer") == 0) {
+    const gchar *rid;
+    gint i;
+
+    if (!json_object_has_member (data_json_object, "rid")) {
+      g_error ("Received layer message without rid\n");
+      goto cleanup;
+    }
+    rid = json_object_get_string_member (data_json_object, "rid");
+
+    /* Caps the quality of this viewer, loss adaptation stays below it */
+    for (i = 0; i < n_layers; i++) {
+      if (g_strcmp0 (rid, layers[i].rid) == 0) {
+        g_atomic_int_set (&receiver_entry->best_layer, i);
+        set_target_layer (receiver_entry,
+            g_atomic_int_get (&receiver_entry->target_layer));
+        break;
+      }
+    }
   } else
     goto unknown_message;
 
@@ -557,37 +3503,69 @@ unknown_message:
 }
 
 
+void
+soup_websocket_message_cb (G_GNUC_UNUSED SoupWebsocketConnection * connection,
+    SoupWebsocketDataType data_type, GBytes * message, gpointer user_data)
+{
+  ReceiverEntry *receiver_entry = (ReceiverEntry *) user_data;
+
+  switch (data_type) {
+    case SOUP_WEBSOCKET_DATA_BINARY:
+      g_error ("Received unknown binary message, ignoring\n");
+      return;
+
+    case SOUP_WEBSOCKET_DATA_TEXT:
+      /* Parsed and handled on the worker the viewer is pinned to */
+      receiver_entry_call (receiver_entry,
+          receiver_entry_context (receiver_entry), handle_message,
+          g_bytes_ref (message), (GDestroyNotify) g_bytes_unref);
+      break;
+
+    default:
+      g_assert_not_reached ();
+  }
+}
+
+
 void
 soup_websocket_closed_cb (SoupWebsocketConnection * connection,
     gpointer user_data)
 {
   GHashTable *receiver_entry_table = (GHashTable *) user_data;
   g_hash_table_remove (receiver_entry_table, connection);
-  gst_print ("Closed websocket connection %p\n", (gpointer) connection);
+  EXAMPLE_LOG_RATELIMITED (50, EXAMPLE_LOG_LEVEL_INFO, "websocket-closed",
+      "Closed websocket connection %p", (gpointer) connection);
 }
 
 
 void
 soup_http_handler (G_GNUC_UNUSED SoupServer * soup_server,
     SoupMessage * message, const char *path, G_GNUC_UNUSED GHashTable * query,
-    G_GNUC_UNUSED SoupClientContext * client_context,
-    G_GNUC_UNUSED gpointer user_data)
+    G_GNUC_UNUSED SoupClientContext * client_context, gpointer user_data)
 {
-  SoupBuffer *soup_buffer;
+  ExampleAssets *assets = (ExampleAssets *) user_data;
 
-  if ((g_strcmp0 (path, "/") != 0) && (g_strcmp0 (path, "/index.html") != 0)) {
+  if (!example_assets_serve (assets, message, path))
     soup_message_set_status (message, SOUP_STATUS_NOT_FOUND);
-    return;
-  }
+}
 
-  soup_buffer =
-      soup_buffer_new (SOUP_MEMORY_STATIC, html_source, strlen (html_source));
 
-  soup_message_headers_set_content_type (message->response_headers, "text/html",
-      NULL);
-  soup_message_body_append_buffer (message->response_body, soup_buffer);
-  soup_buffer_free (soup_buffer);
+void
+soup_stats_handler (G_GNUC_UNUSED SoupServer * soup_server,
+    SoupMessage * message, G_GNUC_UNUSED const char *path,
+    G_GNUC_UNUSED GHashTable * query,
+    G_GNUC_UNUSED SoupClientContext * client_context,
+    G_GNUC_UNUSED gpointer user_data)
+{
+  JsonObject *stats_json;
+  gchar *json_string;
 
+  stats_json = get_server_stats_json ();
+  json_string = get_string_from_json_object (stats_json);
+  json_object_unref (stats_json);
+
+  soup_message_set_response (message, "application/json", SOUP_MEMORY_TAKE,
+      json_string, strlen (json_string));
   soup_message_set_status (message, SOUP_STATUS_OK);
 }
 
@@ -600,7 +3578,8 @@ soup_websocket_handler (G_GNUC_UNUSED SoupServer * server,
   ReceiverEntry *receiver_entry;
   GHashTable *receiver_entry_table = (GHashTable *) user_data;
 
-  gst_print ("Processing new websocket connection %p", (gpointer) connection);
+  EXAMPLE_LOG_RATELIMITED (50, EXAMPLE_LOG_LEVEL_INFO, "websocket-new",
+      "Processing new websocket connection %p", (gpointer) connection);
 
   g_signal_connect (G_OBJECT (connection), "closed",
       G_CALLBACK (soup_websocket_closed_cb), (gpointer) receiver_entry_table);
@@ -648,6 +3627,73 @@ static GOptionEntry entries[] = {
   {"audio-priority", 0, 0, G_OPTION_ARG_STRING, &audio_priority,
         "Priority of the audio stream (very-low, low, medium or high)",
       "PRIORITY"},
+  {"session-pool-min", 0, 0, G_OPTION_ARG_INT, &session_pool_min,
+        "Minimum number of pre-warmed WebRTC sessions (default: 2)", "N"},
+  {"session-pool-max", 0, 0, G_OPTION_ARG_INT, &session_pool_max,
+        "Maximum number of pre-warmed WebRTC sessions, 0 disables the pool "
+        "(default: 32)", "N"},
+  {"simulcast", 0, 0, G_OPTION_ARG_NONE, &simulcast,
+        "Encode 720p, 360p and 180p layers and pick one per viewer", NULL},
+  {"temporal-layers", 0, 0, G_OPTION_ARG_NONE, &temporal_layers,
+        "Encode VP8 with three temporal layers and drop the upper ones for "
+        "congested viewers", NULL},
+  {"ice-batch-ms", 0, 0, G_OPTION_ARG_INT, &ice_batch_ms,
+        "Send ICE candidates gathered within this many milliseconds in one "
+        "message, followed by end-of-candidates, 0 disables batching "
+        "(default: 0)", "MS"},
+  {"no-protection", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &protection,
+        "Negotiate neither NACK/RTX nor FEC, instead of adapting FEC to "
+        "each viewer's loss", NULL},
+  {"pacing", 0, 0, G_OPTION_ARG_DOUBLE, &pacing,
+        "Pace the video packets at this multiple of the encoder bitrate "
+        "instead of sending keyframes in one burst, e.g. 2.5, 0 disables "
+        "pacing (default: 0)", "FACTOR"},
+  {"pacing-max-delay", 0, 0, G_OPTION_ARG_INT, &pacing_max_delay,
+        "Longest a packet is held back for pacing (default: 100)", "MS"},
+  {"dtls-pool", 0, 0, G_OPTION_ARG_INT, &dtls_pool_size,
+        "Share this many DTLS certificates between all sessions instead of "
+        "one per session, 0 disables the pool (default: 0)", "N"},
+  {"dtls-cert-dir", 0, 0, G_OPTION_ARG_FILENAME, &dtls_cert_dir,
+        "Load the pooled DTLS certificates from the PEM files in this "
+        "directory, generating the rest", "DIR"},
+  {"dtls-rotate", 0, 0, G_OPTION_ARG_INT, &dtls_rotate,
+        "Seconds after which the DTLS certificate pool is renewed, 0 keeps "
+        "it (default: 86400)", "SECONDS"},
+  {"host-only", 0, 0, G_OPTION_ARG_NONE, &host_only,
+        "Skip STUN and send all host candidates in the offer instead of "
+        "trickling them, for servers with a public address", NULL},
+  {"ice-address", 0, 0, G_OPTION_ARG_STRING_ARRAY, &ice_addresses,
+        "With --host-only, only offer candidates on this address, may be "
+        "given more than once", "ADDRESS"},
+  {"ice-ports", 0, 0, G_OPTION_ARG_STRING, &ice_ports,
+        "Bundle each session onto one socket and keep all sessions' "
+        "sockets within this port range, e.g. 50000-50999", "MIN-MAX"},
+  {"per-viewer-audio", 0, 0, G_OPTION_ARG_NONE, &per_viewer_audio,
+        "Encode audio separately for every viewer instead of once, to "
+        "compare the cost", NULL},
+  {"workers", 0, 0, G_OPTION_ARG_INT, &n_workers,
+        "Number of threads handling viewer signalling and negotiation, 0 "
+        "handles everything on the main loop (default: 0)", "N"},
+  {"encoder", 0, 0, G_OPTION_ARG_STRING, &encoder_name,
+        "Video encoder: x264, openh264, vp8, vp9 or av1 (default: x264, "
+        "vp8 with --temporal-layers)", "NAME"},
+  {"encoder-preset", 0, 0, G_OPTION_ARG_STRING, &encoder_preset,
+        "Encoder settings, realtime or quality (default: realtime)",
+      "PRESET"},
+  {"cpu-adapt", 0, 0, G_OPTION_ARG_NONE, &cpu_adapt,
+        "Switch between the encoder presets and lower the resolution or "
+        "frame rate as the encoders keep up, starting at --encoder-preset",
+      NULL},
+  {"degradation", 0, 0, G_OPTION_ARG_STRING, &degradation,
+        "What --cpu-adapt lowers after the preset: maintain-framerate, "
+        "maintain-resolution or balanced (default: maintain-framerate)",
+      "PREFERENCE"},
+  {"vod", 0, 0, G_OPTION_ARG_FILENAME, &vod_location,
+        "Send the H.264 video of this MP4 or MKV file, looped, instead of "
+        "encoding the camera, all viewers share one playout", "FILE"},
+  {"assets-dir", 0, 0, G_OPTION_ARG_FILENAME, &assets_dir,
+        "Serve the page and its assets from this directory instead of the "
+        "embedded page", "DIR"},
   {NULL},
 };
 
@@ -656,6 +3702,7 @@ main (int argc, char *argv[])
 {
   GMainLoop *mainloop;
   SoupServer *soup_server;
+  ExampleAssets *assets;
   GHashTable *receiver_entry_table;
   GOptionContext *context;
   GError *error = NULL;
@@ -665,15 +3712,37 @@ main (int argc, char *argv[])
   context = g_option_context_new ("- gstreamer webrtc sendonly demo");
   g_option_context_add_main_entries (context, entries, NULL);
   g_option_context_add_group (context, gst_init_get_option_group ());
+  g_option_context_add_group (context, example_tracer_get_option_group ());
   if (!g_option_context_parse (context, &argc, &argv, &error)) {
     g_printerr ("Error initializing: %s\n", error->message);
     return -1;
   }
 
+  example_log_init ();
+  example_tracer_init ();
+
   receiver_entry_table =
       g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
       destroy_receiver_entry);
 
+  if (!parse_ice_ports () || !select_video_encoder ()
+      || !create_shared_pipeline ())
+    return -1;
+
+  if (dtls_pool_size > 0 || dtls_cert_dir != NULL)
+    dtls_pool = example_dtls_pool_new (dtls_pool_size > 0 ? dtls_pool_size :
+        DTLS_POOL_DEFAULT_SIZE, dtls_cert_dir, MAX (dtls_rotate, 0));
+
+  session_pool_init ();
+  reaper_init ();
+  workers_init ();
+  g_timeout_add_seconds (BWE_INTERVAL, bwe_timeout_cb, NULL);
+  g_timeout_add_seconds (KEYFRAME_STATS_INTERVAL, keyframe_stats_cb, NULL);
+  if (encoder_control != NULL)
+    g_timeout_add_seconds (ENCODER_CONTROL_INTERVAL,
+        encoder_control_timeout_cb, NULL);
+  g_timeout_add (STATS_SLICE, stats_timeout_cb, NULL);
+
   mainloop = g_main_loop_new (NULL, FALSE);
   g_assert (mainloop != NULL);
 
@@ -682,9 +3751,15 @@ main (int argc, char *argv[])
   g_unix_signal_add (SIGTERM, exit_sighandler, mainloop);
 #endif
 
+  assets = example_assets_new (assets_dir);
+  example_assets_add_embedded (assets, "/index.html", "text/html", html_source);
+  example_assets_add_alias (assets, "/", "/index.html");
+
   soup_server =
       soup_server_new (SOUP_SERVER_SERVER_HEADER, "webrtc-soup-server", NULL);
-  soup_server_add_handler (soup_server, "/", soup_http_handler, NULL, NULL);
+  soup_server_add_handler (soup_server, "/", soup_http_handler, assets, NULL);
+  soup_server_add_handler (soup_server, "/stats", soup_stats_handler, NULL,
+      NULL);
   soup_server_add_websocket_handler (soup_server, "/ws", NULL, NULL,
       soup_websocket_handler, (gpointer) receiver_entry_table, NULL);
   soup_server_listen_all (soup_server, SOUP_HTTP_PORT,
@@ -695,9 +3770,20 @@ main (int argc, char *argv[])
   g_main_loop_run (mainloop);
 
   g_object_unref (G_OBJECT (soup_server));
+  example_assets_free (assets);
+  /* Stop streaming first so the viewers detach from the tees right away */
+  gst_element_set_state (pipeline, GST_STATE_NULL);
   g_hash_table_destroy (receiver_entry_table);
+  workers_deinit ();
+  reaper_deinit ();
+  session_pool_deinit ();
+  if (dtls_pool != NULL)
+    example_dtls_pool_free (dtls_pool);
+  destroy_shared_pipeline ();
   g_main_loop_unref (mainloop);
 
+  example_tracer_deinit ();
+  example_log_deinit ();
   gst_deinit ();
 
   return 0;
@@ -19,6 +19,9 @@
 
 #include <string.h>
 
+#include "example-pacer.h"
+#include "example-tracer.h"
+
 enum AppState
 {
   APP_STATE_UNKNOWN = 0,
@@ -54,6 +57,9 @@ static gchar *our_id = NULL;
 static const gchar *server_url = "wss://webrtc.nirbheek.in:8443";
 static gboolean disable_ssl = FALSE;
 static gboolean remote_is_offerer = FALSE;
+static gdouble pacing = 0;
+static gint pacing_max_delay = 100;
+static ExamplePacer *video_pacer = NULL;
 
 static GOptionEntry entries[] = {
   {"peer-id", 0, 0, G_OPTION_ARG_STRING, &peer_id,
@@ -65,6 +71,11 @@ static GOptionEntry entries[] = {
   {"disable-ssl", 0, 0, G_OPTION_ARG_NONE, &disable_ssl, "Disable ssl", NULL},
   {"remote-offerer", 0, 0, G_OPTION_ARG_NONE, &remote_is_offerer,
       "Request that the peer generate the offer and we'll answer", NULL},
+  {"pacing", 0, 0, G_OPTION_ARG_DOUBLE, &pacing,
+      "Pace the video packets at this multiple of the encoder bitrate, "
+      "0 sends them as they are encoded (default: 0)", "FACTOR"},
+  {"pacing-max-delay", 0, 0, G_OPTION_ARG_INT, &pacing_max_delay,
+      "Longest a packet is held back for pacing (default: 100)", "MS"},
   {NULL},
 };
 
@@ -421,6 +432,10 @@ webrtcbin_get_stats (GstElement * webrtcbin)
   return G_SOURCE_REMOVE;
 }
 
+/* Set explicitly, vp8enc picks one from the resolution by default and the
+ * pacer needs to know it */
+#define VIDEO_BITRATE 512000
+
 #define RTP_TWCC_URI "http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01"
 
 static gboolean
@@ -437,10 +452,11 @@ start_pipeline (gboolean create_offer)
        * periods between keyframes and rely on PLI events on packet loss to
        * fix corrupted video.
        */
-      "vp8enc deadline=1 keyframe-max-dist=2000 ! "
+      "vp8enc name=videoenc deadline=1 keyframe-max-dist=2000 "
+      "target-bitrate=" G_STRINGIFY (VIDEO_BITRATE) " ! "
       /* picture-id-mode=15-bit seems to make TWCC stats behave better */
       "rtpvp8pay name=videopay picture-id-mode=15-bit ! "
-      "queue ! " RTP_CAPS_VP8 "96 ! sendrecv. "
+      "queue name=videopayqueue ! " RTP_CAPS_VP8 "96 ! sendrecv. "
       "audiotestsrc is-live=true wave=red-noise ! audioconvert ! audioresample ! queue ! opusenc ! rtpopuspay name=audiopay ! "
       "queue ! " RTP_CAPS_OPUS "97 ! sendrecv. ", &error);
 
@@ -453,6 +469,21 @@ start_pipeline (gboolean create_offer)
   webrtc1 = gst_bin_get_by_name (GST_BIN (pipe1), "sendrecv");
   g_assert_nonnull (webrtc1);
 
+  if (pacing > 0) {
+    GstElement *videoenc, *queue;
+    gint bitrate;
+
+    videoenc = gst_bin_get_by_name (GST_BIN (pipe1), "videoenc");
+    g_object_get (videoenc, "target-bitrate", &bitrate, NULL);
+    queue = gst_bin_get_by_name (GST_BIN (pipe1), "videopayqueue");
+    video_pacer = example_pacer_new (queue, pacing, MAX (pacing_max_delay, 0));
+    example_pacer_set_bitrate (video_pacer, bitrate / 1000);
+    if (bitrate <= 0)
+      gst_printerr ("vp8enc has no target bitrate, not pacing\n");
+    gst_object_unref (queue);
+    gst_object_unref (videoenc);
+  }
+
   if (remote_is_offerer) {
     /* XXX: this will fail when the remote offers twcc as the extension id
      * cannot currently be negotiated when receiving an offer.
@@ -916,6 +947,7 @@ main (int argc, char *argv[])
   context = g_option_context_new ("- gstreamer webrtc sendrecv demo");
   g_option_context_add_main_entries (context, entries, NULL);
   g_option_context_add_group (context, gst_init_get_option_group ());
+  g_option_context_add_group (context, example_tracer_get_option_group ());
   if (!g_option_context_parse (context, &argc, &argv, &error)) {
     gst_printerr ("Error initializing: %s\n", error->message);
     return -1;
@@ -950,6 +982,8 @@ main (int argc, char *argv[])
     gst_uri_unref (uri);
   }
 
+  example_tracer_init ();
+
   loop = g_main_loop_new (NULL, FALSE);
 
   connect_to_websocket_server_async ();
@@ -965,6 +999,19 @@ main (int argc, char *argv[])
     gst_object_unref (pipe1);
   }
 
+  if (video_pacer) {
+    ExamplePacerStats stats;
+
+    example_pacer_get_stats (video_pacer, &stats);
+    gst_print ("Paced %" G_GUINT64_FORMAT " packets, %" G_GUINT64_FORMAT
+        " held back, %" G_GUINT64_FORMAT " over the delay limit, delay "
+        "%.1f ms average, %.1f ms max\n", stats.packets, stats.delayed,
+        stats.overflows, stats.delay_avg_ms, stats.delay_max_ms);
+    example_pacer_free (video_pacer);
+  }
+
+  example_tracer_deinit ();
+
 out:
   g_free (peer_id);
   g_free (our_id);